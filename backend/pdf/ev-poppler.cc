@@ -23,6 +23,13 @@
 
 #include <math.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 #include <gtk/gtk.h>
 #include <poppler.h>
 #include <poppler-document.h>
@@ -34,6 +41,7 @@
 #include <cairo-ps.h>
 #endif
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 
 #include "ev-poppler.h"
 #include "ev-file-exporter.h"
@@ -53,6 +61,8 @@
 #include "ev-selection.h"
 #include "ev-transition-effect.h"
 #include "ev-attachment.h"
+#include "ev-cached-input-stream.h"
+#include "ev-file-helpers.h"
 #include "ev-image.h"
 
 #include <libxml/tree.h>
@@ -235,6 +245,121 @@ convert_error (GError  *poppler_error,
 
 
 /* EvDocument */
+#ifdef FICLONE
+static gboolean
+write_all (gint         fd,
+	   const gchar *data,
+	   gsize        len)
+{
+	while (len > 0) {
+		gssize n_written = write (fd, data, len);
+
+		if (n_written == -1) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		data += n_written;
+		len -= n_written;
+	}
+
+	return TRUE;
+}
+
+/* When the document is modified, poppler writes an incremental update:
+ * the original file verbatim followed by the updated objects. On file
+ * systems supporting reflinks, @uri is made a clone of the original,
+ * poppler saves into a temp file (which needs to be seekable for the
+ * xref offsets), and only what follows the original in its output is
+ * appended to @uri. Returns FALSE without touching @uri when reflinks
+ * aren't supported, or after overwriting it with the original when the
+ * update couldn't be appended, so that the whole document is saved.
+ */
+static gboolean
+pdf_document_save_incremental (PdfDocument *pdf_document,
+			       const char  *uri)
+{
+	const gchar *source_uri;
+	gchar       *source_filename = NULL;
+	gchar       *filename = NULL;
+	gchar       *tmp_filename = NULL;
+	gchar       *tmp_uri = NULL;
+	gint         source_fd = -1;
+	gint         fd = -1;
+	gint         tmp_fd;
+	GMappedFile *source = NULL;
+	GMappedFile *output = NULL;
+	gsize        source_len;
+	gsize        output_len;
+	gboolean     retval = FALSE;
+
+	source_uri = ev_document_get_uri (EV_DOCUMENT (pdf_document));
+	if (!source_uri)
+		return FALSE;
+
+	source_filename = g_filename_from_uri (source_uri, NULL, NULL);
+	filename = g_filename_from_uri (uri, NULL, NULL);
+	if (!source_filename || !filename)
+		goto out;
+
+	source_fd = g_open (source_filename, O_RDONLY, 0);
+	if (source_fd == -1)
+		goto out;
+
+	/* The target is not truncated, if cloning fails it's unchanged */
+	fd = g_open (filename, O_WRONLY | O_CREAT, 0666);
+	if (fd == -1 || ioctl (fd, FICLONE, source_fd) == -1)
+		goto out;
+
+	source = g_mapped_file_new_from_fd (source_fd, FALSE, NULL);
+	tmp_fd = ev_mkstemp ("saveincr.XXXXXX", &tmp_filename, NULL);
+	if (!source || tmp_fd == -1)
+		goto out;
+	close (tmp_fd);
+
+	tmp_uri = g_filename_to_uri (tmp_filename, NULL, NULL);
+	if (!tmp_uri || !poppler_document_save (pdf_document->document, tmp_uri, NULL))
+		goto out;
+
+	output = g_mapped_file_new (tmp_filename, FALSE, NULL);
+	if (!output)
+		goto out;
+
+	source_len = g_mapped_file_get_length (source);
+	output_len = g_mapped_file_get_length (output);
+
+	/* poppler rewrites the whole file, for instance when the xref
+	 * had to be reconstructed */
+	if (output_len < source_len ||
+	    memcmp (g_mapped_file_get_contents (output),
+		    g_mapped_file_get_contents (source),
+		    source_len) != 0)
+		goto out;
+
+	retval = lseek (fd, 0, SEEK_END) == (off_t) source_len &&
+		write_all (fd, g_mapped_file_get_contents (output) + source_len,
+			   output_len - source_len);
+out:
+	if (fd != -1 && close (fd) == -1)
+		retval = FALSE;
+	if (output)
+		g_mapped_file_unref (output);
+	if (source)
+		g_mapped_file_unref (source);
+	if (source_fd != -1)
+		close (source_fd);
+	if (tmp_filename) {
+		g_unlink (tmp_filename);
+		g_free (tmp_filename);
+	}
+	g_free (tmp_uri);
+	g_free (filename);
+	g_free (source_filename);
+
+	return retval;
+}
+#endif /* FICLONE */
+
 static gboolean
 pdf_document_save (EvDocument  *document,
 		   const char  *uri,
@@ -245,6 +370,10 @@ pdf_document_save (EvDocument  *document,
 	GError *poppler_error = NULL;
 
 	if (pdf_document->forms_modified || pdf_document->annots_modified) {
+#ifdef FICLONE
+		retval = pdf_document_save_incremental (pdf_document, uri);
+		if (!retval)
+#endif
 		retval = poppler_document_save (pdf_document->document,
 						uri, &poppler_error);
 		if (retval) {
@@ -315,11 +444,29 @@ pdf_document_load_gfile (EvDocument          *document,
         GError *err = NULL;
         PdfDocument *pdf_document = PDF_DOCUMENT (document);
 
-        pdf_document->document =
-                poppler_document_new_from_gfile (file,
-                                                 pdf_document->password,
-                                                 cancellable,
-                                                 &err);
+        if (!g_file_is_native (file)) {
+                GInputStream *stream;
+
+                /* Fetch remote documents on demand, so that only the
+                 * xref and the objects actually needed are transferred.
+                 * When that's not possible, G_IO_ERROR_NOT_SUPPORTED is
+                 * returned so that the caller loads a local copy */
+                stream = ev_cached_input_stream_new (file, cancellable, &err);
+                if (stream) {
+                        pdf_document->document =
+                                poppler_document_new_from_stream (stream, -1,
+                                                                  pdf_document->password,
+                                                                  cancellable,
+                                                                  &err);
+                        g_object_unref (stream);
+                }
+        } else {
+                pdf_document->document =
+                        poppler_document_new_from_gfile (file,
+                                                         pdf_document->password,
+                                                         cancellable,
+                                                         &err);
+        }
 
         if (pdf_document->document == NULL) {
                 convert_error (err, error);
@@ -1089,8 +1236,8 @@ pdf_document_fonts_get_fonts_summary (EvDocumentFonts *document_fonts)
 }
 
 static void
-pdf_document_fonts_fill_model (EvDocumentFonts *document_fonts,
-			       GtkTreeModel    *model)
+pdf_document_fonts_get_fonts (EvDocumentFonts *document_fonts,
+			      GPtrArray       *fonts)
 {
 	PdfDocument *pdf_document = PDF_DOCUMENT (document_fonts);
 	PopplerFontsIter *iter = pdf_document->fonts_iter;
@@ -1101,7 +1248,7 @@ pdf_document_fonts_fill_model (EvDocumentFonts *document_fonts,
 		return;
 
 	do {
-		GtkTreeIter list_iter;
+		gchar **font;
 		const char *name;
 		PopplerFontType type;
 		const char *type_str;
@@ -1172,20 +1319,18 @@ pdf_document_fonts_fill_model (EvDocumentFonts *document_fonts,
 							   type_str, standard_str,
 							   encoding_text, encoding, embedded);
 
-		gtk_list_store_append (GTK_LIST_STORE (model), &list_iter);
-		gtk_list_store_set (GTK_LIST_STORE (model), &list_iter,
-				    EV_DOCUMENT_FONTS_COLUMN_NAME, name,
-				    EV_DOCUMENT_FONTS_COLUMN_DETAILS, details,
-				    -1);
-
-		g_free (details);
+		font = g_new (gchar *, 3);
+		font[0] = g_strdup (name);
+		font[1] = details;
+		font[2] = NULL;
+		g_ptr_array_add (fonts, font);
 	} while (poppler_fonts_iter_next (iter));
 }
 
 static void
 pdf_document_document_fonts_iface_init (EvDocumentFontsInterface *iface)
 {
-	iface->fill_model = pdf_document_fonts_fill_model;
+	iface->get_fonts = pdf_document_fonts_get_fonts;
 	iface->get_fonts_summary = pdf_document_fonts_get_fonts_summary;
 	iface->scan = pdf_document_fonts_scan;
 	iface->get_progress = pdf_document_fonts_get_progress;
@@ -1207,6 +1352,24 @@ pdf_document_links_has_document_links (EvDocumentLinks *document_links)
 	return TRUE;
 }
 
+/* Destinations only need the page height to flip the y axis, so take it
+ * from the document page size cache instead of loading the page.
+ */
+static double
+pdf_document_get_page_height (PdfDocument *pdf_document,
+			      gint         page_index)
+{
+	EvDocument *document = EV_DOCUMENT (pdf_document);
+	double      height = 0;
+
+	if (page_index < 0 || page_index >= ev_document_get_n_pages (document))
+		return 0;
+
+	ev_document_get_page_size (document, page_index, NULL, &height);
+
+	return height;
+}
+
 static EvLinkDest *
 ev_link_dest_from_dest (PdfDocument *pdf_document,
 			PopplerDest *dest)
@@ -1218,12 +1381,10 @@ ev_link_dest_from_dest (PdfDocument *pdf_document,
 
 	switch (dest->type) {
 	        case POPPLER_DEST_XYZ: {
-			PopplerPage *poppler_page;
 			double height;
 
-			poppler_page = poppler_document_get_page (pdf_document->document,
-								  MAX (0, dest->page_num - 1));
-			poppler_page_get_size (poppler_page, NULL, &height);
+			height = pdf_document_get_page_height (pdf_document,
+							       MAX (0, dest->page_num - 1));
 			ev_dest = ev_link_dest_new_xyz (dest->page_num - 1,
 							dest->left,
 							height - MIN (height, dest->top),
@@ -1231,7 +1392,6 @@ ev_link_dest_from_dest (PdfDocument *pdf_document,
 							dest->change_left,
 							dest->change_top,
 							dest->change_zoom);
-			g_object_unref (poppler_page);
 		}
 			break;
 	        case POPPLER_DEST_FITB:
@@ -1240,16 +1400,13 @@ ev_link_dest_from_dest (PdfDocument *pdf_document,
 			break;
 		case POPPLER_DEST_FITBH:
 	        case POPPLER_DEST_FITH: {
-			PopplerPage *poppler_page;
 			double height;
 
-			poppler_page = poppler_document_get_page (pdf_document->document,
-								  MAX (0, dest->page_num - 1));
-			poppler_page_get_size (poppler_page, NULL, &height);
+			height = pdf_document_get_page_height (pdf_document,
+							       MAX (0, dest->page_num - 1));
 			ev_dest = ev_link_dest_new_fith (dest->page_num - 1,
 							 height - MIN (height, dest->top),
 							 dest->change_top);
-			g_object_unref (poppler_page);
 		}
 			break;
 		case POPPLER_DEST_FITBV:
@@ -1259,12 +1416,10 @@ ev_link_dest_from_dest (PdfDocument *pdf_document,
 							 dest->change_left);
 			break;
 	        case POPPLER_DEST_FITR: {
-			PopplerPage *poppler_page;
 			double height;
 
-			poppler_page = poppler_document_get_page (pdf_document->document,
-								  MAX (0, dest->page_num - 1));
-			poppler_page_get_size (poppler_page, NULL, &height);
+			height = pdf_document_get_page_height (pdf_document,
+							       MAX (0, dest->page_num - 1));
 			/* for evince we ensure that bottom <= top and left <= right */
 			/* also evince has its origin in the top left, so we invert the y axis. */
 			ev_dest = ev_link_dest_new_fitr (dest->page_num - 1,
@@ -1272,7 +1427,6 @@ ev_link_dest_from_dest (PdfDocument *pdf_document,
 							 height - MIN (height, MIN (dest->bottom, dest->top)),
 							 MAX (dest->left, dest->right),
 							 height - MIN (height, MAX (dest->bottom, dest->top)));
-			g_object_unref (poppler_page);
 		}
 			break;
 	        case POPPLER_DEST_NAMED:
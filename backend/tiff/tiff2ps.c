@@ -109,6 +109,8 @@
  * NB: this code assumes uint32 works with printf's %l[ud].
  */
 
+#define	HEXBUFSIZE	65536
+
 struct _TIFF2PSContext
 {
 	char *filename;		/* input filename */
@@ -146,6 +148,15 @@ struct _TIFF2PSContext
 	uint16 compression;
 	uint16 extrasamples;
 	int alpha;
+
+	/*
+	 * Hex encoded image data is staged in hexbuf and written
+	 * out in blocks; the scanline buffer is kept across pages.
+	 */
+	char hexbuf[HEXBUFSIZE];
+	int hexcount;
+	unsigned char *tf_buf;
+	tsize_t tf_bufsize;
 };
 
 static void PSpage(TIFF2PSContext*, TIFF*, uint32, uint32);
@@ -186,6 +197,8 @@ TIFF2PSContext* tiff2ps_context_new(const gchar *filename) {
 void tiff2ps_context_finalize(TIFF2PSContext *ctx) {
 	PSTail(ctx);
 	fclose(ctx->fd);
+	if (ctx->tf_buf)
+		_TIFFfree(ctx->tf_buf);
 	g_free(ctx->filename);
 	g_free(ctx);
 }
@@ -1361,12 +1374,41 @@ PSColorSeparatePreamble(TIFF2PSContext* ctx, uint32 w, uint32 h, int nc)
 	fprintf(ctx->fd, "true %d colorimage\n", nc);
 }
 
-#define	DOBREAK(len, howmany, fd) \
-	if (((len) -= (howmany)) <= 0) {	\
-		putc('\n', fd);			\
-		(len) = MAXLINE-(howmany);	\
+static void
+HexFlush(TIFF2PSContext* ctx)
+{
+	if (ctx->hexcount > 0) {
+		fwrite(ctx->hexbuf, ctx->hexcount, 1, ctx->fd);
+		ctx->hexcount = 0;
 	}
-#define	PUTHEX(c,fd)	putc(hex[((c)>>4)&0xf],fd); putc(hex[(c)&0xf],fd)
+}
+
+static unsigned char *
+GetScanlineBuffer(TIFF2PSContext* ctx, tsize_t size)
+{
+	if (size > ctx->tf_bufsize) {
+		if (ctx->tf_buf)
+			_TIFFfree(ctx->tf_buf);
+		ctx->tf_buf = (unsigned char *) _TIFFmalloc(size);
+		ctx->tf_bufsize = ctx->tf_buf ? size : 0;
+	}
+	return ctx->tf_buf;
+}
+
+#define	DOBREAK(len, howmany, ctx) \
+	if (((len) -= (howmany)) <= 0) {			\
+		if ((ctx)->hexcount >= HEXBUFSIZE)		\
+			HexFlush(ctx);				\
+		(ctx)->hexbuf[(ctx)->hexcount++] = '\n';	\
+		(len) = MAXLINE-(howmany);			\
+	}
+#define	PUTHEX(c,ctx) \
+	do {							\
+		if ((ctx)->hexcount > HEXBUFSIZE - 2)		\
+			HexFlush(ctx);				\
+		(ctx)->hexbuf[(ctx)->hexcount++] = hex[((c)>>4)&0xf];	\
+		(ctx)->hexbuf[(ctx)->hexcount++] = hex[(c)&0xf];	\
+	} while (0)
 
 void
 PSDataColorContig(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h, int nc)
@@ -1377,7 +1419,7 @@ PSDataColorContig(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h, int nc)
 	unsigned char *cp, c;
 
 	(void) w;
-	tf_buf = (unsigned char *) _TIFFmalloc(ctx->tf_bytesperrow);
+	tf_buf = GetScanlineBuffer(ctx, ctx->tf_bytesperrow);
 	if (tf_buf == NULL) {
 		TIFFError(ctx->filename, "No space for scanline buffer");
 		return;
@@ -1390,7 +1432,7 @@ PSDataColorContig(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h, int nc)
 			int adjust;
 			cc = 0;
 			for (; cc < ctx->tf_bytesperrow; cc += ctx->samplesperpixel) {
-				DOBREAK(breaklen, nc, ctx->fd);
+				DOBREAK(breaklen, nc, ctx);
 				/*
 				 * For images with ctx->alpha, matte against
 				 * a white background; i.e.
@@ -1399,28 +1441,28 @@ PSDataColorContig(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h, int nc)
 				 */
 				adjust = 255 - cp[nc];
 				switch (nc) {
-				case 4: c = *cp++ + adjust; PUTHEX(c,ctx->fd);
-				case 3: c = *cp++ + adjust; PUTHEX(c,ctx->fd);
-				case 2: c = *cp++ + adjust; PUTHEX(c,ctx->fd);
-				case 1: c = *cp++ + adjust; PUTHEX(c,ctx->fd);
+				case 4: c = *cp++ + adjust; PUTHEX(c,ctx);
+				case 3: c = *cp++ + adjust; PUTHEX(c,ctx);
+				case 2: c = *cp++ + adjust; PUTHEX(c,ctx);
+				case 1: c = *cp++ + adjust; PUTHEX(c,ctx);
 				}
 				cp += es;
 			}
 		} else {
 			cc = 0;
 			for (; cc < ctx->tf_bytesperrow; cc += ctx->samplesperpixel) {
-				DOBREAK(breaklen, nc, ctx->fd);
+				DOBREAK(breaklen, nc, ctx);
 				switch (nc) {
-				case 4: c = *cp++; PUTHEX(c,ctx->fd);
-				case 3: c = *cp++; PUTHEX(c,ctx->fd);
-				case 2: c = *cp++; PUTHEX(c,ctx->fd);
-				case 1: c = *cp++; PUTHEX(c,ctx->fd);
+				case 4: c = *cp++; PUTHEX(c,ctx);
+				case 3: c = *cp++; PUTHEX(c,ctx);
+				case 2: c = *cp++; PUTHEX(c,ctx);
+				case 1: c = *cp++; PUTHEX(c,ctx);
 				}
 				cp += es;
 			}
 		}
 	}
-	_TIFFfree((char *) tf_buf);
+	HexFlush(ctx);
 }
 
 void
@@ -1433,7 +1475,7 @@ PSDataColorSeparate(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h, int nc)
 	unsigned char *cp, c;
 
 	(void) w;
-	tf_buf = (unsigned char *) _TIFFmalloc(ctx->tf_bytesperrow);
+	tf_buf = GetScanlineBuffer(ctx, ctx->tf_bytesperrow);
 	if (tf_buf == NULL) {
 		TIFFError(ctx->filename, "No space for scanline buffer");
 		return;
@@ -1444,17 +1486,17 @@ PSDataColorSeparate(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h, int nc)
 			if (TIFFReadScanline(tif, tf_buf, row, s) < 0)
 				break;
 			for (cp = tf_buf, cc = 0; cc < ctx->tf_bytesperrow; cc++) {
-				DOBREAK(breaklen, 1, ctx->fd);
+				DOBREAK(breaklen, 1, ctx);
 				c = *cp++;
-				PUTHEX(c,ctx->fd);
+				PUTHEX(c,ctx);
 			}
 		}
 	}
-	_TIFFfree((char *) tf_buf);
+	HexFlush(ctx);
 }
 
-#define	PUTRGBHEX(c,fd) \
-	PUTHEX(rmap[c],fd); PUTHEX(gmap[c],fd); PUTHEX(bmap[c],fd)
+#define	PUTRGBHEX(c,ctx) \
+	PUTHEX(rmap[c],ctx); PUTHEX(gmap[c],ctx); PUTHEX(bmap[c],ctx)
 
 void
 PSDataPalette(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h)
@@ -1478,7 +1520,7 @@ PSDataPalette(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h)
 		return;
 	}
 	nc = 3 * (8 / ctx->bitspersample);
-	tf_buf = (unsigned char *) _TIFFmalloc(ctx->tf_bytesperrow);
+	tf_buf = GetScanlineBuffer(ctx, ctx->tf_bytesperrow);
 	if (tf_buf == NULL) {
 		TIFFError(ctx->filename, "No space for scanline buffer");
 		return;
@@ -1497,35 +1539,35 @@ PSDataPalette(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h)
 		if (TIFFReadScanline(tif, tf_buf, row, 0) < 0)
 			break;
 		for (cp = tf_buf, cc = 0; cc < ctx->tf_bytesperrow; cc++) {
-			DOBREAK(breaklen, nc, ctx->fd);
+			DOBREAK(breaklen, nc, ctx);
 			switch (ctx->bitspersample) {
 			case 8:
-				c = *cp++; PUTRGBHEX(c, ctx->fd);
+				c = *cp++; PUTRGBHEX(c, ctx);
 				break;
 			case 4:
-				c = *cp++; PUTRGBHEX(c&0xf, ctx->fd);
-				c >>= 4;   PUTRGBHEX(c, ctx->fd);
+				c = *cp++; PUTRGBHEX(c&0xf, ctx);
+				c >>= 4;   PUTRGBHEX(c, ctx);
 				break;
 			case 2:
-				c = *cp++; PUTRGBHEX(c&0x3, ctx->fd);
-				c >>= 2;   PUTRGBHEX(c&0x3, ctx->fd);
-				c >>= 2;   PUTRGBHEX(c&0x3, ctx->fd);
-				c >>= 2;   PUTRGBHEX(c, ctx->fd);
+				c = *cp++; PUTRGBHEX(c&0x3, ctx);
+				c >>= 2;   PUTRGBHEX(c&0x3, ctx);
+				c >>= 2;   PUTRGBHEX(c&0x3, ctx);
+				c >>= 2;   PUTRGBHEX(c, ctx);
 				break;
 			case 1:
-				c = *cp++; PUTRGBHEX(c&0x1, ctx->fd);
-				c >>= 1;   PUTRGBHEX(c&0x1, ctx->fd);
-				c >>= 1;   PUTRGBHEX(c&0x1, ctx->fd);
-				c >>= 1;   PUTRGBHEX(c&0x1, ctx->fd);
-				c >>= 1;   PUTRGBHEX(c&0x1, ctx->fd);
-				c >>= 1;   PUTRGBHEX(c&0x1, ctx->fd);
-				c >>= 1;   PUTRGBHEX(c&0x1, ctx->fd);
-				c >>= 1;   PUTRGBHEX(c, ctx->fd);
+				c = *cp++; PUTRGBHEX(c&0x1, ctx);
+				c >>= 1;   PUTRGBHEX(c&0x1, ctx);
+				c >>= 1;   PUTRGBHEX(c&0x1, ctx);
+				c >>= 1;   PUTRGBHEX(c&0x1, ctx);
+				c >>= 1;   PUTRGBHEX(c&0x1, ctx);
+				c >>= 1;   PUTRGBHEX(c&0x1, ctx);
+				c >>= 1;   PUTRGBHEX(c&0x1, ctx);
+				c >>= 1;   PUTRGBHEX(c, ctx);
 				break;
 			}
 		}
 	}
-	_TIFFfree((char *) tf_buf);
+	HexFlush(ctx);
 }
 
 void
@@ -1543,12 +1585,12 @@ PSDataBW(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h)
 #endif
 
 	(void) w; (void) h;
-	tf_buf = (unsigned char *) _TIFFmalloc(stripsize);
-        memset(tf_buf, 0, stripsize);
+	tf_buf = GetScanlineBuffer(ctx, stripsize);
 	if (tf_buf == NULL) {
 		TIFFError(ctx->filename, "No space for scanline buffer");
 		return;
 	}
+	memset(tf_buf, 0, stripsize);
 
 #if defined( EXP_ASCII85ENCODER )
 	if ( ctx->ascii85 ) {
@@ -1564,8 +1606,6 @@ PSDataBW(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h)
 	    ascii85_p = _TIFFmalloc( (stripsize+(stripsize/2)) + 8 );
 
 	    if ( !ascii85_p ) {
-		_TIFFfree( tf_buf );
-
 		TIFFError( ctx->filename,
 			   "Cannot allocate ASCII85 encoding buffer." );
 		return;
@@ -1614,7 +1654,7 @@ PSDataBW(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h)
 			if (ctx->alpha) {
 				int adjust;
 				while (cc-- > 0) {
-					DOBREAK(breaklen, 1, ctx->fd);
+					DOBREAK(breaklen, 1, ctx);
 					/*
 					 * For images with ctx->alpha, matte against
 					 * a white background; i.e.
@@ -1622,19 +1662,21 @@ PSDataBW(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h)
 					 * where Cback = 1.
 					 */
 					adjust = 255 - cp[1];
-					c = *cp++ + adjust; PUTHEX(c,ctx->fd);
+					c = *cp++ + adjust; PUTHEX(c,ctx);
 					cp++, cc--;
 				}
 			} else {
 				while (cc-- > 0) {
 					c = *cp++;
-					DOBREAK(breaklen, 1, ctx->fd);
-					PUTHEX(c, ctx->fd);
+					DOBREAK(breaklen, 1, ctx);
+					PUTHEX(c,ctx);
 				}
 			}
 		}
 	}
 
+	HexFlush(ctx);
+
 	if ( !ctx->ascii85 )
 	{
 	    if ( ctx->level2 || ctx->level3)
@@ -1647,8 +1689,6 @@ PSDataBW(TIFF2PSContext* ctx, TIFF* tif, uint32 w, uint32 h)
 	if ( ascii85_p )
 	    _TIFFfree( ascii85_p );
 #endif
-
-	_TIFFfree(tf_buf);
 }
 
 static void
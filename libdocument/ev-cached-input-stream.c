@@ -0,0 +1,516 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Copyright (C) 2013 Evince contributors
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <glib/gi18n-lib.h>
+
+#include "ev-cached-input-stream.h"
+#include "ev-file-helpers.h"
+
+/* Remote data is fetched in blocks of BLOCK_SIZE bytes, and up to
+ * READAHEAD_BLOCKS missing blocks are requested at once */
+#define BLOCK_SIZE       (64 * 1024)
+#define READAHEAD_BLOCKS 4
+
+/* When the validators can't be read from the stream itself, the file is
+ * queried for them at most once every VALIDATE_INTERVAL microseconds */
+#define VALIDATE_INTERVAL (2 * G_USEC_PER_SEC)
+
+/* Attributes telling whether the remote file changed */
+#define VALIDATOR_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_ETAG_VALUE "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC
+
+struct _EvCachedInputStreamPrivate {
+	GFile         *file;
+	GInputStream  *base_stream;
+	goffset        size;
+	goffset        position;
+
+	/* The file as it was when the stream was created */
+	gchar         *etag;
+	guint64        mtime;
+	guint32        mtime_usec;
+	gint64         validated_time;
+
+	/* Fetched blocks are stored at their offset in a sparse temp file */
+	GFile         *cache_file;
+	GFileIOStream *cache_stream;
+	guint8        *cached_blocks;
+	guint          n_blocks;
+};
+
+#define EV_CACHED_INPUT_STREAM_GET_PRIVATE(object) \
+                (G_TYPE_INSTANCE_GET_PRIVATE ((object), EV_TYPE_CACHED_INPUT_STREAM, EvCachedInputStreamPrivate))
+
+static void ev_cached_input_stream_seekable_iface_init (GSeekableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (EvCachedInputStream, ev_cached_input_stream, G_TYPE_INPUT_STREAM,
+			 G_IMPLEMENT_INTERFACE (G_TYPE_SEEKABLE,
+						ev_cached_input_stream_seekable_iface_init))
+
+static gboolean
+block_is_cached (EvCachedInputStreamPrivate *priv,
+		 guint                       block)
+{
+	return (priv->cached_blocks[block / 8] & (1 << (block % 8))) != 0;
+}
+
+static void
+block_set_cached (EvCachedInputStreamPrivate *priv,
+		  guint                       block)
+{
+	priv->cached_blocks[block / 8] |= 1 << (block % 8);
+}
+
+static gboolean
+ev_cached_input_stream_get_validators (GFileInfo *info,
+				       gchar    **etag,
+				       guint64   *mtime,
+				       guint32   *mtime_usec)
+{
+	*etag = g_strdup (g_file_info_get_etag (info));
+	*mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	*mtime_usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+	return *etag != NULL || g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+}
+
+static gboolean
+ev_cached_input_stream_query_validators (GFile        *file,
+					 gchar       **etag,
+					 guint64      *mtime,
+					 guint32      *mtime_usec,
+					 GCancellable *cancellable,
+					 GError      **error)
+{
+	GFileInfo *info;
+	gboolean   retval;
+
+	info = g_file_query_info (file, VALIDATOR_ATTRIBUTES,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable, error);
+	if (!info)
+		return FALSE;
+
+	retval = ev_cached_input_stream_get_validators (info, etag, mtime, mtime_usec);
+	g_object_unref (info);
+
+	if (!retval)
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     _("The file can't be checked for changes"));
+
+	return retval;
+}
+
+/* Blocks fetched at different times must come from the same version of
+ * the file, otherwise the document would be a mix of both. This is
+ * checked after every fetch. The validators of the data just fetched
+ * are taken from the stream when possible, for HTTP they come from the
+ * headers of the response so no request is added. Otherwise the file
+ * is queried, but not more often than every VALIDATE_INTERVAL.
+ */
+static gboolean
+ev_cached_input_stream_check_unchanged (EvCachedInputStream *stream,
+					GCancellable        *cancellable,
+					GError             **error)
+{
+	EvCachedInputStreamPrivate *priv = stream->priv;
+	GFileInfo                  *info;
+	gchar                      *etag = NULL;
+	guint64                     mtime;
+	guint32                     mtime_usec;
+	gboolean                    unchanged;
+
+	info = g_file_input_stream_query_info (G_FILE_INPUT_STREAM (priv->base_stream),
+					       VALIDATOR_ATTRIBUTES,
+					       cancellable, NULL);
+	if (info && !ev_cached_input_stream_get_validators (info, &etag, &mtime, &mtime_usec))
+		g_clear_object (&info);
+
+	if (info) {
+		g_object_unref (info);
+	} else {
+		gint64 now = g_get_monotonic_time ();
+
+		if (now - priv->validated_time < VALIDATE_INTERVAL)
+			return TRUE;
+
+		if (!ev_cached_input_stream_query_validators (priv->file, &etag,
+							      &mtime, &mtime_usec,
+							      cancellable, error))
+			return FALSE;
+		priv->validated_time = now;
+	}
+
+	unchanged = g_strcmp0 (etag, priv->etag) == 0 &&
+		mtime == priv->mtime && mtime_usec == priv->mtime_usec;
+	g_free (etag);
+
+	if (!unchanged)
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				     _("The file was modified while it was being read"));
+
+	return unchanged;
+}
+
+/* Makes sure blocks from @first to @last are in the cache file, fetching
+ * the missing ones, plus some readahead, with as few requests as possible */
+static gboolean
+ev_cached_input_stream_fetch (EvCachedInputStream *stream,
+			      guint                first,
+			      guint                last,
+			      GCancellable        *cancellable,
+			      GError             **error)
+{
+	EvCachedInputStreamPrivate *priv = stream->priv;
+	GOutputStream              *cache_output;
+	guint                       block = first;
+
+	cache_output = g_io_stream_get_output_stream (G_IO_STREAM (priv->cache_stream));
+
+	while (block <= last) {
+		guint   run_end, i;
+		goffset offset;
+		gsize   length, bytes_read;
+		guchar *buffer;
+
+		if (block_is_cached (priv, block)) {
+			block++;
+			continue;
+		}
+
+		run_end = block;
+		while (run_end + 1 < priv->n_blocks &&
+		       !block_is_cached (priv, run_end + 1) &&
+		       (run_end + 1 <= last || run_end + 1 - block < READAHEAD_BLOCKS))
+			run_end++;
+
+		offset = (goffset)block * BLOCK_SIZE;
+		length = MIN ((goffset)(run_end + 1) * BLOCK_SIZE, priv->size) - offset;
+		buffer = g_malloc (length);
+
+		if (!g_seekable_seek (G_SEEKABLE (priv->base_stream), offset, G_SEEK_SET,
+				      cancellable, error) ||
+		    !g_input_stream_read_all (priv->base_stream, buffer, length,
+					      &bytes_read, cancellable, error)) {
+			g_free (buffer);
+			return FALSE;
+		}
+
+		if (bytes_read != length) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+					     _("The file was truncated while it was being read"));
+			g_free (buffer);
+			return FALSE;
+		}
+
+		if (!ev_cached_input_stream_check_unchanged (stream, cancellable, error)) {
+			g_free (buffer);
+			return FALSE;
+		}
+
+		if (!g_seekable_seek (G_SEEKABLE (priv->cache_stream), offset, G_SEEK_SET,
+				      cancellable, error) ||
+		    !g_output_stream_write_all (cache_output, buffer, length,
+						NULL, cancellable, error)) {
+			g_free (buffer);
+			return FALSE;
+		}
+		g_free (buffer);
+
+		for (i = block; i <= run_end; i++)
+			block_set_cached (priv, i);
+
+		block = run_end + 1;
+	}
+
+	return TRUE;
+}
+
+static gssize
+ev_cached_input_stream_read (GInputStream *input_stream,
+			     void         *buffer,
+			     gsize         count,
+			     GCancellable *cancellable,
+			     GError      **error)
+{
+	EvCachedInputStream        *stream = EV_CACHED_INPUT_STREAM (input_stream);
+	EvCachedInputStreamPrivate *priv = stream->priv;
+	GInputStream               *cache_input;
+	gsize                       bytes_read;
+
+	if (count == 0 || priv->position >= priv->size)
+		return 0;
+
+	count = MIN (count, (gsize)(priv->size - priv->position));
+
+	if (!ev_cached_input_stream_fetch (stream,
+					   priv->position / BLOCK_SIZE,
+					   (priv->position + count - 1) / BLOCK_SIZE,
+					   cancellable, error))
+		return -1;
+
+	cache_input = g_io_stream_get_input_stream (G_IO_STREAM (priv->cache_stream));
+	if (!g_seekable_seek (G_SEEKABLE (priv->cache_stream), priv->position, G_SEEK_SET,
+			      cancellable, error) ||
+	    !g_input_stream_read_all (cache_input, buffer, count,
+				      &bytes_read, cancellable, error))
+		return -1;
+
+	priv->position += bytes_read;
+
+	return bytes_read;
+}
+
+static gboolean
+ev_cached_input_stream_close (GInputStream *input_stream,
+			      GCancellable *cancellable,
+			      GError      **error)
+{
+	EvCachedInputStreamPrivate *priv = EV_CACHED_INPUT_STREAM (input_stream)->priv;
+	gboolean                    retval;
+
+	retval = g_input_stream_close (priv->base_stream, cancellable, error);
+	g_io_stream_close (G_IO_STREAM (priv->cache_stream), NULL, NULL);
+	g_file_delete (priv->cache_file, NULL, NULL);
+
+	return retval;
+}
+
+static goffset
+ev_cached_input_stream_tell (GSeekable *seekable)
+{
+	return EV_CACHED_INPUT_STREAM (seekable)->priv->position;
+}
+
+static gboolean
+ev_cached_input_stream_can_seek (GSeekable *seekable)
+{
+	return TRUE;
+}
+
+static gboolean
+ev_cached_input_stream_seek (GSeekable    *seekable,
+			     goffset       offset,
+			     GSeekType     type,
+			     GCancellable *cancellable,
+			     GError      **error)
+{
+	EvCachedInputStreamPrivate *priv = EV_CACHED_INPUT_STREAM (seekable)->priv;
+	goffset                     position;
+
+	switch (type) {
+	case G_SEEK_CUR:
+		position = priv->position + offset;
+		break;
+	case G_SEEK_SET:
+		position = offset;
+		break;
+	case G_SEEK_END:
+		position = priv->size + offset;
+		break;
+	default:
+		g_assert_not_reached ();
+		return FALSE;
+	}
+
+	if (position < 0 || position > priv->size) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+				     _("Invalid seek request"));
+		return FALSE;
+	}
+
+	priv->position = position;
+
+	return TRUE;
+}
+
+static gboolean
+ev_cached_input_stream_can_truncate (GSeekable *seekable)
+{
+	return FALSE;
+}
+
+static gboolean
+ev_cached_input_stream_truncate (GSeekable    *seekable,
+				 goffset       offset,
+				 GCancellable *cancellable,
+				 GError      **error)
+{
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+			     _("Cannot truncate EvCachedInputStream"));
+	return FALSE;
+}
+
+static void
+ev_cached_input_stream_finalize (GObject *object)
+{
+	EvCachedInputStreamPrivate *priv = EV_CACHED_INPUT_STREAM (object)->priv;
+
+	g_clear_object (&priv->file);
+	g_clear_object (&priv->base_stream);
+	g_clear_object (&priv->cache_stream);
+	g_clear_object (&priv->cache_file);
+	g_free (priv->cached_blocks);
+	g_free (priv->etag);
+
+	G_OBJECT_CLASS (ev_cached_input_stream_parent_class)->finalize (object);
+}
+
+static void
+ev_cached_input_stream_init (EvCachedInputStream *stream)
+{
+	stream->priv = EV_CACHED_INPUT_STREAM_GET_PRIVATE (stream);
+}
+
+static void
+ev_cached_input_stream_class_init (EvCachedInputStreamClass *klass)
+{
+	GObjectClass      *g_object_class = G_OBJECT_CLASS (klass);
+	GInputStreamClass *input_stream_class = G_INPUT_STREAM_CLASS (klass);
+
+	g_object_class->finalize = ev_cached_input_stream_finalize;
+	input_stream_class->read_fn = ev_cached_input_stream_read;
+	input_stream_class->close_fn = ev_cached_input_stream_close;
+
+	g_type_class_add_private (g_object_class, sizeof (EvCachedInputStreamPrivate));
+}
+
+static void
+ev_cached_input_stream_seekable_iface_init (GSeekableIface *iface)
+{
+	iface->tell = ev_cached_input_stream_tell;
+	iface->can_seek = ev_cached_input_stream_can_seek;
+	iface->seek = ev_cached_input_stream_seek;
+	iface->can_truncate = ev_cached_input_stream_can_truncate;
+	iface->truncate_fn = ev_cached_input_stream_truncate;
+}
+
+/**
+ * ev_cached_input_stream_new:
+ * @file: a #GFile
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @error: (allow-none): a #GError location to store an error, or %NULL
+ *
+ * Creates a seekable stream to read @file on demand. Only the ranges
+ * actually read are transferred, in blocks that are kept in a local
+ * temporary file so that they are never fetched twice. This is meant for
+ * remote files, so that backends can start parsing a document before
+ * it's been completely transferred.
+ *
+ * Fetches fail with %G_IO_ERROR_FAILED when @file changed since the
+ * stream was created, so that the data read is consistent. The entity
+ * tag and modification time returned with each fetch are checked; when
+ * the stream doesn't provide them, @file is queried again every couple
+ * of seconds while data is being fetched.
+ *
+ * %G_IO_ERROR_NOT_SUPPORTED is returned if @file can't be read at
+ * arbitrary positions, or if it has neither an entity tag nor a
+ * modification time to tell whether it changed.
+ *
+ * Returns: (transfer full): a new #GInputStream, or %NULL
+ *
+ * Since: 3.10
+ */
+GInputStream *
+ev_cached_input_stream_new (GFile        *file,
+			    GCancellable *cancellable,
+			    GError      **error)
+{
+	EvCachedInputStream        *stream;
+	EvCachedInputStreamPrivate *priv;
+	GFileInputStream           *base_stream;
+	GFileInfo                  *info;
+	GFile                      *cache_file;
+	GFileIOStream              *cache_stream;
+	goffset                     size;
+	gchar                      *etag;
+	guint64                     mtime;
+	guint32                     mtime_usec;
+
+	g_return_val_if_fail (G_IS_FILE (file), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	base_stream = g_file_read (file, cancellable, error);
+	if (!base_stream)
+		return NULL;
+
+	if (!g_seekable_can_seek (G_SEEKABLE (base_stream))) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     _("The file can't be read at arbitrary positions"));
+		g_object_unref (base_stream);
+		return NULL;
+	}
+
+	info = g_file_input_stream_query_info (base_stream,
+					       G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					       cancellable, NULL);
+	if (!info)
+		info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					  G_FILE_QUERY_INFO_NONE,
+					  cancellable, error);
+	if (!info) {
+		g_object_unref (base_stream);
+		return NULL;
+	}
+	size = g_file_info_get_size (info);
+	g_object_unref (info);
+
+	if (!ev_cached_input_stream_query_validators (file, &etag,
+						      &mtime, &mtime_usec,
+						      cancellable, error)) {
+		g_object_unref (base_stream);
+		return NULL;
+	}
+
+	cache_file = ev_mkstemp_file ("remote.XXXXXX", error);
+	if (!cache_file) {
+		g_free (etag);
+		g_object_unref (base_stream);
+		return NULL;
+	}
+
+	cache_stream = g_file_open_readwrite (cache_file, cancellable, error);
+	if (!cache_stream) {
+		g_file_delete (cache_file, NULL, NULL);
+		g_object_unref (cache_file);
+		g_free (etag);
+		g_object_unref (base_stream);
+		return NULL;
+	}
+
+	stream = g_object_new (EV_TYPE_CACHED_INPUT_STREAM, NULL);
+	priv = stream->priv;
+	priv->file = g_object_ref (file);
+	priv->base_stream = G_INPUT_STREAM (base_stream);
+	priv->size = size;
+	priv->etag = etag;
+	priv->mtime = mtime;
+	priv->mtime_usec = mtime_usec;
+	priv->validated_time = g_get_monotonic_time ();
+	priv->cache_file = cache_file;
+	priv->cache_stream = cache_stream;
+	priv->n_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	priv->cached_blocks = g_malloc0 (priv->n_blocks / 8 + 1);
+
+	return G_INPUT_STREAM (stream);
+}
@@ -0,0 +1,59 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Copyright (C) 2013 Evince contributors
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (__EV_EVINCE_DOCUMENT_H_INSIDE__) && !defined (EVINCE_COMPILATION)
+#error "Only <evince-document.h> can be included directly."
+#endif
+
+#ifndef __EV_CACHED_INPUT_STREAM_H__
+#define __EV_CACHED_INPUT_STREAM_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _EvCachedInputStream        EvCachedInputStream;
+typedef struct _EvCachedInputStreamClass   EvCachedInputStreamClass;
+typedef struct _EvCachedInputStreamPrivate EvCachedInputStreamPrivate;
+
+#define EV_TYPE_CACHED_INPUT_STREAM              (ev_cached_input_stream_get_type())
+#define EV_CACHED_INPUT_STREAM(object)           (G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_CACHED_INPUT_STREAM, EvCachedInputStream))
+#define EV_CACHED_INPUT_STREAM_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_CACHED_INPUT_STREAM, EvCachedInputStreamClass))
+#define EV_IS_CACHED_INPUT_STREAM(object)        (G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_CACHED_INPUT_STREAM))
+#define EV_IS_CACHED_INPUT_STREAM_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE((klass), EV_TYPE_CACHED_INPUT_STREAM))
+#define EV_CACHED_INPUT_STREAM_GET_CLASS(object) (G_TYPE_INSTANCE_GET_CLASS((object), EV_TYPE_CACHED_INPUT_STREAM, EvCachedInputStreamClass))
+
+struct _EvCachedInputStream {
+	GInputStream base_instance;
+
+	EvCachedInputStreamPrivate *priv;
+};
+
+struct _EvCachedInputStreamClass {
+	GInputStreamClass base_class;
+};
+
+GType         ev_cached_input_stream_get_type (void) G_GNUC_CONST;
+GInputStream *ev_cached_input_stream_new      (GFile        *file,
+					       GCancellable *cancellable,
+					       GError      **error);
+
+G_END_DECLS
+
+#endif /* __EV_CACHED_INPUT_STREAM_H__ */
@@ -102,6 +102,8 @@ debug_init (void)
 
 	if (g_getenv ("EV_DEBUG_JOBS") != NULL)
 		ev_debug |= EV_DEBUG_JOBS;
+	if (g_getenv ("EV_DEBUG_SYNCTEX") != NULL)
+		ev_debug |= EV_DEBUG_SYNCTEX;
 
         if (ev_debug_parse_show_borders (g_getenv ("EV_DEBUG_SHOW_BORDERS")))
                 ev_debug |= EV_DEBUG_SHOW_BORDERS;
@@ -116,6 +118,8 @@ profile_init (void)
 	} else {
 		if (g_getenv ("EV_PROFILE_JOBS") != NULL)
 			ev_profile |= EV_PROFILE_JOBS;
+		if (g_getenv ("EV_PROFILE_TRANSITIONS") != NULL)
+			ev_profile |= EV_PROFILE_TRANSITIONS;
 	}
 
 	if (ev_profile) {
@@ -228,4 +232,16 @@ ev_debug_get_debug_borders (void)
         return ev_debug_borders;
 }
 
+gboolean
+ev_debug_is_enabled (EvDebugSection section)
+{
+	return (ev_debug & section) != 0;
+}
+
+gboolean
+ev_profiler_is_enabled (EvProfileSection section)
+{
+	return (ev_profile & section) != 0;
+}
+
 #endif /* EV_ENABLE_DEBUG */
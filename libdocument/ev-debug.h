@@ -73,7 +73,8 @@ G_BEGIN_DECLS
 typedef enum {
 	EV_NO_DEBUG           = 0,
 	EV_DEBUG_JOBS         = 1 << 0,
-        EV_DEBUG_SHOW_BORDERS = 1 << 1
+        EV_DEBUG_SHOW_BORDERS = 1 << 1,
+	EV_DEBUG_SYNCTEX      = 1 << 2
 } EvDebugSection;
 
 typedef enum {
@@ -88,6 +89,7 @@ typedef enum {
 } EvDebugBorders;
 
 #define DEBUG_JOBS      EV_DEBUG_JOBS,    __FILE__, __LINE__, G_STRFUNC
+#define DEBUG_SYNCTEX   EV_DEBUG_SYNCTEX, __FILE__, __LINE__, G_STRFUNC
 
 /*
  * Set an environmental var of the same name to turn on
@@ -95,8 +97,9 @@ typedef enum {
  * sections.
  */
 typedef enum {
-	EV_NO_PROFILE   = 0,
-	EV_PROFILE_JOBS = 1 << 0
+	EV_NO_PROFILE          = 0,
+	EV_PROFILE_JOBS        = 1 << 0,
+	EV_PROFILE_TRANSITIONS = 1 << 1
 } EvProfileSection;
 
 void _ev_debug_init     (void);
@@ -113,6 +116,8 @@ void ev_profiler_stop  (EvProfileSection section,
 			const gchar     *format, ...) G_GNUC_PRINTF(2, 3);
 
 EvDebugBorders ev_debug_get_debug_borders (void);
+gboolean       ev_debug_is_enabled        (EvDebugSection   section);
+gboolean       ev_profiler_is_enabled     (EvProfileSection section);
 
 G_END_DECLS
 
@@ -403,6 +403,7 @@ ev_document_factory_get_document_for_gfile (GFile *file,
         GFileInfo *file_info;
         const char *content_type;
         char *mime_type = NULL;
+        GError *err = NULL;
 
         g_return_val_if_fail (G_IS_FILE (file), NULL);
         g_return_val_if_fail (error == NULL || *error == NULL, NULL);
@@ -426,12 +427,26 @@ ev_document_factory_get_document_for_gfile (GFile *file,
         mime_type = g_content_type_get_mime_type (content_type);
         g_object_unref (file_info);
 
+        /* Compressed documents have to be uncompressed to a file first */
+        if (get_compression_from_mime_type (mime_type) != EV_COMPRESSION_NONE) {
+                g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                     "Compressed documents can't be loaded from GFile");
+                g_free (mime_type);
+                return NULL;
+        }
+
         document = ev_document_factory_new_document_for_mime_type (mime_type, error);
         g_free (mime_type);
         if (document == NULL)
                 return NULL;
 
-        if (!ev_document_load_gfile (document, file, flags, cancellable, error)) {
+        if (!ev_document_load_gfile (document, file, flags, cancellable, &err)) {
+                if (g_error_matches (err, EV_DOCUMENT_ERROR, EV_DOCUMENT_ERROR_ENCRYPTED)) {
+                        g_propagate_error (error, err);
+                        return document;
+                }
+
+                g_propagate_error (error, err);
                 g_object_unref (document);
                 return NULL;
         }
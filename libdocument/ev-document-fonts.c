@@ -54,8 +54,47 @@ ev_document_fonts_fill_model (EvDocumentFonts *document_fonts,
 			      GtkTreeModel    *model)
 {
 	EvDocumentFontsInterface *iface = EV_DOCUMENT_FONTS_GET_IFACE (document_fonts);
+	GPtrArray                *fonts;
+	guint                     i;
 
-	iface->fill_model (document_fonts, model);
+	if (iface->fill_model) {
+		iface->fill_model (document_fonts, model);
+		return;
+	}
+
+	fonts = g_ptr_array_new_with_free_func ((GDestroyNotify) g_strfreev);
+	ev_document_fonts_get_fonts (document_fonts, fonts);
+	for (i = 0; i < fonts->len; i++) {
+		gchar **font = g_ptr_array_index (fonts, i);
+
+		gtk_list_store_insert_with_values (GTK_LIST_STORE (model), NULL, -1,
+						   EV_DOCUMENT_FONTS_COLUMN_NAME, font[0],
+						   EV_DOCUMENT_FONTS_COLUMN_DETAILS, font[1],
+						   -1);
+	}
+	g_ptr_array_free (fonts, TRUE);
+}
+
+/**
+ * ev_document_fonts_get_fonts:
+ * @document_fonts: a #EvDocumentFonts
+ * @fonts: (element-type GStrv): a #GPtrArray
+ *
+ * Appends to @fonts a %NULL-terminated string array holding the name
+ * and the details markup of every font found by the last call to
+ * ev_document_fonts_scan(). Unlike ev_document_fonts_fill_model(), it
+ * doesn't touch any GTK+ object, so it can be called from a thread.
+ */
+void
+ev_document_fonts_get_fonts (EvDocumentFonts *document_fonts,
+			     GPtrArray       *fonts)
+{
+	EvDocumentFontsInterface *iface = EV_DOCUMENT_FONTS_GET_IFACE (document_fonts);
+
+	if (!iface->get_fonts)
+		return;
+
+	iface->get_fonts (document_fonts, fonts);
 }
 
 const gchar *
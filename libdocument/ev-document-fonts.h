@@ -65,6 +65,8 @@ struct _EvDocumentFontsInterface
         void         (* fill_model)        (EvDocumentFonts *document_fonts,
                                             GtkTreeModel    *model);
         const gchar *(* get_fonts_summary) (EvDocumentFonts *document_fonts);
+        void         (* get_fonts)         (EvDocumentFonts *document_fonts,
+                                            GPtrArray       *fonts);
 };
 
 GType        ev_document_fonts_get_type          (void);
@@ -74,6 +76,8 @@ double       ev_document_fonts_get_progress      (EvDocumentFonts *document_font
 void         ev_document_fonts_fill_model        (EvDocumentFonts *document_fonts,
                                                   GtkTreeModel    *model);
 const gchar *ev_document_fonts_get_fonts_summary (EvDocumentFonts *document_fonts);
+void         ev_document_fonts_get_fonts         (EvDocumentFonts *document_fonts,
+                                                  GPtrArray       *fonts);
 
 G_END_DECLS
 
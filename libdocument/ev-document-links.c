@@ -27,6 +27,27 @@
 
 G_DEFINE_INTERFACE (EvDocumentLinks, ev_document_links, 0)
 
+/* Named destination -> page cache, accessed with the doc mutex held */
+static GHashTable *
+ev_document_links_get_page_cache (EvDocumentLinks *document_links)
+{
+	GHashTable *cache;
+	static GQuark cache_key = 0;
+
+	if (!cache_key)
+		cache_key = g_quark_from_static_string ("ev-document-links-page-cache");
+
+	cache = g_object_get_qdata (G_OBJECT (document_links), cache_key);
+	if (!cache) {
+		cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+		g_object_set_qdata_full (G_OBJECT (document_links),
+					 cache_key, cache,
+					 (GDestroyNotify) g_hash_table_destroy);
+	}
+
+	return cache;
+}
+
 static void
 ev_document_links_default_init (EvDocumentLinksInterface *klass)
 {
@@ -85,6 +106,17 @@ ev_document_links_find_link_dest (EvDocumentLinks *document_links,
 
 	ev_document_doc_mutex_lock ();
 	retval = iface->find_link_dest (document_links, link_name);
+	if (retval) {
+		switch (ev_link_dest_get_dest_type (retval)) {
+		case EV_LINK_DEST_TYPE_NAMED:
+		case EV_LINK_DEST_TYPE_PAGE_LABEL:
+			break;
+		default:
+			g_hash_table_insert (ev_document_links_get_page_cache (document_links),
+					     g_strdup (link_name),
+					     GINT_TO_POINTER (ev_link_dest_get_page (retval)));
+		}
+	}
 	ev_document_doc_mutex_unlock ();
 
 	return retval;
@@ -95,10 +127,18 @@ ev_document_links_find_link_page (EvDocumentLinks *document_links,
 				  const gchar     *link_name)
 {
 	EvDocumentLinksInterface *iface = EV_DOCUMENT_LINKS_GET_IFACE (document_links);
-	gint retval;
+	GHashTable *cache;
+	gpointer    page;
+	gint        retval;
 
 	ev_document_doc_mutex_lock ();
-	retval = iface->find_link_page (document_links, link_name);
+	cache = ev_document_links_get_page_cache (document_links);
+	if (g_hash_table_lookup_extended (cache, link_name, NULL, &page)) {
+		retval = GPOINTER_TO_INT (page);
+	} else {
+		retval = iface->find_link_page (document_links, link_name);
+		g_hash_table_insert (cache, g_strdup (link_name), GINT_TO_POINTER (retval));
+	}
 	ev_document_doc_mutex_unlock ();
 
 	return retval;
@@ -380,6 +380,133 @@ ev_document_misc_surface_rotate_and_scale (cairo_surface_t *surface,
 	return new_surface;
 }
 
+/**
+ * ev_document_misc_pixbuf_from_surface_downscaled:
+ * @surface: an image #cairo_surface_t in %CAIRO_FORMAT_ARGB32 or %CAIRO_FORMAT_RGB24
+ * @dest_width: the width of the new pixbuf
+ * @dest_height: the height of the new pixbuf
+ *
+ * Creates a pixbuf with the contents of @surface scaled down to
+ * @dest_width x @dest_height using a box filter. Every destination pixel
+ * is the average of the source pixels it covers.
+ *
+ * Returns: (transfer full): a #GdkPixbuf, or %NULL if @surface can't be
+ * scaled down to the given size
+ */
+GdkPixbuf *
+ev_document_misc_pixbuf_from_surface_downscaled (cairo_surface_t *surface,
+						 gint             dest_width,
+						 gint             dest_height)
+{
+	cairo_format_t format;
+	const guchar  *src;
+	gint           src_width, src_height, src_stride;
+	GdkPixbuf     *pixbuf;
+	guchar        *dest;
+	gint           dest_stride;
+	gboolean       has_alpha;
+	gint          *x_bounds;
+	guint32       *sums;
+	gint           x, y;
+
+	g_return_val_if_fail (surface != NULL, NULL);
+	g_return_val_if_fail (dest_width > 0 && dest_height > 0, NULL);
+
+	if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE)
+		return NULL;
+
+	format = cairo_image_surface_get_format (surface);
+	if (format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24)
+		return NULL;
+
+	src_width = cairo_image_surface_get_width (surface);
+	src_height = cairo_image_surface_get_height (surface);
+	if (dest_width > src_width || dest_height > src_height)
+		return NULL;
+
+	src = cairo_image_surface_get_data (surface);
+	src_stride = cairo_image_surface_get_stride (surface);
+
+	has_alpha = format == CAIRO_FORMAT_ARGB32;
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8, dest_width, dest_height);
+	dest = gdk_pixbuf_get_pixels (pixbuf);
+	dest_stride = gdk_pixbuf_get_rowstride (pixbuf);
+
+	/* Source columns covered by every destination column */
+	x_bounds = g_new (gint, dest_width + 1);
+	for (x = 0; x <= dest_width; x++)
+		x_bounds[x] = (gint64)x * src_width / dest_width;
+
+	/* Per channel sums of the destination row being computed. The
+	 * channels are accumulated independently over whole pixels, which
+	 * lets the compiler vectorize the inner loops.
+	 */
+	sums = g_new (guint32, dest_width * 4);
+
+	for (y = 0; y < dest_height; y++) {
+		gint    sy, sy0, sy1;
+		guchar *dest_row;
+
+		sy0 = (gint64)y * src_height / dest_height;
+		sy1 = (gint64)(y + 1) * src_height / dest_height;
+
+		memset (sums, 0, dest_width * 4 * sizeof (guint32));
+		for (sy = sy0; sy < sy1; sy++) {
+			const guint32 *src_row = (const guint32 *)(src + sy * src_stride);
+
+			for (x = 0; x < dest_width; x++) {
+				guint32 a = 0, r = 0, g = 0, b = 0;
+				gint    sx;
+
+				for (sx = x_bounds[x]; sx < x_bounds[x + 1]; sx++) {
+					guint32 p = src_row[sx];
+
+					a += p >> 24;
+					r += (p >> 16) & 0xff;
+					g += (p >> 8) & 0xff;
+					b += p & 0xff;
+				}
+				sums[x * 4] += a;
+				sums[x * 4 + 1] += r;
+				sums[x * 4 + 2] += g;
+				sums[x * 4 + 3] += b;
+			}
+		}
+
+		dest_row = dest + y * dest_stride;
+		for (x = 0; x < dest_width; x++) {
+			guint32 area = (x_bounds[x + 1] - x_bounds[x]) * (sy1 - sy0);
+			guint32 a = sums[x * 4];
+			guint32 r = sums[x * 4 + 1];
+			guint32 g = sums[x * 4 + 2];
+			guint32 b = sums[x * 4 + 3];
+
+			if (has_alpha) {
+				/* Cairo uses premultiplied alpha, GdkPixbuf doesn't */
+				if (a == 0) {
+					dest_row[0] = dest_row[1] = dest_row[2] = dest_row[3] = 0;
+				} else {
+					dest_row[0] = ((guint64)r * 255 + a / 2) / a;
+					dest_row[1] = ((guint64)g * 255 + a / 2) / a;
+					dest_row[2] = ((guint64)b * 255 + a / 2) / a;
+					dest_row[3] = (a + area / 2) / area;
+				}
+				dest_row += 4;
+			} else {
+				dest_row[0] = (r + area / 2) / area;
+				dest_row[1] = (g + area / 2) / area;
+				dest_row[2] = (b + area / 2) / area;
+				dest_row += 3;
+			}
+		}
+	}
+
+	g_free (sums);
+	g_free (x_bounds);
+
+	return pixbuf;
+}
+
 void
 ev_document_misc_invert_surface (cairo_surface_t *surface) {
 	cairo_t *cr;
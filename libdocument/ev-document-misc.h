@@ -68,6 +68,9 @@ cairo_surface_t *ev_document_misc_surface_rotate_and_scale (cairo_surface_t *sur
 							    gint             dest_width,
 							    gint             dest_height,
 							    gint             dest_rotation);
+GdkPixbuf       *ev_document_misc_pixbuf_from_surface_downscaled (cairo_surface_t *surface,
+								  gint             dest_width,
+								  gint             dest_height);
 void             ev_document_misc_invert_surface (cairo_surface_t *surface);
 void		 ev_document_misc_invert_pixbuf  (GdkPixbuf       *pixbuf);
 
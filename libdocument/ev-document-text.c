@@ -80,3 +80,68 @@ ev_document_text_get_text_attrs (EvDocumentText *document_text,
 
 	return iface->get_text_attrs (document_text, page);
 }
+
+/**
+ * ev_document_text_get_page_text:
+ * @document_text: a #EvDocumentText
+ * @page: a #EvPage
+ * @text: (out) (allow-none): return location for the page text, or %NULL
+ * @areas: (out) (allow-none): return location for the glyph boxes, or %NULL
+ * @n_areas: (out) (allow-none): return location for the number of glyph boxes
+ * @text_mapping: (out) (allow-none): return location for the text region, or %NULL
+ * @text_attrs: (out) (allow-none): return location for the text attributes, or %NULL
+ *
+ * Retrieves all the requested text information of @page at once. Backends
+ * implementing this can extract the page text only once, instead of once
+ * per piece of information as when calling ev_document_text_get_text(),
+ * ev_document_text_get_text_layout(), ev_document_text_get_text_mapping()
+ * and ev_document_text_get_text_attrs() separately.
+ *
+ * Pass %NULL for the information that is not needed.
+ *
+ * Returns: %FALSE if @areas was requested but the text layout is not
+ *   available, %TRUE otherwise
+ *
+ * Since: 3.10
+ */
+gboolean
+ev_document_text_get_page_text (EvDocumentText  *document_text,
+				EvPage          *page,
+				gchar          **text,
+				EvRectangle    **areas,
+				guint           *n_areas,
+				cairo_region_t **text_mapping,
+				PangoAttrList  **text_attrs)
+{
+	EvDocumentTextInterface *iface = EV_DOCUMENT_TEXT_GET_IFACE (document_text);
+	gboolean                 retval = TRUE;
+
+	g_return_val_if_fail (areas == NULL || n_areas != NULL, FALSE);
+
+	if (text)
+		*text = NULL;
+	if (areas) {
+		*areas = NULL;
+		*n_areas = 0;
+	}
+	if (text_mapping)
+		*text_mapping = NULL;
+	if (text_attrs)
+		*text_attrs = NULL;
+
+	if (iface->get_page_text)
+		return iface->get_page_text (document_text, page, text,
+					     areas, n_areas,
+					     text_mapping, text_attrs);
+
+	if (text)
+		*text = ev_document_text_get_text (document_text, page);
+	if (areas)
+		retval = ev_document_text_get_text_layout (document_text, page, areas, n_areas);
+	if (text_mapping)
+		*text_mapping = ev_document_text_get_text_mapping (document_text, page);
+	if (text_attrs)
+		*text_attrs = ev_document_text_get_text_attrs (document_text, page);
+
+	return retval;
+}
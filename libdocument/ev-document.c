@@ -26,7 +26,7 @@
 
 #include "ev-document.h"
 #include "ev-document-misc.h"
-#include "synctex_parser.h"
+#include "ev-synctex-index.h"
 
 #define EV_DOCUMENT_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), EV_TYPE_DOCUMENT, EvDocumentPrivate))
 
@@ -56,7 +56,7 @@ struct _EvDocumentPrivate
 	EvPageSize     *page_sizes;
 	EvDocumentInfo *info;
 
-	synctex_scanner_t synctex_scanner;
+	EvSynctexIndex *synctex_index;
 };
 
 static gint            _ev_document_get_n_pages     (EvDocument *document);
@@ -127,9 +127,9 @@ ev_document_finalize (GObject *object)
 		document->priv->info = NULL;
 	}
 
-	if (document->priv->synctex_scanner) {
-		synctex_scanner_free (document->priv->synctex_scanner);
-		document->priv->synctex_scanner = NULL;
+	if (document->priv->synctex_index) {
+		ev_synctex_index_free (document->priv->synctex_index);
+		document->priv->synctex_index = NULL;
 	}
 
 	G_OBJECT_CLASS (ev_document_parent_class)->finalize (object);
@@ -319,8 +319,8 @@ ev_document_load (EvDocument  *document,
 
                         filename = g_filename_from_uri (uri, NULL, NULL);
                         if (filename != NULL) {
-                                priv->synctex_scanner =
-                                        synctex_scanner_new_with_output_file (filename, NULL, 1);
+                                priv->synctex_index =
+                                        ev_synctex_index_new (filename, priv->n_pages);
                                 g_free (filename);
                         }
                 }
@@ -471,7 +471,7 @@ ev_document_has_synctex (EvDocument *document)
 {
 	g_return_val_if_fail (EV_IS_DOCUMENT (document), FALSE);
 
-	return document->priv->synctex_scanner != NULL;
+	return document->priv->synctex_index != NULL;
 }
 
 /**
@@ -495,34 +495,15 @@ ev_document_synctex_backward_search (EvDocument *document,
                                      gfloat      x,
                                      gfloat      y)
 {
-        EvSourceLink *result = NULL;
-        synctex_scanner_t scanner;
+        EvSynctexIndex *index;
 
         g_return_val_if_fail (EV_IS_DOCUMENT (document), NULL);
 
-        scanner = document->priv->synctex_scanner;
-        if (!scanner)
+        index = document->priv->synctex_index;
+        if (!index)
                 return NULL;
 
-        if (synctex_edit_query (scanner, page_index + 1, x, y) > 0) {
-                synctex_node_t node;
-
-                /* We assume that a backward search returns either zero or one result_node */
-                node = synctex_next_result (scanner);
-                if (node != NULL) {
-			const gchar *filename;
-
-			filename = synctex_scanner_get_name (scanner, synctex_node_tag (node));
-			
-			if (filename) {
-				result = ev_source_link_new (filename,
-							     synctex_node_line (node),
-							     synctex_node_column (node));
-			}
-                }
-        }
-
-        return result;
+        return ev_synctex_index_backward_search (index, page_index, x, y);
 }
 
 /**
@@ -540,35 +521,15 @@ EvMapping *
 ev_document_synctex_forward_search (EvDocument   *document,
 				    EvSourceLink *link)
 {
-        EvMapping        *result = NULL;
-        synctex_scanner_t scanner;
+        EvSynctexIndex *index;
 
         g_return_val_if_fail (EV_IS_DOCUMENT (document), NULL);
 
-        scanner = document->priv->synctex_scanner;
-        if (!scanner)
+        index = document->priv->synctex_index;
+        if (!index)
                 return NULL;
 
-        if (synctex_display_query (scanner, link->filename, link->line, link->col) > 0) {
-                synctex_node_t node;
-                gint           page;
-
-                if ((node = synctex_next_result (scanner))) {
-                        result = g_new (EvMapping, 1);
-
-                        page = synctex_node_page (node) - 1;
-                        result->data = GINT_TO_POINTER (page);
-
-                        result->area.x1 = synctex_node_box_visible_h (node);
-                        result->area.y1 = synctex_node_box_visible_v (node) -
-                                synctex_node_box_visible_height (node);
-                        result->area.x2 = synctex_node_box_visible_width (node) + result->area.x1;
-                        result->area.y2 = synctex_node_box_visible_depth (node) +
-                                synctex_node_box_visible_height (node) + result->area.y1;
-                }
-        }
-
-        return result;
+        return ev_synctex_index_forward_search (index, link);
 }
 
 static gint
@@ -21,13 +21,25 @@
 
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n-lib.h>
+#ifdef HAVE_BZLIB
+#include <bzlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
 
 #include "ev-file-helpers.h"
 
@@ -389,13 +401,92 @@ ev_file_is_temp (GFile *file)
 	return retval;
 }
 
+#ifdef FICLONE
+/* Shares the extents of @source_file with @target_file on file systems
+ * supporting it (btrfs, XFS), so copying is instant and takes no space.
+ * The clone is made in a temp file next to the target and renamed over
+ * it, so the target is left untouched when cloning isn't supported */
+static gboolean
+ev_xfer_file_reflink (GFile *source_file,
+		      GFile *target_file)
+{
+	gchar    *source_path;
+	gchar    *target_path;
+	gchar    *target_dir = NULL;
+	gchar    *tmp_path = NULL;
+	gint      source_fd = -1;
+	gint      tmp_fd = -1;
+	GStatBuf  source_st;
+	GStatBuf  target_st;
+	gboolean  target_exists;
+	gboolean  tmp_created = FALSE;
+	gboolean  retval = FALSE;
+
+	source_path = g_file_get_path (source_file);
+	target_path = g_file_get_path (target_file);
+	if (!source_path || !target_path)
+		goto out;
+
+	source_fd = g_open (source_path, O_RDONLY, 0);
+	if (source_fd == -1 || fstat (source_fd, &source_st) == -1)
+		goto out;
+
+	target_exists = g_lstat (target_path, &target_st) == 0;
+	if (target_exists) {
+		/* Leave symlinks, special files and other names of the
+		 * source itself (hard links, bind mounts) to GIO */
+		if (!S_ISREG (target_st.st_mode))
+			goto out;
+		if (target_st.st_dev == source_st.st_dev &&
+		    target_st.st_ino == source_st.st_ino)
+			goto out;
+	} else if (errno != ENOENT) {
+		goto out;
+	}
+
+	target_dir = g_path_get_dirname (target_path);
+	tmp_path = g_build_filename (target_dir, ".evince-copy-XXXXXX", NULL);
+	tmp_fd = g_mkstemp_full (tmp_path, O_WRONLY, 0666);
+	if (tmp_fd == -1)
+		goto out;
+	tmp_created = TRUE;
+
+	if (ioctl (tmp_fd, FICLONE, source_fd) == -1)
+		goto out;
+
+	/* Keep the mode of the file being replaced, like GIO does */
+	if (target_exists)
+		fchmod (tmp_fd, target_st.st_mode & 07777);
+
+	retval = close (tmp_fd) == 0;
+	tmp_fd = -1;
+
+	if (retval)
+		retval = g_rename (tmp_path, target_path) == 0;
+out:
+	if (tmp_fd != -1)
+		close (tmp_fd);
+	if (!retval && tmp_created)
+		g_unlink (tmp_path);
+	if (source_fd != -1)
+		close (source_fd);
+	g_free (tmp_path);
+	g_free (target_dir);
+	g_free (target_path);
+	g_free (source_path);
+
+	return retval;
+}
+#endif
+
 /**
  * ev_xfer_uri_simple:
  * @from: the source URI
  * @to: the target URI
  * @error: a #GError location to store an error, or %NULL
  *
- * Performs a g_file_copy() from @from to @to.
+ * Performs a g_file_copy() from @from to @to. When both are local
+ * files on a file system supporting it, the copy is a reflink.
  *
  * Returns: %TRUE on success, or %FALSE on error with @error filled in
  */
@@ -415,6 +506,17 @@ ev_xfer_uri_simple (const char *from,
 
 	source_file = g_file_new_for_uri (from);
 	target_file = g_file_new_for_uri (to);
+
+#ifdef FICLONE
+	if (g_file_is_native (source_file) && g_file_is_native (target_file) &&
+	    !g_file_equal (source_file, target_file) &&
+	    ev_xfer_file_reflink (source_file, target_file)) {
+		g_object_unref (target_file);
+		g_object_unref (source_file);
+
+		return TRUE;
+	}
+#endif
 	
 	result = g_file_copy (source_file, target_file,
 			      G_FILE_COPY_TARGET_DEFAULT_PERMS |
@@ -578,6 +680,325 @@ ev_file_get_mime_type (const gchar *uri,
 
 /* Compressed files support */
 
+/* Data is streamed from the source file to the destination file in
+ * chunks of BUFFER_SIZE bytes, without spawning external programs */
+#define BUFFER_SIZE (64 * 1024)
+
+/* A gzip file can be made of several members, as produced by
+ * concatenating gzip files, and gzip -d outputs all of them.
+ * GZlibDecompressor stops after the first one, so it's restarted
+ * until the input is consumed.
+ */
+static gboolean
+compression_run_gunzip (GInputStream  *input,
+			GOutputStream *output,
+			GError       **error)
+{
+	GConverter *converter;
+	gchar      *in_buf, *out_buf;
+	gsize       in_len = 0;
+	gsize       in_start = 0;
+	gboolean    eof = FALSE;
+	gboolean    in_member = FALSE;
+	guint       n_members = 0;
+	gboolean    retval = FALSE;
+
+	converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+	in_buf = g_malloc (BUFFER_SIZE);
+	out_buf = g_malloc (BUFFER_SIZE);
+
+	for (;;) {
+		GConverterResult result;
+		gsize            bytes_read;
+		gsize            bytes_written;
+		gssize           size;
+		GError          *convert_error = NULL;
+
+		if (in_len == 0 && !eof) {
+			size = g_input_stream_read (input, in_buf, BUFFER_SIZE, NULL, error);
+			if (size == -1)
+				goto out;
+
+			eof = size == 0;
+			in_start = 0;
+			in_len = size;
+		}
+
+		if (!in_member) {
+			/* Like gzip, ignore the zero padding after the last member */
+			while (in_len > 0 && in_buf[in_start] == '\0') {
+				in_start++;
+				in_len--;
+			}
+
+			if (in_len == 0) {
+				if (!eof)
+					continue;
+				if (n_members > 0)
+					break;
+			}
+
+			in_member = TRUE;
+			n_members++;
+		}
+
+		result = g_converter_convert (converter,
+					      in_buf + in_start, in_len,
+					      out_buf, BUFFER_SIZE,
+					      eof ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+					      &bytes_read, &bytes_written,
+					      &convert_error);
+		if (result == G_CONVERTER_ERROR) {
+			if (!eof && g_error_matches (convert_error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT)) {
+				/* Keep the unconsumed input and read some more after it */
+				g_error_free (convert_error);
+				memmove (in_buf, in_buf + in_start, in_len);
+				in_start = 0;
+				if (in_len == BUFFER_SIZE) {
+					g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+							     "Invalid gzip data");
+					goto out;
+				}
+
+				size = g_input_stream_read (input, in_buf + in_len,
+							    BUFFER_SIZE - in_len, NULL, error);
+				if (size == -1)
+					goto out;
+
+				eof = size == 0;
+				in_len += size;
+				continue;
+			}
+
+			g_propagate_error (error, convert_error);
+			goto out;
+		}
+
+		if (!g_output_stream_write_all (output, out_buf, bytes_written, NULL, NULL, error))
+			goto out;
+
+		in_start += bytes_read;
+		in_len -= bytes_read;
+
+		if (result == G_CONVERTER_FINISHED) {
+			g_converter_reset (converter);
+			in_member = FALSE;
+		}
+	}
+
+	retval = TRUE;
+out:
+	g_object_unref (converter);
+	g_free (in_buf);
+	g_free (out_buf);
+
+	return retval;
+}
+
+static gboolean
+compression_run_gzip (GInputStream  *input,
+		      GOutputStream *output,
+		      gboolean       compress,
+		      GError       **error)
+{
+	GConverter   *converter;
+	GInputStream *converter_stream;
+	gssize        retval;
+
+	if (!compress)
+		return compression_run_gunzip (input, output, error);
+
+	converter = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+	converter_stream = g_converter_input_stream_new (input, converter);
+	g_object_unref (converter);
+
+	retval = g_output_stream_splice (output, converter_stream,
+					 G_OUTPUT_STREAM_SPLICE_NONE,
+					 NULL, error);
+	g_object_unref (converter_stream);
+
+	return retval != -1;
+}
+
+#ifdef HAVE_BZLIB
+static gboolean
+compression_run_bzip2 (GInputStream  *input,
+		       GOutputStream *output,
+		       gboolean       compress,
+		       GError       **error)
+{
+	bz_stream strm;
+	gchar    *in_buf, *out_buf;
+	gboolean  eof = FALSE;
+	gboolean  stream_end = FALSE;
+	gboolean  retval = FALSE;
+	gint      ret;
+
+	memset (&strm, 0, sizeof (bz_stream));
+	ret = compress ? BZ2_bzCompressInit (&strm, 9, 0, 0) : BZ2_bzDecompressInit (&strm, 0, 0);
+	if (ret != BZ_OK) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				     "Failed to initialize bzip2 stream");
+		return FALSE;
+	}
+
+	in_buf = g_malloc (BUFFER_SIZE);
+	out_buf = g_malloc (BUFFER_SIZE);
+
+	for (;;) {
+		gsize produced;
+
+		if (strm.avail_in == 0 && !eof) {
+			gssize bytes_read;
+
+			bytes_read = g_input_stream_read (input, in_buf, BUFFER_SIZE, NULL, error);
+			if (bytes_read == -1)
+				goto out;
+
+			eof = bytes_read == 0;
+			strm.next_in = in_buf;
+			strm.avail_in = bytes_read;
+		}
+
+		/* Concatenated bzip2 files hold several streams, and
+		 * bzip2 -d outputs all of them: start a new one when
+		 * there is input left after the end of a stream.
+		 */
+		if (stream_end) {
+			gchar *next_in = strm.next_in;
+			guint  avail_in = strm.avail_in;
+
+			if (avail_in == 0)
+				break;
+
+			BZ2_bzDecompressEnd (&strm);
+			memset (&strm, 0, sizeof (bz_stream));
+			if (BZ2_bzDecompressInit (&strm, 0, 0) != BZ_OK) {
+				g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+						     "Failed to initialize bzip2 stream");
+				g_free (in_buf);
+				g_free (out_buf);
+				return FALSE;
+			}
+			strm.next_in = next_in;
+			strm.avail_in = avail_in;
+			stream_end = FALSE;
+		}
+
+		strm.next_out = out_buf;
+		strm.avail_out = BUFFER_SIZE;
+
+		if (compress)
+			ret = BZ2_bzCompress (&strm, eof ? BZ_FINISH : BZ_RUN);
+		else
+			ret = BZ2_bzDecompress (&strm);
+
+		if (ret < 0) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+					     "Invalid bzip2 data");
+			goto out;
+		}
+
+		produced = BUFFER_SIZE - strm.avail_out;
+		if (!g_output_stream_write_all (output, out_buf, produced, NULL, NULL, error))
+			goto out;
+
+		if (!compress && eof && strm.avail_in == 0 && produced == 0 &&
+		    ret != BZ_STREAM_END) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+					     "Unexpected end of bzip2 data");
+			goto out;
+		}
+
+		if (ret == BZ_STREAM_END) {
+			if (compress)
+				break;
+			stream_end = TRUE;
+		}
+	}
+
+	retval = TRUE;
+out:
+	if (compress)
+		BZ2_bzCompressEnd (&strm);
+	else
+		BZ2_bzDecompressEnd (&strm);
+
+	g_free (in_buf);
+	g_free (out_buf);
+
+	return retval;
+}
+#endif /* HAVE_BZLIB */
+
+#ifdef HAVE_LZMA
+static gboolean
+compression_run_xz (GInputStream  *input,
+		    GOutputStream *output,
+		    gboolean       compress,
+		    GError       **error)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	guint8     *in_buf, *out_buf;
+	gboolean    eof = FALSE;
+	gboolean    retval = FALSE;
+	lzma_ret    ret;
+
+	if (compress)
+		ret = lzma_easy_encoder (&strm, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
+	else
+		ret = lzma_stream_decoder (&strm, UINT64_MAX, LZMA_CONCATENATED);
+	if (ret != LZMA_OK) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				     "Failed to initialize xz stream");
+		return FALSE;
+	}
+
+	in_buf = g_malloc (BUFFER_SIZE);
+	out_buf = g_malloc (BUFFER_SIZE);
+
+	do {
+		if (strm.avail_in == 0 && !eof) {
+			gssize bytes_read;
+
+			bytes_read = g_input_stream_read (input, in_buf, BUFFER_SIZE, NULL, error);
+			if (bytes_read == -1)
+				goto out;
+
+			eof = bytes_read == 0;
+			strm.next_in = in_buf;
+			strm.avail_in = bytes_read;
+		}
+
+		strm.next_out = out_buf;
+		strm.avail_out = BUFFER_SIZE;
+
+		ret = lzma_code (&strm, eof ? LZMA_FINISH : LZMA_RUN);
+		if (ret != LZMA_OK && ret != LZMA_STREAM_END) {
+			g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+					     ret == LZMA_BUF_ERROR ?
+					     "Unexpected end of xz data" :
+					     "Invalid xz data");
+			goto out;
+		}
+
+		if (!g_output_stream_write_all (output, out_buf, BUFFER_SIZE - strm.avail_out,
+						NULL, NULL, error))
+			goto out;
+	} while (ret != LZMA_STREAM_END);
+
+	retval = TRUE;
+out:
+	lzma_end (&strm);
+
+	g_free (in_buf);
+	g_free (out_buf);
+
+	return retval;
+}
+#endif /* HAVE_LZMA */
+
+#if !defined (HAVE_BZLIB) || !defined (HAVE_LZMA)
 static const char *compressor_cmds[] = {
   NULL,
   "bzip2",
@@ -585,24 +1006,19 @@ static const char *compressor_cmds[] = {
   "xz"
 };
 
-#define N_ARGS      4
-#define BUFFER_SIZE 1024
-
-static gchar *
-compression_run (const gchar       *uri,
-		 EvCompressionType  type,
-		 gboolean           compress, 
-		 GError           **error)
+/* Fallback for the formats not supported in-process */
+static gboolean
+compression_run_command (const gchar       *uri,
+			 EvCompressionType  type,
+			 GOutputStream     *output,
+			 gboolean           compress,
+			 GError           **error)
 {
-	gchar *argv[N_ARGS];
-	gchar *uri_dst = NULL;
-	gchar *filename, *filename_dst = NULL;
-	gchar *cmd;
-	gint   fd, pout;
-	GError *err = NULL;
-
-	if (type == EV_COMPRESSION_NONE)
-		return NULL;
+	gchar    *argv[4];
+	gchar    *filename;
+	gchar    *cmd;
+	gint      pout;
+	gboolean  retval;
 
 	cmd = g_find_program_in_path (compressor_cmds[type]);
 	if (!cmd) {
@@ -611,21 +1027,13 @@ compression_run (const gchar       *uri,
 		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
 			     "Failed to find the \"%s\" command in the search path.",
                              compressor_cmds[type]);
-		return NULL;
+		return FALSE;
 	}
 
 	filename = g_filename_from_uri (uri, NULL, error);
 	if (!filename) {
 		g_free (cmd);
-		return NULL;
-	}
-
-        fd = ev_mkstemp ("comp.XXXXXX", &filename_dst, error);
-	if (fd == -1) {
-		g_free (cmd);
-		g_free (filename);
-
-		return NULL;
+		return FALSE;
 	}
 
 	argv[0] = cmd;
@@ -633,52 +1041,121 @@ compression_run (const gchar       *uri,
 	argv[2] = filename;
 	argv[3] = NULL;
 
-	if (g_spawn_async_with_pipes (NULL, argv, NULL,
-				      G_SPAWN_STDERR_TO_DEV_NULL,
-				      NULL, NULL, NULL,
-				      NULL, &pout, NULL, &err)) {
-		GIOChannel *in, *out;
-		gchar buf[BUFFER_SIZE];
-		GIOStatus read_st, write_st;
-		gsize bytes_read, bytes_written;
+	retval = g_spawn_async_with_pipes (NULL, argv, NULL,
+					   G_SPAWN_STDERR_TO_DEV_NULL,
+					   NULL, NULL, NULL,
+					   NULL, &pout, NULL, error);
+	if (retval) {
+		GIOChannel *in;
+		gchar      *buf;
+		GIOStatus   read_st;
+		gsize       bytes_read;
 
 		in = g_io_channel_unix_new (pout);
 		g_io_channel_set_encoding (in, NULL, NULL);
-		out = g_io_channel_unix_new (fd);
-		g_io_channel_set_encoding (out, NULL, NULL);
+		g_io_channel_set_close_on_unref (in, TRUE);
+		buf = g_malloc (BUFFER_SIZE);
 
 		do {
-			read_st = g_io_channel_read_chars (in, buf,
-							   BUFFER_SIZE,
-							   &bytes_read,
-							   error);
-			if (read_st == G_IO_STATUS_NORMAL) {
-				write_st = g_io_channel_write_chars (out, buf,
-								     bytes_read,
-								     &bytes_written,
-								     error);
-				if (write_st == G_IO_STATUS_ERROR)
-					break;
-			} else if (read_st == G_IO_STATUS_ERROR) {
+			read_st = g_io_channel_read_chars (in, buf, BUFFER_SIZE,
+							   &bytes_read, error);
+			if (read_st == G_IO_STATUS_ERROR ||
+			    !g_output_stream_write_all (output, buf, bytes_read,
+							NULL, NULL, error)) {
+				retval = FALSE;
 				break;
 			}
-		} while (bytes_read > 0);
+		} while (read_st != G_IO_STATUS_EOF);
 
+		g_free (buf);
 		g_io_channel_unref (in);
-		g_io_channel_unref (out);
 	}
 
-	close (fd);
+	g_free (cmd);
+	g_free (filename);
 
-	if (err) {
-		g_propagate_error (error, err);
-	} else {
-		uri_dst = g_filename_to_uri (filename_dst, NULL, error);
+	return retval;
+}
+#endif
+
+static gchar *
+compression_run (const gchar       *uri,
+		 EvCompressionType  type,
+		 gboolean           compress,
+		 GError           **error)
+{
+	GFile             *file, *file_dst;
+	GInputStream      *input = NULL;
+	GFileOutputStream *output;
+	gchar             *uri_dst = NULL;
+	gboolean           retval = FALSE;
+	GError            *err = NULL;
+
+	if (type == EV_COMPRESSION_NONE)
+		return NULL;
+
+	file_dst = ev_mkstemp_file ("comp.XXXXXX", error);
+	if (!file_dst)
+		return NULL;
+
+	output = g_file_replace (file_dst, NULL, FALSE,
+				 G_FILE_CREATE_PRIVATE,
+				 NULL, &err);
+	if (!output)
+		goto out;
+
+	if (type == EV_COMPRESSION_GZIP
+#ifdef HAVE_BZLIB
+	    || type == EV_COMPRESSION_BZIP2
+#endif
+#ifdef HAVE_LZMA
+	    || type == EV_COMPRESSION_LZMA
+#endif
+	    ) {
+		file = g_file_new_for_uri (uri);
+		input = G_INPUT_STREAM (g_file_read (file, NULL, &err));
+		g_object_unref (file);
+		if (!input)
+			goto out;
 	}
 
-	g_free (cmd);
-	g_free (filename);
-	g_free (filename_dst);
+	switch (type) {
+	case EV_COMPRESSION_GZIP:
+		retval = compression_run_gzip (input, G_OUTPUT_STREAM (output), compress, &err);
+		break;
+	case EV_COMPRESSION_BZIP2:
+#ifdef HAVE_BZLIB
+		retval = compression_run_bzip2 (input, G_OUTPUT_STREAM (output), compress, &err);
+#else
+		retval = compression_run_command (uri, type, G_OUTPUT_STREAM (output), compress, &err);
+#endif
+		break;
+	case EV_COMPRESSION_LZMA:
+#ifdef HAVE_LZMA
+		retval = compression_run_xz (input, G_OUTPUT_STREAM (output), compress, &err);
+#else
+		retval = compression_run_command (uri, type, G_OUTPUT_STREAM (output), compress, &err);
+#endif
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	if (retval)
+		retval = g_output_stream_close (G_OUTPUT_STREAM (output), NULL, &err);
+out:
+	if (input)
+		g_object_unref (input);
+	if (output)
+		g_object_unref (output);
+
+	if (retval) {
+		uri_dst = g_file_get_uri (file_dst);
+	} else {
+		g_propagate_error (error, err);
+		g_file_delete (file_dst, NULL, NULL);
+	}
+	g_object_unref (file_dst);
 
 	return uri_dst;
 }
@@ -0,0 +1,239 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Copyright (C) 2013 Evince contributors
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "ev-document-text.h"
+#include "ev-page-text.h"
+
+/* The text of a page with its layout and log attributes, shared by
+ * everything that needs it for a document. Every document keeps a weak
+ * table of the pages that are alive, so that the text of a page is only
+ * extracted once while somebody holds it.
+ */
+struct _EvPageText {
+	guint         page;
+	gchar        *text;
+	EvRectangle  *layout;
+	guint         layout_length;
+	PangoLogAttr *log_attrs;
+	gulong        log_attrs_length;
+
+	GHashTable   *store;
+	gint          ref_count;
+};
+
+/* Protects the stores, the reference counts and the lazy log attrs */
+G_LOCK_DEFINE_STATIC (page_text);
+
+G_DEFINE_BOXED_TYPE (EvPageText, ev_page_text, ev_page_text_ref, ev_page_text_unref)
+
+static void
+ev_page_text_free (EvPageText *page_text)
+{
+	g_free (page_text->text);
+	g_free (page_text->layout);
+	g_free (page_text->log_attrs);
+	g_slice_free (EvPageText, page_text);
+}
+
+static void
+page_text_detach (gpointer key,
+		  gpointer value,
+		  gpointer user_data)
+{
+	EvPageText *page_text = (EvPageText *)value;
+
+	page_text->store = NULL;
+}
+
+static void
+page_text_store_destroy (GHashTable *store)
+{
+	G_LOCK (page_text);
+	g_hash_table_foreach (store, page_text_detach, NULL);
+	G_UNLOCK (page_text);
+
+	g_hash_table_destroy (store);
+}
+
+static GHashTable *
+page_text_get_store (EvDocument *document)
+{
+	GHashTable   *store;
+	static GQuark store_key = 0;
+
+	if (!store_key)
+		store_key = g_quark_from_static_string ("ev-page-text-store");
+
+	store = g_object_get_qdata (G_OBJECT (document), store_key);
+	if (!store) {
+		store = g_hash_table_new (g_direct_hash, g_direct_equal);
+		g_object_set_qdata_full (G_OBJECT (document),
+					 store_key, store,
+					 (GDestroyNotify) page_text_store_destroy);
+	}
+
+	return store;
+}
+
+/**
+ * ev_page_text_get:
+ * @document: an #EvDocument implementing #EvDocumentText
+ * @page: an #EvPage of @document
+ *
+ * Returns the text of @page, extracting it only if nobody holds it
+ * already. Must be called with the document mutex held.
+ *
+ * Returns: (transfer full): an #EvPageText, or %NULL if the page has no text
+ */
+EvPageText *
+ev_page_text_get (EvDocument *document,
+		  EvPage     *page)
+{
+	EvPageText *page_text;
+	GHashTable *store;
+
+	g_return_val_if_fail (EV_IS_DOCUMENT_TEXT (document), NULL);
+	g_return_val_if_fail (EV_IS_PAGE (page), NULL);
+
+	G_LOCK (page_text);
+	store = page_text_get_store (document);
+	page_text = g_hash_table_lookup (store, GINT_TO_POINTER (page->index));
+	if (page_text)
+		page_text->ref_count++;
+	G_UNLOCK (page_text);
+
+	if (page_text)
+		return page_text;
+
+	/* The doc mutex is held, so no other thread can be extracting the
+	 * same page meanwhile */
+	page_text = g_slice_new0 (EvPageText);
+	page_text->page = page->index;
+	page_text->ref_count = 1;
+
+	/* A page without layout still has its text */
+	ev_document_text_get_page_text (EV_DOCUMENT_TEXT (document), page,
+					&page_text->text,
+					&page_text->layout,
+					&page_text->layout_length,
+					NULL, NULL);
+	if (!page_text->text) {
+		ev_page_text_free (page_text);
+
+		return NULL;
+	}
+
+	G_LOCK (page_text);
+	page_text->store = store;
+	g_hash_table_insert (store, GINT_TO_POINTER (page_text->page), page_text);
+	G_UNLOCK (page_text);
+
+	return page_text;
+}
+
+EvPageText *
+ev_page_text_ref (EvPageText *page_text)
+{
+	g_return_val_if_fail (page_text != NULL, NULL);
+
+	G_LOCK (page_text);
+	page_text->ref_count++;
+	G_UNLOCK (page_text);
+
+	return page_text;
+}
+
+void
+ev_page_text_unref (EvPageText *page_text)
+{
+	gboolean last;
+
+	g_return_if_fail (page_text != NULL);
+
+	G_LOCK (page_text);
+	last = --page_text->ref_count == 0;
+	if (last && page_text->store)
+		g_hash_table_remove (page_text->store, GINT_TO_POINTER (page_text->page));
+	G_UNLOCK (page_text);
+
+	if (last)
+		ev_page_text_free (page_text);
+}
+
+guint
+ev_page_text_get_page (EvPageText *page_text)
+{
+	return page_text->page;
+}
+
+const gchar *
+ev_page_text_get_text (EvPageText *page_text)
+{
+	return page_text->text;
+}
+
+/**
+ * ev_page_text_get_layout:
+ * @page_text: an #EvPageText
+ * @n_areas: (out): return location for the number of areas
+ *
+ * Returns: (transfer none) (array length=n_areas): the area of every
+ * character of the text
+ */
+const EvRectangle *
+ev_page_text_get_layout (EvPageText *page_text,
+			 guint      *n_areas)
+{
+	*n_areas = page_text->layout_length;
+
+	return page_text->layout;
+}
+
+/**
+ * ev_page_text_get_log_attrs:
+ * @page_text: an #EvPageText
+ * @n_attrs: (out): return location for the number of attributes
+ *
+ * The attributes are computed the first time they are requested.
+ *
+ * Returns: (transfer none) (array length=n_attrs): the #PangoLogAttr of
+ * every character of the text
+ */
+const PangoLogAttr *
+ev_page_text_get_log_attrs (EvPageText *page_text,
+			    gulong     *n_attrs)
+{
+	G_LOCK (page_text);
+	if (!page_text->log_attrs) {
+		page_text->log_attrs_length = g_utf8_strlen (page_text->text, -1);
+		page_text->log_attrs = g_new0 (PangoLogAttr, page_text->log_attrs_length + 1);
+
+		/* FIXME: We need API to get the language of the document */
+		pango_get_log_attrs (page_text->text, -1, -1, NULL,
+				     page_text->log_attrs,
+				     page_text->log_attrs_length + 1);
+	}
+	G_UNLOCK (page_text);
+
+	*n_attrs = page_text->log_attrs_length;
+
+	return page_text->log_attrs;
+}
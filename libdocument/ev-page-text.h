@@ -0,0 +1,52 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Copyright (C) 2013 Evince contributors
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (__EV_EVINCE_DOCUMENT_H_INSIDE__) && !defined (EVINCE_COMPILATION)
+#error "Only <evince-document.h> can be included directly."
+#endif
+
+#ifndef EV_PAGE_TEXT_H
+#define EV_PAGE_TEXT_H
+
+#include <pango/pango.h>
+
+#include "ev-document.h"
+
+G_BEGIN_DECLS
+
+typedef struct _EvPageText EvPageText;
+
+#define             EV_TYPE_PAGE_TEXT             (ev_page_text_get_type())
+GType               ev_page_text_get_type         (void) G_GNUC_CONST;
+
+EvPageText         *ev_page_text_get              (EvDocument *document,
+						   EvPage     *page);
+EvPageText         *ev_page_text_ref              (EvPageText *page_text);
+void                ev_page_text_unref            (EvPageText *page_text);
+
+guint               ev_page_text_get_page         (EvPageText *page_text);
+const gchar        *ev_page_text_get_text         (EvPageText *page_text);
+const EvRectangle  *ev_page_text_get_layout       (EvPageText *page_text,
+						   guint      *n_areas);
+const PangoLogAttr *ev_page_text_get_log_attrs    (EvPageText *page_text,
+						   gulong     *n_attrs);
+
+G_END_DECLS
+
+#endif /* EV_PAGE_TEXT_H */
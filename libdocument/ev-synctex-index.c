@@ -0,0 +1,1805 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Copyright (C) 2013 Evince contributors
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "ev-synctex-index.h"
+#include "ev-debug.h"
+#include "synctex_parser.h"
+#include "synctex_parser_utils.h"
+
+#define EV_SYNCTEX_INDEX_MAGIC      "EVSYNC02"
+#define EV_SYNCTEX_INDEX_BYTE_ORDER 0x01020304
+#define EV_SYNCTEX_INDEX_MAX_AGE    (30 * 24 * 60 * 60)
+
+/* An index file contains everything needed to answer SyncTeX queries
+ * for one .synctex file, so that it doesn't need to be parsed again
+ * until it changes:
+ *
+ *   EvSynctexIndexHeader
+ *   EvSynctexIndexPage[n_pages + 1]
+ *   EvSynctexIndexLine[n_lines]
+ *   EvSynctexIndexNode[n_nodes]
+ *   guint32 forward[n_nodes]
+ *   EvSynctexIndexInput[n_inputs]
+ *   input names, nul terminated and padded to 4 bytes
+ *
+ * A line is an horizontal box of the typeset output. Lines are grouped
+ * by page and sorted by their bottom edge; the nodes of a line (the
+ * positions TeX recorded while typesetting it) are stored contiguously
+ * and sorted horizontally. The forward table holds the node indices
+ * sorted by input tag and line number. Everything is stored in host
+ * byte order, and the file is only valid for the .synctex file whose
+ * modification time (in nanoseconds) and size are recorded in the header.
+ * Indices read from the cache are validated before being used, so that
+ * a corrupted file can't make queries read outside of it.
+ */
+typedef struct {
+	gchar   magic[8];
+	guint32 byte_order;
+	guint32 n_pages;
+	guint32 n_lines;
+	guint32 n_nodes;
+	guint32 n_inputs;
+	guint32 names_size;
+	guint64 mtime;
+	guint64 size;
+} EvSynctexIndexHeader;
+
+typedef struct {
+	guint32 first_line;
+	gfloat  max_height;
+} EvSynctexIndexPage;
+
+typedef struct {
+	gfloat  x1, y1, x2, y2;
+	guint32 page;
+	guint32 first_node;
+	guint32 n_nodes;
+} EvSynctexIndexLine;
+
+typedef struct {
+	gint32  tag;
+	gint32  line;
+	gint32  column;
+	guint32 line_index;
+	gfloat  x;
+} EvSynctexIndexNode;
+
+typedef struct {
+	gint32  tag;
+	guint32 name_offset;
+} EvSynctexIndexInput;
+
+struct _EvSynctexIndex {
+	gchar                      *output;
+	GBytes                     *data;
+
+	const EvSynctexIndexHeader *header;
+	const EvSynctexIndexPage   *pages;
+	const EvSynctexIndexLine   *lines;
+	const EvSynctexIndexNode   *nodes;
+	const guint32              *forward;
+	const EvSynctexIndexInput  *inputs;
+	const gchar                *names;
+};
+
+#define PAD4(n) (((n) + 3) & ~3)
+
+static guint64
+ev_synctex_index_get_size (const EvSynctexIndexHeader *header)
+{
+	/* The counts are 32 bits, so this can't overflow */
+	return sizeof (EvSynctexIndexHeader) +
+		((guint64)header->n_pages + 1) * sizeof (EvSynctexIndexPage) +
+		(guint64)header->n_lines * sizeof (EvSynctexIndexLine) +
+		(guint64)header->n_nodes * (sizeof (EvSynctexIndexNode) + sizeof (guint32)) +
+		(guint64)header->n_inputs * sizeof (EvSynctexIndexInput) +
+		PAD4 ((guint64)header->names_size);
+}
+
+static gboolean
+ev_synctex_index_set_data (EvSynctexIndex *index,
+			   GBytes         *data)
+{
+	const gchar *contents;
+	gsize        length;
+
+	contents = g_bytes_get_data (data, &length);
+	if (length < sizeof (EvSynctexIndexHeader))
+		return FALSE;
+
+	index->header = (const EvSynctexIndexHeader *)contents;
+	if (length != ev_synctex_index_get_size (index->header))
+		return FALSE;
+
+	contents += sizeof (EvSynctexIndexHeader);
+	index->pages = (const EvSynctexIndexPage *)contents;
+	contents += (index->header->n_pages + 1) * sizeof (EvSynctexIndexPage);
+	index->lines = (const EvSynctexIndexLine *)contents;
+	contents += index->header->n_lines * sizeof (EvSynctexIndexLine);
+	index->nodes = (const EvSynctexIndexNode *)contents;
+	contents += index->header->n_nodes * sizeof (EvSynctexIndexNode);
+	index->forward = (const guint32 *)contents;
+	contents += index->header->n_nodes * sizeof (guint32);
+	index->inputs = (const EvSynctexIndexInput *)contents;
+	contents += index->header->n_inputs * sizeof (EvSynctexIndexInput);
+	index->names = contents;
+
+	index->data = g_bytes_ref (data);
+
+	return TRUE;
+}
+
+/* Checks every index the queries follow */
+static gboolean
+ev_synctex_index_validate (EvSynctexIndex *index)
+{
+	const EvSynctexIndexHeader *header = index->header;
+	guint                       i;
+
+	if (index->pages[0].first_line != 0 ||
+	    index->pages[header->n_pages].first_line != header->n_lines)
+		return FALSE;
+
+	for (i = 0; i < header->n_pages; i++) {
+		if (index->pages[i].first_line > index->pages[i + 1].first_line)
+			return FALSE;
+	}
+
+	for (i = 0; i < header->n_lines; i++) {
+		const EvSynctexIndexLine *line = &index->lines[i];
+
+		if (line->n_nodes == 0 ||
+		    line->first_node > header->n_nodes ||
+		    line->n_nodes > header->n_nodes - line->first_node)
+			return FALSE;
+	}
+
+	for (i = 0; i < header->n_nodes; i++) {
+		if (index->nodes[i].line_index >= header->n_lines ||
+		    index->forward[i] >= header->n_nodes)
+			return FALSE;
+	}
+
+	if (header->n_inputs > 0 &&
+	    (header->names_size == 0 || index->names[header->names_size - 1] != '\0'))
+		return FALSE;
+
+	for (i = 0; i < header->n_inputs; i++) {
+		if (index->inputs[i].name_offset >= header->names_size)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gchar *
+ev_synctex_index_get_filename (const gchar *synctex)
+{
+	gchar *checksum;
+	gchar *basename;
+	gchar *filename;
+
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, synctex, -1);
+	basename = g_strconcat (checksum, ".evsynctex", NULL);
+	filename = g_build_filename (g_get_user_cache_dir (),
+				     "evince", "synctex",
+				     basename, NULL);
+	g_free (checksum);
+	g_free (basename);
+
+	return filename;
+}
+
+/* Same lookup synctex_scanner_new_with_output_file () does for
+ * the common case, so that a valid index is used without
+ * creating a scanner at all.
+ */
+static gchar *
+ev_synctex_index_find_synctex (const gchar *output)
+{
+	static const gchar *extensions[] = { ".synctex.gz", ".synctex" };
+	const gchar        *dot;
+	gchar              *base;
+	guint               i;
+
+	dot = strrchr (output, '.');
+	if (dot && !strchr (dot, G_DIR_SEPARATOR))
+		base = g_strndup (output, dot - output);
+	else
+		base = g_strdup (output);
+
+	for (i = 0; i < G_N_ELEMENTS (extensions); i++) {
+		gchar *synctex;
+
+		synctex = g_strconcat (base, extensions[i], NULL);
+		if (g_file_test (synctex, G_FILE_TEST_IS_REGULAR)) {
+			g_free (base);
+			return synctex;
+		}
+		g_free (synctex);
+	}
+	g_free (base);
+
+	return NULL;
+}
+
+/* The modification time is in nanoseconds, TeX can rewrite the
+ * .synctex file several times within a second.
+ */
+static gboolean
+ev_synctex_index_stat (const gchar *synctex,
+		       guint64     *mtime,
+		       guint64     *size)
+{
+	GStatBuf statbuf;
+
+	if (g_stat (synctex, &statbuf) != 0)
+		return FALSE;
+
+	*mtime = (guint64)statbuf.st_mtime * G_GUINT64_CONSTANT (1000000000);
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	*mtime += statbuf.st_mtim.tv_nsec;
+#endif
+	*size = statbuf.st_size;
+
+	return TRUE;
+}
+
+/* Without sub-second timestamps, the .synctex file could still be
+ * rewritten with the same size and modification time after it was
+ * parsed. Don't cache its index until that can't happen anymore.
+ */
+static gboolean
+ev_synctex_index_can_cache (guint64 mtime)
+{
+	guint64 seconds = mtime / G_GUINT64_CONSTANT (1000000000);
+
+	if (mtime == 0)
+		return FALSE;
+
+	return mtime % G_GUINT64_CONSTANT (1000000000) != 0 ||
+		seconds + 1 < (guint64)time (NULL);
+}
+
+static gboolean
+ev_synctex_index_read (EvSynctexIndex *index,
+		       const gchar    *synctex,
+		       gint            n_pages)
+{
+	GMappedFile *mapped;
+	GBytes      *data;
+	gchar       *filename;
+	guint64      mtime, size;
+	gboolean     retval;
+
+	if (!ev_synctex_index_stat (synctex, &mtime, &size))
+		return FALSE;
+
+	filename = ev_synctex_index_get_filename (synctex);
+	mapped = g_mapped_file_new (filename, FALSE, NULL);
+	if (!mapped) {
+		g_free (filename);
+		return FALSE;
+	}
+
+	data = g_mapped_file_get_bytes (mapped);
+	g_mapped_file_unref (mapped);
+
+	retval = ev_synctex_index_set_data (index, data);
+	g_bytes_unref (data);
+	if (!retval) {
+		g_free (filename);
+		return FALSE;
+	}
+
+	if (memcmp (index->header->magic, EV_SYNCTEX_INDEX_MAGIC, 8) != 0 ||
+	    index->header->byte_order != EV_SYNCTEX_INDEX_BYTE_ORDER ||
+	    index->header->n_pages != n_pages ||
+	    index->header->mtime != mtime ||
+	    index->header->size != size ||
+	    !ev_synctex_index_validate (index)) {
+		g_bytes_unref (index->data);
+		index->data = NULL;
+		g_free (filename);
+		return FALSE;
+	}
+
+	/* Recently used indices are kept when cleaning up the cache */
+	g_utime (filename, NULL);
+	g_free (filename);
+
+	return TRUE;
+}
+
+/* Index creation */
+
+/* Lines and nodes of a single page while the index is being created.
+ * Nodes refer to their line by its position in the page.
+ */
+typedef struct {
+	GArray *lines;
+	GArray *nodes;
+} EvSynctexIndexSheet;
+
+static void
+ev_synctex_index_sheet_init (EvSynctexIndexSheet *sheet)
+{
+	sheet->lines = g_array_new (FALSE, FALSE, sizeof (EvSynctexIndexLine));
+	sheet->nodes = g_array_new (FALSE, FALSE, sizeof (EvSynctexIndexNode));
+}
+
+static void
+ev_synctex_index_sheet_clear (EvSynctexIndexSheet *sheet)
+{
+	g_array_free (sheet->lines, TRUE);
+	g_array_free (sheet->nodes, TRUE);
+}
+
+static void
+ev_synctex_index_sheet_set_line (EvSynctexIndexSheet *sheet,
+				 guint                line_index,
+				 gfloat               x,
+				 gfloat               width,
+				 gfloat               v,
+				 gfloat               height,
+				 gfloat               depth)
+{
+	EvSynctexIndexLine *line;
+
+	line = &g_array_index (sheet->lines, EvSynctexIndexLine, line_index);
+	line->x1 = MIN (x, x + width);
+	line->x2 = MAX (x, x + width);
+	line->y1 = MIN (v - height, v + depth);
+	line->y2 = MAX (v - height, v + depth);
+}
+
+static guint
+ev_synctex_index_sheet_add_line (EvSynctexIndexSheet *sheet,
+				 gint                 page)
+{
+	EvSynctexIndexLine line = { 0, };
+
+	line.page = page;
+	g_array_append_val (sheet->lines, line);
+
+	return sheet->lines->len - 1;
+}
+
+static void
+ev_synctex_index_sheet_add_node (EvSynctexIndexSheet *sheet,
+				 guint                line_index,
+				 gint                 tag,
+				 gint                 line,
+				 gint                 column,
+				 gfloat               x)
+{
+	EvSynctexIndexNode node;
+
+	node.tag = tag;
+	node.line = line;
+	node.column = column;
+	node.line_index = line_index;
+	node.x = x;
+	g_array_append_val (sheet->nodes, node);
+
+	g_array_index (sheet->lines, EvSynctexIndexLine, line_index).n_nodes++;
+}
+
+static void
+ev_synctex_index_add_input (GArray      *inputs,
+			    GString     *names,
+			    gint         tag,
+			    const gchar *name,
+			    gsize        length)
+{
+	EvSynctexIndexInput input;
+
+	input.tag = tag;
+	input.name_offset = names->len;
+	g_array_append_val (inputs, input);
+
+	g_string_append_len (names, name, length);
+	g_string_append_c (names, '\0');
+}
+
+static gint
+compare_lines (const guint              *a,
+	       const guint              *b,
+	       const EvSynctexIndexLine *lines)
+{
+	gfloat y2_a = lines[*a].y2;
+	gfloat y2_b = lines[*b].y2;
+
+	return (y2_a > y2_b) - (y2_a < y2_b);
+}
+
+static gint
+compare_nodes_by_x (const EvSynctexIndexNode *a,
+		    const EvSynctexIndexNode *b)
+{
+	return (a->x > b->x) - (a->x < b->x);
+}
+
+static gint
+compare_forward (const guint32 *a,
+		 const guint32 *b,
+		 GArray       **tables)
+{
+	const EvSynctexIndexNode *nodes = (const EvSynctexIndexNode *)tables[0]->data;
+	const EvSynctexIndexLine *lines = (const EvSynctexIndexLine *)tables[1]->data;
+	const EvSynctexIndexNode *node_a = &nodes[*a];
+	const EvSynctexIndexNode *node_b = &nodes[*b];
+	const EvSynctexIndexLine *line_a = &lines[node_a->line_index];
+	const EvSynctexIndexLine *line_b = &lines[node_b->line_index];
+
+	if (node_a->tag != node_b->tag)
+		return node_a->tag < node_b->tag ? -1 : 1;
+	if (node_a->line != node_b->line)
+		return node_a->line < node_b->line ? -1 : 1;
+	if (line_a->page != line_b->page)
+		return line_a->page < line_b->page ? -1 : 1;
+	if (line_a->y1 != line_b->y1)
+		return line_a->y1 < line_b->y1 ? -1 : 1;
+
+	return (node_a->x > node_b->x) - (node_a->x < node_b->x);
+}
+
+/* Links the sheets of every page into the final index */
+static GBytes *
+ev_synctex_index_link (EvSynctexIndexSheet *sheets,
+		       gint                 n_pages,
+		       GArray              *inputs,
+		       GString             *names,
+		       guint64              mtime,
+		       guint64              size)
+{
+	EvSynctexIndexHeader header;
+	GArray              *pages;
+	GArray              *lines;
+	GArray              *nodes;
+	GArray              *forward;
+	GArray              *tables[2];
+	GByteArray          *data;
+	gint                 page;
+	guint                i;
+
+	pages = g_array_sized_new (FALSE, FALSE, sizeof (EvSynctexIndexPage), n_pages + 1);
+	lines = g_array_new (FALSE, FALSE, sizeof (EvSynctexIndexLine));
+	nodes = g_array_new (FALSE, FALSE, sizeof (EvSynctexIndexNode));
+
+	for (page = 0; page < n_pages; page++) {
+		EvSynctexIndexSheet *sheet = &sheets[page];
+		EvSynctexIndexPage   index_page;
+		guint                first_line = lines->len;
+		guint                first_node = nodes->len;
+		guint               *order;
+		guint               *cursor;
+
+		index_page.first_line = first_line;
+		index_page.max_height = 0;
+
+		/* Sort the lines by their bottom edge */
+		order = g_new (guint, sheet->lines->len);
+		for (i = 0; i < sheet->lines->len; i++)
+			order[i] = i;
+		g_qsort_with_data (order, sheet->lines->len, sizeof (guint),
+				   (GCompareDataFunc)compare_lines,
+				   sheet->lines->data);
+
+		/* and group the nodes of every line after them */
+		cursor = g_new (guint, sheet->lines->len);
+		for (i = 0; i < sheet->lines->len; i++) {
+			EvSynctexIndexLine line;
+
+			line = g_array_index (sheet->lines, EvSynctexIndexLine, order[i]);
+			line.first_node = first_node;
+			first_node += line.n_nodes;
+
+			cursor[order[i]] = line.first_node;
+			g_array_append_val (lines, line);
+
+			index_page.max_height = MAX (index_page.max_height, line.y2 - line.y1);
+		}
+
+		g_array_set_size (nodes, first_node);
+		for (i = 0; i < sheet->nodes->len; i++) {
+			EvSynctexIndexNode node;
+
+			node = g_array_index (sheet->nodes, EvSynctexIndexNode, i);
+			g_array_index (nodes, EvSynctexIndexNode, cursor[node.line_index]++) = node;
+		}
+
+		for (i = first_line; i < lines->len; i++) {
+			EvSynctexIndexLine *line = &g_array_index (lines, EvSynctexIndexLine, i);
+			EvSynctexIndexNode *line_nodes;
+			guint               j;
+
+			line_nodes = &g_array_index (nodes, EvSynctexIndexNode, line->first_node);
+			for (j = 0; j < line->n_nodes; j++)
+				line_nodes[j].line_index = i;
+			qsort (line_nodes, line->n_nodes, sizeof (EvSynctexIndexNode),
+			       (GCompareFunc)compare_nodes_by_x);
+		}
+
+		g_free (order);
+		g_free (cursor);
+
+		g_array_append_val (pages, index_page);
+	}
+
+	/* Sentinel, so that the lines of page n are [pages[n], pages[n + 1]) */
+	{
+		EvSynctexIndexPage index_page = { lines->len, 0 };
+
+		g_array_append_val (pages, index_page);
+	}
+
+	forward = g_array_sized_new (FALSE, FALSE, sizeof (guint32), nodes->len);
+	for (i = 0; i < nodes->len; i++)
+		g_array_append_val (forward, i);
+
+	tables[0] = nodes;
+	tables[1] = lines;
+	g_array_sort_with_data (forward, (GCompareDataFunc)compare_forward, tables);
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, EV_SYNCTEX_INDEX_MAGIC, 8);
+	header.byte_order = EV_SYNCTEX_INDEX_BYTE_ORDER;
+	header.n_pages = n_pages;
+	header.n_lines = lines->len;
+	header.n_nodes = nodes->len;
+	header.n_inputs = inputs->len;
+	header.names_size = names->len;
+	header.mtime = mtime;
+	header.size = size;
+
+	data = g_byte_array_sized_new (ev_synctex_index_get_size (&header));
+	g_byte_array_append (data, (guint8 *)&header, sizeof (header));
+	g_byte_array_append (data, (guint8 *)pages->data, pages->len * sizeof (EvSynctexIndexPage));
+	g_byte_array_append (data, (guint8 *)lines->data, lines->len * sizeof (EvSynctexIndexLine));
+	g_byte_array_append (data, (guint8 *)nodes->data, nodes->len * sizeof (EvSynctexIndexNode));
+	g_byte_array_append (data, (guint8 *)forward->data, forward->len * sizeof (guint32));
+	g_byte_array_append (data, (guint8 *)inputs->data, inputs->len * sizeof (EvSynctexIndexInput));
+	g_byte_array_append (data, (guint8 *)names->str, names->len);
+	while (data->len % 4)
+		g_byte_array_append (data, (guint8 *)"", 1);
+
+	g_array_free (pages, TRUE);
+	g_array_free (lines, TRUE);
+	g_array_free (nodes, TRUE);
+	g_array_free (forward, TRUE);
+
+	return g_byte_array_free_to_bytes (data);
+}
+
+/* Creating the index from the node tree of a synctex scanner */
+static guint
+ev_synctex_index_add_box (EvSynctexIndexSheet *sheet,
+			  synctex_node_t       node,
+			  gint                 page)
+{
+	guint line_index;
+
+	line_index = ev_synctex_index_sheet_add_line (sheet, page);
+	ev_synctex_index_sheet_set_line (sheet, line_index,
+					 synctex_node_box_visible_h (node),
+					 synctex_node_box_visible_width (node),
+					 synctex_node_box_visible_v (node),
+					 synctex_node_box_visible_height (node),
+					 synctex_node_box_visible_depth (node));
+
+	return line_index;
+}
+
+static void
+ev_synctex_index_add_nodes (EvSynctexIndexSheet *sheet,
+			    synctex_node_t       node,
+			    gint                 page,
+			    gboolean             in_hbox)
+{
+	for (; node; node = synctex_node_sibling (node)) {
+		EvSynctexIndexLine *line;
+		synctex_node_t      child;
+		guint               line_index;
+
+		switch (synctex_node_type (node)) {
+		case synctex_node_type_hbox:
+			line_index = ev_synctex_index_add_box (sheet, node, page);
+			for (child = synctex_node_child (node); child; child = synctex_node_sibling (child)) {
+				switch (synctex_node_type (child)) {
+				case synctex_node_type_hbox:
+				case synctex_node_type_vbox:
+					break;
+				default:
+					ev_synctex_index_sheet_add_node (sheet, line_index,
+									 synctex_node_tag (child),
+									 synctex_node_line (child),
+									 synctex_node_column (child),
+									 synctex_node_visible_h (child));
+				}
+			}
+
+			line = &g_array_index (sheet->lines, EvSynctexIndexLine, line_index);
+			if (line->n_nodes == 0) {
+				ev_synctex_index_sheet_add_node (sheet, line_index,
+								 synctex_node_tag (node),
+								 synctex_node_line (node),
+								 synctex_node_column (node),
+								 line->x1);
+			}
+
+			ev_synctex_index_add_nodes (sheet, synctex_node_child (node), page, TRUE);
+			break;
+		case synctex_node_type_vbox:
+			ev_synctex_index_add_nodes (sheet, synctex_node_child (node), page, FALSE);
+			break;
+		case synctex_node_type_void_hbox:
+		case synctex_node_type_void_vbox:
+			/* Already a node of the enclosing line */
+			if (in_hbox)
+				break;
+
+			line_index = ev_synctex_index_add_box (sheet, node, page);
+			line = &g_array_index (sheet->lines, EvSynctexIndexLine, line_index);
+			ev_synctex_index_sheet_add_node (sheet, line_index,
+							 synctex_node_tag (node),
+							 synctex_node_line (node),
+							 synctex_node_column (node),
+							 line->x1);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static GBytes *
+ev_synctex_index_build (synctex_scanner_t scanner,
+			gint              n_pages,
+			guint64           mtime,
+			guint64           size)
+{
+	EvSynctexIndexSheet *sheets;
+	GArray              *inputs;
+	GString             *names;
+	GBytes              *data;
+	synctex_node_t       input;
+	gint                 page;
+
+	sheets = g_new (EvSynctexIndexSheet, n_pages);
+	for (page = 0; page < n_pages; page++) {
+		ev_synctex_index_sheet_init (&sheets[page]);
+		ev_synctex_index_add_nodes (&sheets[page],
+					    synctex_sheet_content (scanner, page + 1),
+					    page, FALSE);
+	}
+
+	inputs = g_array_new (FALSE, FALSE, sizeof (EvSynctexIndexInput));
+	names = g_string_new (NULL);
+	for (input = synctex_scanner_input (scanner); input; input = synctex_node_sibling (input)) {
+		const gchar *name;
+
+		name = synctex_scanner_get_name (scanner, synctex_node_tag (input));
+		if (name)
+			ev_synctex_index_add_input (inputs, names, synctex_node_tag (input),
+						    name, strlen (name));
+	}
+
+	data = ev_synctex_index_link (sheets, n_pages, inputs, names, mtime, size);
+
+	for (page = 0; page < n_pages; page++)
+		ev_synctex_index_sheet_clear (&sheets[page]);
+	g_free (sheets);
+	g_array_free (inputs, TRUE);
+	g_string_free (names, TRUE);
+
+	return data;
+}
+
+/* Creating the index straight from the .synctex contents.
+ *
+ * The file is inflated at once and split at the sheet boundaries, then
+ * every sheet is parsed in a worker thread into the arrays of its page,
+ * instead of building the node tree of the synctex parser one record
+ * at a time. Files this parser doesn't handle (a post scriptum changing
+ * the magnification or the offsets, malformed or unknown records) are
+ * left to the synctex parser.
+ */
+#define SYNCTEX_UNIT_FACTOR 65781.76
+
+typedef struct {
+	gfloat unit;
+	gfloat x_offset;
+	gfloat y_offset;
+} EvSynctexIndexUnits;
+
+typedef struct {
+	const gchar               *start;
+	const gchar               *end;
+	gint                       page;
+
+	const EvSynctexIndexUnits *units;
+	EvSynctexIndexSheet       *sheet;
+	gboolean                   failed;
+} EvSynctexIndexSheetTask;
+
+typedef struct {
+	gboolean is_hbox;
+	guint    line_index;
+	gint     tag;
+	gint     line;
+	/* Visible extents of horizontal boxes, in synctex units */
+	gint     h, v, width, height, depth;
+} EvSynctexIndexBox;
+
+static gboolean
+line_has_prefix (const gchar *line,
+		 const gchar *end,
+		 const gchar *prefix)
+{
+	gsize length = strlen (prefix);
+
+	return (gsize)(end - line) >= length && strncmp (line, prefix, length) == 0;
+}
+
+static gboolean
+parse_int (const gchar **ptr,
+	   const gchar  *end,
+	   gint         *value)
+{
+	const gchar *p = *ptr;
+	gboolean     negative = FALSE;
+	gint         result = 0;
+
+	if (p < end && (*p == ':' || *p == ','))
+		p++;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+	if (p == end || !g_ascii_isdigit (*p))
+		return FALSE;
+
+	while (p < end && g_ascii_isdigit (*p))
+		result = result * 10 + (*p++ - '0');
+
+	*value = negative ? -result : result;
+	*ptr = p;
+
+	return TRUE;
+}
+
+static gboolean
+parse_ints (const gchar *p,
+	    const gchar *end,
+	    gint        *values,
+	    guint        n_values)
+{
+	guint i;
+
+	for (i = 0; i < n_values; i++) {
+		if (!parse_int (&p, end, &values[i]))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Same as _synctex_hbox_setup_visible (): horizontal boxes are enlarged
+ * to contain their material, some of them have no width but do contain text.
+ */
+static void
+box_setup_visible (EvSynctexIndexBox *box,
+		   gint               h)
+{
+	gint btm, top;
+
+	if (box->width < 0) {
+		btm = box->h;
+		top = box->h - box->width;
+		if (h < btm) {
+			box->h = h;
+			box->width = box->h - top;
+		} else if (h > top) {
+			box->width = box->h - h;
+		}
+	} else {
+		btm = box->h;
+		top = box->h + box->width;
+		if (h < btm) {
+			box->h = h;
+			box->width = top - box->h;
+		} else if (h > top) {
+			box->width = h - box->h;
+		}
+	}
+}
+
+static void
+ev_synctex_index_task_set_line (EvSynctexIndexSheetTask *task,
+				guint                    line_index,
+				gint                     h,
+				gint                     v,
+				gint                     width,
+				gint                     height,
+				gint                     depth)
+{
+	const EvSynctexIndexUnits *units = task->units;
+
+	ev_synctex_index_sheet_set_line (task->sheet, line_index,
+					 h * units->unit + units->x_offset,
+					 width * units->unit,
+					 v * units->unit + units->y_offset,
+					 height * units->unit,
+					 depth * units->unit);
+}
+
+static void
+ev_synctex_index_task_close_hbox (EvSynctexIndexSheetTask *task,
+				  EvSynctexIndexBox       *box)
+{
+	EvSynctexIndexLine *line;
+
+	ev_synctex_index_task_set_line (task, box->line_index,
+					box->h, box->v, box->width,
+					box->height, box->depth);
+
+	line = &g_array_index (task->sheet->lines, EvSynctexIndexLine, box->line_index);
+	if (line->n_nodes == 0) {
+		ev_synctex_index_sheet_add_node (task->sheet, box->line_index,
+						 box->tag, box->line, -1,
+						 line->x1);
+	}
+}
+
+static void
+ev_synctex_index_parse_sheet (EvSynctexIndexSheetTask *task,
+			      gpointer                 user_data)
+{
+	const EvSynctexIndexUnits *units = task->units;
+	const gchar               *p = task->start;
+	GArray                    *stack;
+	guint                      nested = 0;
+
+	stack = g_array_new (FALSE, FALSE, sizeof (EvSynctexIndexBox));
+
+	while (p < task->end) {
+		const gchar       *eol;
+		EvSynctexIndexBox *parent = NULL;
+		EvSynctexIndexBox  box;
+		gboolean           in_hbox;
+		gint               values[7];
+
+		eol = memchr (p, '\n', task->end - p);
+		if (!eol)
+			eol = task->end;
+
+		/* Nested sheets are ignored like the synctex parser does */
+		if (nested > 0) {
+			if (*p == '{')
+				nested++;
+			else if (*p == '}')
+				nested--;
+			p = eol + 1;
+			continue;
+		}
+
+		if (stack->len > 0)
+			parent = &g_array_index (stack, EvSynctexIndexBox, stack->len - 1);
+		in_hbox = parent && parent->is_hbox;
+
+		switch (*p) {
+		case '[':
+		case '(':
+			if (!parse_ints (p + 1, eol, values, 7))
+				goto error;
+
+			box.is_hbox = (*p == '(');
+			box.line_index = 0;
+			box.tag = values[0];
+			box.line = values[1];
+			box.h = values[2];
+			box.v = values[3];
+			box.width = values[4];
+			box.height = values[5];
+			box.depth = values[6];
+
+			if (box.is_hbox) {
+				if (in_hbox) {
+					box_setup_visible (parent, box.h);
+					box_setup_visible (parent, box.h + ABS (box.width));
+				}
+				box.line_index = ev_synctex_index_sheet_add_line (task->sheet, task->page);
+			}
+
+			g_array_append_val (stack, box);
+			break;
+		case ']':
+		case ')':
+			/* Unexpected ends of boxes are ignored */
+			if (!parent || parent->is_hbox != (*p == ')'))
+				break;
+
+			if (parent->is_hbox)
+				ev_synctex_index_task_close_hbox (task, parent);
+			g_array_set_size (stack, stack->len - 1);
+			break;
+		case 'v':
+		case 'h':
+			if (!parse_ints (p + 1, eol, values, 7))
+				goto error;
+
+			if (in_hbox) {
+				if (*p == 'h') {
+					box_setup_visible (parent, values[2]);
+					box_setup_visible (parent, values[2] + ABS (values[4]));
+				}
+				ev_synctex_index_sheet_add_node (task->sheet, parent->line_index,
+								 values[0], values[1], -1,
+								 values[2] * units->unit + units->x_offset);
+			} else {
+				guint               line_index;
+				EvSynctexIndexLine *line;
+
+				line_index = ev_synctex_index_sheet_add_line (task->sheet, task->page);
+				ev_synctex_index_task_set_line (task, line_index,
+								values[2], values[3], values[4],
+								values[5], values[6]);
+				line = &g_array_index (task->sheet->lines, EvSynctexIndexLine, line_index);
+				ev_synctex_index_sheet_add_node (task->sheet, line_index,
+								 values[0], values[1], -1,
+								 line->x1);
+			}
+			break;
+		case 'k':
+			if (!parse_ints (p + 1, eol, values, 5))
+				goto error;
+
+			if (in_hbox) {
+				box_setup_visible (parent, values[2]);
+				box_setup_visible (parent, values[2] - values[4]);
+				ev_synctex_index_sheet_add_node (task->sheet, parent->line_index,
+								 values[0], values[1], -1,
+								 values[2] * units->unit + units->x_offset);
+			}
+			break;
+		case 'g':
+		case '$':
+		case 'x':
+			if (!parse_ints (p + 1, eol, values, 4))
+				goto error;
+
+			if (in_hbox) {
+				box_setup_visible (parent, values[2]);
+				ev_synctex_index_sheet_add_node (task->sheet, parent->line_index,
+								 values[0], values[1], -1,
+								 values[2] * units->unit + units->x_offset);
+			}
+			break;
+		case '{':
+			nested = 1;
+			break;
+		case '!':
+		case '\n':
+			/* Anchors (byte offsets of the records) and empty lines */
+			break;
+		default:
+			/* Form references and other records this parser doesn't
+			 * know about are left to the synctex parser.
+			 */
+			goto error;
+		}
+
+		p = eol + 1;
+	}
+
+	/* Close the boxes left open at the end of the sheet */
+	while (stack->len > 0) {
+		EvSynctexIndexBox *box = &g_array_index (stack, EvSynctexIndexBox, stack->len - 1);
+
+		if (box->is_hbox)
+			ev_synctex_index_task_close_hbox (task, box);
+		g_array_set_size (stack, stack->len - 1);
+	}
+
+	g_array_free (stack, TRUE);
+
+	return;
+ error:
+	task->failed = TRUE;
+	g_array_free (stack, TRUE);
+}
+
+/* Reads the preamble, the input records and the boundaries of the sheets */
+static gboolean
+ev_synctex_index_split (const gchar         *contents,
+			gsize                length,
+			EvSynctexIndexUnits *units,
+			GArray              *inputs,
+			GString             *names,
+			GArray              *tasks)
+{
+	enum { PREAMBLE, CONTENT, POSTAMBLE, POST_SCRIPTUM } section = PREAMBLE;
+	const gchar *end = contents + length;
+	const gchar *p = contents;
+	const gchar *sheet_start = NULL;
+	guint        depth = 0;
+	gint         sheet_page = 0;
+	gint         magnification = 1000;
+	gint         unit = 8192;
+	gint         x_offset = 578;
+	gint         y_offset = 578;
+
+	if (!line_has_prefix (p, end, "SyncTeX Version:"))
+		return FALSE;
+
+	while (p < end) {
+		const gchar *eol;
+		const gchar *q;
+		gint         value;
+
+		eol = memchr (p, '\n', end - p);
+		if (!eol)
+			eol = end;
+
+		if (depth > 0) {
+			/* Only the sheet boundaries matter here */
+			if (*p == '{') {
+				depth++;
+			} else if (*p == '}' && --depth == 0) {
+				EvSynctexIndexSheetTask task = { 0, };
+
+				task.start = sheet_start;
+				task.end = p;
+				task.page = sheet_page - 1;
+				task.units = units;
+				g_array_append_val (tasks, task);
+			}
+			p = eol + 1;
+			continue;
+		}
+
+		if (line_has_prefix (p, eol, "Input:") && section != POST_SCRIPTUM) {
+			q = p + strlen ("Input");
+			if (parse_int (&q, eol, &value) && q < eol && *q == ':')
+				ev_synctex_index_add_input (inputs, names, value, q + 1, eol - q - 1);
+		} else if (section == PREAMBLE) {
+			q = memchr (p, ':', eol - p);
+			if (line_has_prefix (p, eol, "Content:"))
+				section = CONTENT;
+			else if (!q || !parse_int (&q, eol, &value))
+				;
+			else if (line_has_prefix (p, eol, "Magnification:"))
+				magnification = value;
+			else if (line_has_prefix (p, eol, "Unit:"))
+				unit = value;
+			else if (line_has_prefix (p, eol, "X Offset:"))
+				x_offset = value;
+			else if (line_has_prefix (p, eol, "Y Offset:"))
+				y_offset = value;
+		} else if (section == CONTENT) {
+			if (*p == '{') {
+				q = p + 1;
+				if (!parse_int (&q, eol, &sheet_page))
+					return FALSE;
+				sheet_start = eol + 1;
+				depth = 1;
+			} else if (line_has_prefix (p, eol, "Postamble:")) {
+				section = POSTAMBLE;
+			}
+		} else if (section == POSTAMBLE) {
+			if (line_has_prefix (p, eol, "Post scriptum:"))
+				section = POST_SCRIPTUM;
+		} else if (line_has_prefix (p, eol, "Magnification:") ||
+			   line_has_prefix (p, eol, "X Offset:") ||
+			   line_has_prefix (p, eol, "Y Offset:")) {
+			/* Values given in physical units, leave them to synctex */
+			return FALSE;
+		}
+
+		p = eol + 1;
+	}
+
+	if (section == PREAMBLE || depth > 0)
+		return FALSE;
+
+	if (unit <= 0)
+		unit = 8192;
+	if (magnification <= 0)
+		magnification = 1000;
+
+	units->unit = unit / SYNCTEX_UNIT_FACTOR * (magnification / 1000.0);
+	units->x_offset = x_offset * (unit / SYNCTEX_UNIT_FACTOR);
+	units->y_offset = y_offset * (unit / SYNCTEX_UNIT_FACTOR);
+
+	return TRUE;
+}
+
+static GBytes *
+ev_synctex_index_load_synctex (const gchar *synctex)
+{
+	GFile         *file;
+	GInputStream  *input;
+	GInputStream  *stream;
+	GConverter    *decompressor;
+	GOutputStream *output;
+	GBytes        *contents = NULL;
+
+	if (!g_str_has_suffix (synctex, ".gz")) {
+		GMappedFile *mapped;
+
+		mapped = g_mapped_file_new (synctex, FALSE, NULL);
+		if (!mapped)
+			return NULL;
+
+		contents = g_mapped_file_get_bytes (mapped);
+		g_mapped_file_unref (mapped);
+
+		return contents;
+	}
+
+	file = g_file_new_for_path (synctex);
+	input = G_INPUT_STREAM (g_file_read (file, NULL, NULL));
+	g_object_unref (file);
+	if (!input)
+		return NULL;
+
+	/* A gzip stream can only be inflated sequentially */
+	decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+	stream = g_converter_input_stream_new (input, decompressor);
+	g_object_unref (decompressor);
+	g_object_unref (input);
+
+	output = g_memory_output_stream_new_resizable ();
+	if (g_output_stream_splice (output, stream,
+				    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+				    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+				    NULL, NULL) >= 0)
+		contents = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (output));
+	g_object_unref (output);
+	g_object_unref (stream);
+
+	return contents;
+}
+
+static GBytes *
+ev_synctex_index_parse (const gchar *synctex,
+			gint         n_pages,
+			guint64      mtime,
+			guint64      size)
+{
+	GBytes              *contents;
+	const gchar         *data;
+	gsize                length;
+	EvSynctexIndexUnits  units;
+	EvSynctexIndexSheet *sheets;
+	GArray              *inputs;
+	GString             *names;
+	GArray              *tasks;
+	GThreadPool         *pool;
+	gboolean            *claimed;
+	GBytes              *index_data = NULL;
+	gboolean             failed = FALSE;
+	gint                 page;
+	guint                i;
+
+	contents = ev_synctex_index_load_synctex (synctex);
+	if (!contents)
+		return NULL;
+
+	data = g_bytes_get_data (contents, &length);
+	inputs = g_array_new (FALSE, FALSE, sizeof (EvSynctexIndexInput));
+	names = g_string_new (NULL);
+	tasks = g_array_new (FALSE, FALSE, sizeof (EvSynctexIndexSheetTask));
+
+	if (!ev_synctex_index_split (data, length, &units, inputs, names, tasks)) {
+		g_array_free (inputs, TRUE);
+		g_string_free (names, TRUE);
+		g_array_free (tasks, TRUE);
+		g_bytes_unref (contents);
+
+		return NULL;
+	}
+
+	sheets = g_new (EvSynctexIndexSheet, n_pages);
+	for (page = 0; page < n_pages; page++)
+		ev_synctex_index_sheet_init (&sheets[page]);
+
+	claimed = g_new0 (gboolean, n_pages);
+	pool = g_thread_pool_new ((GFunc)ev_synctex_index_parse_sheet, NULL,
+				  g_get_num_processors (), FALSE, NULL);
+	for (i = 0; i < tasks->len; i++) {
+		EvSynctexIndexSheetTask *task;
+
+		task = &g_array_index (tasks, EvSynctexIndexSheetTask, i);
+		if (task->page < 0 || task->page >= n_pages)
+			continue;
+
+		/* Only the first sheet of a page is used */
+		if (claimed[task->page])
+			continue;
+		claimed[task->page] = TRUE;
+
+		task->sheet = &sheets[task->page];
+		g_thread_pool_push (pool, task, NULL);
+	}
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_free (claimed);
+
+	for (i = 0; i < tasks->len; i++)
+		failed |= g_array_index (tasks, EvSynctexIndexSheetTask, i).failed;
+
+	if (!failed)
+		index_data = ev_synctex_index_link (sheets, n_pages, inputs, names, mtime, size);
+
+	for (page = 0; page < n_pages; page++)
+		ev_synctex_index_sheet_clear (&sheets[page]);
+	g_free (sheets);
+	g_array_free (inputs, TRUE);
+	g_string_free (names, TRUE);
+	g_array_free (tasks, TRUE);
+	g_bytes_unref (contents);
+
+	return index_data;
+}
+
+/* Removes the indices that haven't been used for a while; their
+ * .synctex files are most likely gone already.
+ */
+static void
+ev_synctex_index_clean_cache (const gchar *dirname)
+{
+	GDir        *dir;
+	const gchar *name;
+	time_t       now;
+
+	dir = g_dir_open (dirname, 0, NULL);
+	if (!dir)
+		return;
+
+	now = time (NULL);
+	while ((name = g_dir_read_name (dir))) {
+		gchar   *filename;
+		GStatBuf statbuf;
+
+		/* Also catches temporary files left behind by a crash */
+		if (!strstr (name, ".evsynctex"))
+			continue;
+
+		filename = g_build_filename (dirname, name, NULL);
+		if (g_stat (filename, &statbuf) == 0 &&
+		    now - statbuf.st_mtime > EV_SYNCTEX_INDEX_MAX_AGE)
+			g_unlink (filename);
+		g_free (filename);
+	}
+	g_dir_close (dir);
+}
+
+static void
+ev_synctex_index_write (GBytes      *data,
+			const gchar *synctex)
+{
+	static gsize  cleaned = 0;
+	gchar        *filename;
+	gchar        *dirname;
+	const gchar  *contents;
+	gsize         length;
+	GError       *error = NULL;
+
+	filename = ev_synctex_index_get_filename (synctex);
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+	if (g_once_init_enter (&cleaned)) {
+		ev_synctex_index_clean_cache (dirname);
+		g_once_init_leave (&cleaned, 1);
+	}
+	g_free (dirname);
+
+	contents = g_bytes_get_data (data, &length);
+	if (!g_file_set_contents (filename, contents, length, &error)) {
+		g_warning ("Error writing SyncTeX index %s: %s",
+			   filename, error->message);
+		g_error_free (error);
+	}
+	g_free (filename);
+}
+
+static EvSynctexIndex *
+ev_synctex_index_open (const gchar *output,
+		       gint         n_pages)
+{
+	EvSynctexIndex   *index;
+	synctex_scanner_t scanner;
+	gchar            *synctex;
+	guint64           mtime, size;
+	GBytes           *data;
+
+	index = g_new0 (EvSynctexIndex, 1);
+	index->output = g_strdup (output);
+
+	synctex = ev_synctex_index_find_synctex (output);
+	if (synctex && ev_synctex_index_read (index, synctex, n_pages)) {
+		g_free (synctex);
+		return index;
+	}
+
+	if (synctex && ev_synctex_index_stat (synctex, &mtime, &size)) {
+		data = ev_synctex_index_parse (synctex, n_pages, mtime, size);
+		if (data) {
+			if (ev_synctex_index_can_cache (mtime))
+				ev_synctex_index_write (data, synctex);
+			g_free (synctex);
+
+			ev_synctex_index_set_data (index, data);
+			g_bytes_unref (data);
+
+			return index;
+		}
+	}
+	g_free (synctex);
+
+	scanner = synctex_scanner_new_with_output_file (output, NULL, 1);
+	if (!scanner) {
+		ev_synctex_index_free (index);
+		return NULL;
+	}
+
+	synctex = g_strdup (synctex_scanner_get_synctex (scanner));
+	if (!synctex || !ev_synctex_index_stat (synctex, &mtime, &size))
+		mtime = size = 0;
+
+	data = ev_synctex_index_build (scanner, n_pages, mtime, size);
+	synctex_scanner_free (scanner);
+
+	if (synctex && ev_synctex_index_can_cache (mtime))
+		ev_synctex_index_write (data, synctex);
+	g_free (synctex);
+
+	ev_synctex_index_set_data (index, data);
+	g_bytes_unref (data);
+
+	return index;
+}
+
+#ifdef EV_ENABLE_DEBUG
+static void ev_synctex_index_check (EvSynctexIndex *index);
+#endif
+
+/**
+ * ev_synctex_index_new:
+ * @output: the filename of the typeset document
+ * @n_pages: the number of pages of the document
+ *
+ * Opens the SyncTeX index of @output. The .synctex file is only parsed
+ * when there isn't an index for it in the cache yet or it has changed
+ * since the index was created.
+ *
+ * Returns: a new #EvSynctexIndex, or %NULL if @output has no SyncTeX
+ * information
+ */
+EvSynctexIndex *
+ev_synctex_index_new (const gchar *output,
+		      gint         n_pages)
+{
+	EvSynctexIndex *index;
+
+	index = ev_synctex_index_open (output, n_pages);
+
+#ifdef EV_ENABLE_DEBUG
+	/* EV_DEBUG_SYNCTEX compares the index with the synctex parser */
+	if (index && ev_debug_is_enabled (EV_DEBUG_SYNCTEX))
+		ev_synctex_index_check (index);
+#endif
+
+	return index;
+}
+
+void
+ev_synctex_index_free (EvSynctexIndex *index)
+{
+	if (!index)
+		return;
+
+	if (index->data)
+		g_bytes_unref (index->data);
+	g_free (index->output);
+	g_free (index);
+}
+
+/* Queries */
+static const gchar *
+ev_synctex_index_get_name (EvSynctexIndex *index,
+			   gint            tag)
+{
+	guint i;
+
+	for (i = 0; i < index->header->n_inputs; i++) {
+		if (index->inputs[i].tag == tag)
+			return index->names + index->inputs[i].name_offset;
+	}
+
+	return NULL;
+}
+
+static gint
+ev_synctex_index_find_tag (EvSynctexIndex *index,
+			   const gchar    *name)
+{
+	guint i;
+
+	for (i = 0; i < index->header->n_inputs; i++) {
+		if (_synctex_is_equivalent_file_name (name, index->names + index->inputs[i].name_offset))
+			return index->inputs[i].tag;
+	}
+
+	return 0;
+}
+
+/* Same fallbacks as synctex_scanner_get_tag () */
+static gint
+ev_synctex_index_get_tag (EvSynctexIndex *index,
+			  const gchar    *name)
+{
+	const gchar *relative;
+	const gchar *ptr;
+	gsize        char_index;
+	gint         tag;
+
+	char_index = strlen (name);
+	if (char_index == 0 || G_IS_DIR_SEPARATOR (name[char_index - 1]))
+		return 0;
+
+	if ((tag = ev_synctex_index_find_tag (index, name)))
+		return tag;
+
+	/* Try a name relative to the directory of the output file */
+	relative = name;
+	ptr = index->output;
+	while (*relative && *ptr && *relative == *ptr) {
+		relative++;
+		ptr++;
+	}
+	while (relative > name && !G_IS_DIR_SEPARATOR (*(relative - 1)))
+		relative--;
+	if (relative > name && (tag = ev_synctex_index_find_tag (index, relative)))
+		return tag;
+
+	/* Try each relative path starting from the shortest one */
+	if (G_IS_DIR_SEPARATOR (name[0])) {
+		while (char_index > 0) {
+			char_index--;
+			if (G_IS_DIR_SEPARATOR (name[char_index]) &&
+			    (tag = ev_synctex_index_find_tag (index, name + char_index + 1)))
+				return tag;
+		}
+	}
+
+	return 0;
+}
+
+static gfloat
+distance_to_range (gfloat value,
+		   gfloat start,
+		   gfloat end)
+{
+	if (value < start)
+		return start - value;
+	if (value > end)
+		return value - end;
+	return 0;
+}
+
+/**
+ * ev_synctex_index_backward_search:
+ * @index: an #EvSynctexIndex
+ * @page: the page index
+ * @x: X coordinate
+ * @y: Y coordinate
+ *
+ * Returns: the #EvSourceLink of the position closest to (@x, @y) in
+ * @page, or %NULL
+ */
+EvSourceLink *
+ev_synctex_index_backward_search (EvSynctexIndex *index,
+				  gint            page,
+				  gfloat          x,
+				  gfloat          y)
+{
+	const EvSynctexIndexLine *line = NULL;
+	const EvSynctexIndexNode *node;
+	const gchar              *filename;
+	guint                     first, last;
+	guint                     low, high, i;
+	gfloat                    best_distance = G_MAXFLOAT;
+	gfloat                    best_area = G_MAXFLOAT;
+
+	if (page < 0 || page >= index->header->n_pages)
+		return NULL;
+
+	first = index->pages[page].first_line;
+	last = index->pages[page + 1].first_line;
+	if (first == last)
+		return NULL;
+
+	/* First line whose bottom edge is below y */
+	low = first;
+	high = last;
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+
+		if (index->lines[mid].y2 < y)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	/* Lines containing y can't end further than the tallest line */
+	for (i = low; i < last && index->lines[i].y2 <= y + index->pages[page].max_height; i++) {
+		const EvSynctexIndexLine *candidate = &index->lines[i];
+		gfloat                    distance;
+		gfloat                    area;
+
+		if (candidate->y1 > y)
+			continue;
+
+		/* Prefer lines containing x (distance 0), then the ones
+		 * closest to x, and among those the innermost line */
+		distance = distance_to_range (x, candidate->x1, candidate->x2);
+		area = (candidate->x2 - candidate->x1) * (candidate->y2 - candidate->y1);
+		if (distance < best_distance ||
+		    (distance == best_distance && area < best_area)) {
+			best_distance = distance;
+			best_area = area;
+			line = candidate;
+		}
+	}
+
+	if (!line) {
+		/* Nothing contains y, use the closest line above or below */
+		if (low == last)
+			line = &index->lines[last - 1];
+		else if (low == first)
+			line = &index->lines[first];
+		else if (y - index->lines[low - 1].y2 < index->lines[low].y1 - y)
+			line = &index->lines[low - 1];
+		else
+			line = &index->lines[low];
+	}
+
+	/* Closest node of the line */
+	low = line->first_node;
+	high = line->first_node + line->n_nodes;
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+
+		if (index->nodes[mid].x < x)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low == line->first_node + line->n_nodes)
+		low--;
+	else if (low > line->first_node && x - index->nodes[low - 1].x < index->nodes[low].x - x)
+		low--;
+	node = &index->nodes[low];
+
+	filename = ev_synctex_index_get_name (index, node->tag);
+	if (!filename)
+		return NULL;
+
+	return ev_source_link_new (filename, node->line, node->column);
+}
+
+/**
+ * ev_synctex_index_forward_search:
+ * @index: an #EvSynctexIndex
+ * @link: an #EvSourceLink
+ *
+ * Returns: an #EvMapping with the page number and area of the first
+ * line typeset from @link, or from the closest following line of the
+ * same file. It must be freed with g_free ().
+ */
+EvMapping *
+ev_synctex_index_forward_search (EvSynctexIndex *index,
+				 EvSourceLink   *link)
+{
+	const EvSynctexIndexNode *node;
+	const EvSynctexIndexLine *line;
+	EvMapping                *result;
+	guint                     low, high;
+	gint                      tag;
+
+	tag = ev_synctex_index_get_tag (index, link->filename);
+	if (!tag)
+		return NULL;
+
+	low = 0;
+	high = index->header->n_nodes;
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+
+		node = &index->nodes[index->forward[mid]];
+		if (node->tag < tag || (node->tag == tag && node->line < link->line))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low < index->header->n_nodes && index->nodes[index->forward[low]].tag == tag)
+		node = &index->nodes[index->forward[low]];
+	else if (low > 0 && index->nodes[index->forward[low - 1]].tag == tag)
+		node = &index->nodes[index->forward[low - 1]];
+	else
+		return NULL;
+
+	line = &index->lines[node->line_index];
+
+	result = g_new (EvMapping, 1);
+	result->data = GINT_TO_POINTER (line->page);
+	result->area.x1 = line->x1;
+	result->area.y1 = line->y1;
+	result->area.x2 = line->x2;
+	result->area.y2 = line->y2;
+
+	return result;
+}
+
+#ifdef EV_ENABLE_DEBUG
+/* Parity check: runs the queries every line of the index can answer
+ * through the synctex parser too, which is what evince used before the
+ * index existed, and reports where the answers differ.
+ */
+static gboolean
+ev_synctex_index_check_backward (EvSynctexIndex   *index,
+				 synctex_scanner_t scanner,
+				 gint              page,
+				 gfloat            x,
+				 gfloat            y)
+{
+	EvSourceLink  *link;
+	synctex_node_t node = NULL;
+	const gchar   *filename = NULL;
+	gboolean       equal;
+
+	link = ev_synctex_index_backward_search (index, page, x, y);
+	if (synctex_edit_query (scanner, page + 1, x, y) > 0 &&
+	    (node = synctex_next_result (scanner)))
+		filename = synctex_scanner_get_name (scanner, synctex_node_tag (node));
+
+	if (!link || !filename)
+		equal = !link && !filename;
+	else
+		equal = g_strcmp0 (link->filename, filename) == 0 &&
+			link->line == synctex_node_line (node);
+
+	if (!equal) {
+		ev_debug_message (DEBUG_SYNCTEX,
+				  "backward search at page %d (%.2f, %.2f): index %s:%d, synctex %s:%d",
+				  page, x, y,
+				  link ? link->filename : "none", link ? link->line : 0,
+				  filename ? filename : "none", node ? synctex_node_line (node) : 0);
+	}
+
+	if (link)
+		ev_source_link_free (link);
+
+	return equal;
+}
+
+static gboolean
+ev_synctex_index_check_forward (EvSynctexIndex   *index,
+				synctex_scanner_t scanner,
+				const gchar      *filename,
+				gint              line)
+{
+	EvSourceLink  *link;
+	EvMapping     *mapping;
+	synctex_node_t node = NULL;
+	gint           page = -1;
+	gboolean       equal;
+
+	link = ev_source_link_new (filename, line, -1);
+	mapping = ev_synctex_index_forward_search (index, link);
+	ev_source_link_free (link);
+
+	if (synctex_display_query (scanner, filename, line, -1) > 0 &&
+	    (node = synctex_next_result (scanner)))
+		page = synctex_node_page (node) - 1;
+
+	if (!mapping || !node)
+		equal = !mapping && !node;
+	else
+		equal = GPOINTER_TO_INT (mapping->data) == page;
+
+	if (!equal) {
+		ev_debug_message (DEBUG_SYNCTEX,
+				  "forward search of %s:%d: index page %d, synctex page %d",
+				  filename, line,
+				  mapping ? GPOINTER_TO_INT (mapping->data) : -1, page);
+	}
+
+	g_free (mapping);
+
+	return equal;
+}
+
+static void
+ev_synctex_index_check (EvSynctexIndex *index)
+{
+	const EvSynctexIndexHeader *header = index->header;
+	synctex_scanner_t           scanner;
+	guint                       n_backward = 0, backward_failed = 0;
+	guint                       n_forward = 0, forward_failed = 0;
+	guint                       i;
+
+	scanner = synctex_scanner_new_with_output_file (index->output, NULL, 1);
+	if (!scanner)
+		return;
+
+	/* The center of every line */
+	for (i = 0; i < header->n_pages; i++) {
+		guint j;
+
+		for (j = index->pages[i].first_line; j < index->pages[i + 1].first_line; j++) {
+			const EvSynctexIndexLine *line = &index->lines[j];
+
+			n_backward++;
+			if (!ev_synctex_index_check_backward (index, scanner, i,
+							      (line->x1 + line->x2) / 2,
+							      (line->y1 + line->y2) / 2))
+				backward_failed++;
+		}
+	}
+
+	/* Every source line with some output, once */
+	for (i = 0; i < header->n_nodes; i++) {
+		const EvSynctexIndexNode *node = &index->nodes[index->forward[i]];
+		const gchar              *filename;
+
+		if (i > 0) {
+			const EvSynctexIndexNode *prev = &index->nodes[index->forward[i - 1]];
+
+			if (prev->tag == node->tag && prev->line == node->line)
+				continue;
+		}
+
+		filename = ev_synctex_index_get_name (index, node->tag);
+		if (!filename)
+			continue;
+
+		n_forward++;
+		if (!ev_synctex_index_check_forward (index, scanner, filename, node->line))
+			forward_failed++;
+	}
+
+	synctex_scanner_free (scanner);
+
+	ev_debug_message (DEBUG_SYNCTEX,
+			  "%s: %u of %u backward and %u of %u forward searches differ",
+			  index->output, backward_failed, n_backward,
+			  forward_failed, n_forward);
+}
+#endif /* EV_ENABLE_DEBUG */
@@ -169,23 +169,23 @@ ev_scheduler_thread_job_cancelled (EvSchedulerJob *job,
 	}
 }
 
-static void
+static gboolean
 ev_job_thread (EvJob *job)
 {
 	gboolean result;
 
 	ev_debug_message (DEBUG_JOBS, "%s", EV_GET_TYPE_NAME (job));
 
-	do {
-		if (g_cancellable_is_cancelled (job->cancellable))
-			result = FALSE;
-		else {
-                        g_atomic_pointer_set (&running_job, job);
-			result = ev_job_run (job);
-                }
-	} while (result);
+	if (g_cancellable_is_cancelled (job->cancellable))
+		result = FALSE;
+	else {
+                g_atomic_pointer_set (&running_job, job);
+		result = ev_job_run (job);
+        }
 
         g_atomic_pointer_set (&running_job, NULL);
+
+	return result;
 }
 
 static gboolean
@@ -214,8 +214,15 @@ ev_job_thread_proxy (gpointer data)
 		}
 		g_mutex_unlock (&job_queue_mutex);
 		
-		ev_job_thread (job->job);
-		ev_scheduler_job_destroy (job);
+		/* Jobs that need to run again go back to the end of
+		 * their queue, so that they don't starve the others.
+		 * A job cancelled meanwhile is destroyed when it's
+		 * picked up again.
+		 */
+		if (ev_job_thread (job->job))
+			ev_job_queue_push (job, job->priority);
+		else
+			ev_scheduler_job_destroy (job);
 	}
 
 	return NULL;
@@ -36,11 +36,14 @@
 #include "ev-document-annotations.h"
 #include "ev-document-attachments.h"
 #include "ev-document-text.h"
+#include "ev-selection.h"
 #include "ev-debug.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n-lib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 static void ev_job_init                   (EvJob                 *job);
@@ -69,6 +72,8 @@ static void ev_job_export_init            (EvJobExport           *job);
 static void ev_job_export_class_init      (EvJobExportClass      *class);
 static void ev_job_print_init             (EvJobPrint            *job);
 static void ev_job_print_class_init       (EvJobPrintClass       *class);
+static void ev_job_copy_init              (EvJobCopy             *job);
+static void ev_job_copy_class_init        (EvJobCopyClass        *class);
 
 enum {
 	CANCELLED,
@@ -86,9 +91,15 @@ enum {
 	FIND_LAST_SIGNAL
 };
 
+enum {
+	COPY_UPDATED,
+	COPY_LAST_SIGNAL
+};
+
 static guint job_signals[LAST_SIGNAL] = { 0 };
 static guint job_fonts_signals[FONTS_LAST_SIGNAL] = { 0 };
 static guint job_find_signals[FIND_LAST_SIGNAL] = { 0 };
+static guint job_copy_signals[COPY_LAST_SIGNAL] = { 0 };
 
 G_DEFINE_ABSTRACT_TYPE (EvJob, ev_job, G_TYPE_OBJECT)
 G_DEFINE_TYPE (EvJobLinks, ev_job_links, EV_TYPE_JOB)
@@ -106,6 +117,7 @@ G_DEFINE_TYPE (EvJobFind, ev_job_find, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobLayers, ev_job_layers, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobExport, ev_job_export, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobPrint, ev_job_print, EV_TYPE_JOB)
+G_DEFINE_TYPE (EvJobCopy, ev_job_copy, EV_TYPE_JOB)
 
 /* EvJob */
 static void
@@ -341,18 +353,42 @@ ev_job_links_dispose (GObject *object)
 		job->model = NULL;
 	}
 
+	if (job->page_index) {
+		g_array_free (job->page_index, TRUE);
+		job->page_index = NULL;
+	}
+
 	(* G_OBJECT_CLASS (ev_job_links_parent_class)->dispose) (object);
 }
 
+static void
+page_entry_clear (EvJobLinksPageEntry *entry)
+{
+	gtk_tree_path_free (entry->path);
+}
+
+static gint
+page_entry_compare (const EvJobLinksPageEntry *a,
+		    const EvJobLinksPageEntry *b)
+{
+	if (a->page != b->page)
+		return a->page < b->page ? -1 : 1;
+
+	/* Paths compare in tree order, so the first entry of the
+	 * outline pointing to a page wins */
+	return gtk_tree_path_compare (a->path, b->path);
+}
+
 static gboolean
 fill_page_labels (GtkTreeModel   *tree_model,
 		  GtkTreePath    *path,
 		  GtkTreeIter    *iter,
 		  EvJob          *job)
 {
-	EvDocumentLinks *document_links;
-	EvLink          *link;
-	gchar           *page_label;
+	EvDocumentLinks     *document_links;
+	EvLink              *link;
+	EvJobLinksPageEntry  entry;
+	gchar               *page_label;
 
 	gtk_tree_model_get (tree_model, iter,
 			    EV_DOCUMENT_LINKS_COLUMN_LINK, &link,
@@ -362,7 +398,15 @@ fill_page_labels (GtkTreeModel   *tree_model,
 		return FALSE;
 
 	document_links = EV_DOCUMENT_LINKS (job->document);
+
+	entry.page = ev_document_links_get_link_page (document_links, link);
+	if (entry.page >= 0) {
+		entry.path = gtk_tree_path_copy (path);
+		g_array_append_val (EV_JOB_LINKS (job)->page_index, entry);
+	}
+
 	page_label = ev_document_links_get_link_page_label (document_links, link);
+	g_object_unref (link);
 	if (!page_label)
 		return FALSE;
 
@@ -371,7 +415,6 @@ fill_page_labels (GtkTreeModel   *tree_model,
 			    -1);
 
 	g_free (page_label);
-	g_object_unref (link);
 
 	return FALSE;
 }
@@ -388,7 +431,14 @@ ev_job_links_run (EvJob *job)
 	job_links->model = ev_document_links_get_links_model (EV_DOCUMENT_LINKS (job->document));
 	ev_document_doc_mutex_unlock ();
 
+	/* Resolve the destination page of every outline entry here, so
+	 * that the sidebar can find the entry for the current page by
+	 * binary search without touching the document */
+	job_links->page_index = g_array_new (FALSE, FALSE, sizeof (EvJobLinksPageEntry));
+	g_array_set_clear_func (job_links->page_index, (GDestroyNotify)page_entry_clear);
+
 	gtk_tree_model_foreach (job_links->model, (GtkTreeModelForeachFunc)fill_page_labels, job);
+	g_array_sort (job_links->page_index, (GCompareFunc)page_entry_compare);
 
 	ev_job_succeeded (job);
 	
@@ -736,28 +786,37 @@ ev_job_page_data_run (EvJob *job)
 	ev_document_doc_mutex_lock ();
 	ev_page = ev_document_get_page (job->document, job_pd->page);
 
-	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_MAPPING) && EV_IS_DOCUMENT_TEXT (job->document))
-		job_pd->text_mapping =
-			ev_document_text_get_text_mapping (EV_DOCUMENT_TEXT (job->document), ev_page);
-	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT) && EV_IS_DOCUMENT_TEXT (job->document))
-		job_pd->text =
-			ev_document_text_get_text (EV_DOCUMENT_TEXT (job->document), ev_page);
-	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT) && EV_IS_DOCUMENT_TEXT (job->document))
-		ev_document_text_get_text_layout (EV_DOCUMENT_TEXT (job->document),
-						  ev_page,
-						  &(job_pd->text_layout),
-						  &(job_pd->text_layout_length));
-	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_ATTRS) && EV_IS_DOCUMENT_TEXT (job->document))
-		job_pd ->text_attrs =
-			ev_document_text_get_text_attrs (EV_DOCUMENT_TEXT (job->document),
-							 ev_page);
-        if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_LOG_ATTRS) && job_pd->text) {
-                job_pd->text_log_attrs_length = g_utf8_strlen (job_pd->text, -1);
-                job_pd->text_log_attrs = g_new0 (PangoLogAttr, job_pd->text_log_attrs_length + 1);
-
-                /* FIXME: We need API to get the language of the document */
-                pango_get_log_attrs (job_pd->text, -1, -1, NULL, job_pd->text_log_attrs, job_pd->text_log_attrs_length + 1);
-        }
+	if ((job_pd->flags & (EV_PAGE_DATA_INCLUDE_TEXT |
+			      EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT |
+			      EV_PAGE_DATA_INCLUDE_TEXT_LOG_ATTRS)) &&
+	    EV_IS_DOCUMENT_TEXT (job->document)) {
+		/* The text, its layout and log attrs are shared with the
+		 * other users of the page text, so they are not owned by
+		 * the job but by page_text */
+		job_pd->page_text = ev_page_text_get (job->document, ev_page);
+		if (job_pd->page_text) {
+			if (job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT)
+				job_pd->text = (gchar *)ev_page_text_get_text (job_pd->page_text);
+			if (job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT)
+				job_pd->text_layout = (EvRectangle *)
+					ev_page_text_get_layout (job_pd->page_text,
+								 &(job_pd->text_layout_length));
+			if (job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_LOG_ATTRS)
+				job_pd->text_log_attrs = (PangoLogAttr *)
+					ev_page_text_get_log_attrs (job_pd->page_text,
+								    &(job_pd->text_log_attrs_length));
+		}
+	}
+	if ((job_pd->flags & (EV_PAGE_DATA_INCLUDE_TEXT_MAPPING |
+			      EV_PAGE_DATA_INCLUDE_TEXT_ATTRS)) &&
+	    EV_IS_DOCUMENT_TEXT (job->document)) {
+		ev_document_text_get_page_text (EV_DOCUMENT_TEXT (job->document),
+						ev_page, NULL, NULL, NULL,
+						(job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_MAPPING) ?
+						&(job_pd->text_mapping) : NULL,
+						(job_pd->flags & EV_PAGE_DATA_INCLUDE_TEXT_ATTRS) ?
+						&(job_pd->text_attrs) : NULL);
+	}
 	if ((job_pd->flags & EV_PAGE_DATA_INCLUDE_LINKS) && EV_IS_DOCUMENT_LINKS (job->document))
 		job_pd->link_mapping =
 			ev_document_links_get_links (EV_DOCUMENT_LINKS (job->document), ev_page);
@@ -781,11 +840,29 @@ ev_job_page_data_run (EvJob *job)
 	return FALSE;
 }
 
+static void
+ev_job_page_data_dispose (GObject *object)
+{
+	EvJobPageData *job = EV_JOB_PAGE_DATA (object);
+
+	if (job->page_text) {
+		ev_page_text_unref (job->page_text);
+		job->page_text = NULL;
+		job->text = NULL;
+		job->text_layout = NULL;
+		job->text_log_attrs = NULL;
+	}
+
+	(* G_OBJECT_CLASS (ev_job_page_data_parent_class)->dispose) (object);
+}
+
 static void
 ev_job_page_data_class_init (EvJobPageDataClass *class)
 {
-	EvJobClass *job_class = EV_JOB_CLASS (class);
+	GObjectClass *oclass = G_OBJECT_CLASS (class);
+	EvJobClass   *job_class = EV_JOB_CLASS (class);
 
+	oclass->dispose = ev_job_page_data_dispose;
 	job_class->run = ev_job_page_data_run;
 }
 
@@ -902,10 +979,119 @@ ev_job_thumbnail_set_has_frame (EvJobThumbnail  *job,
 }
 
 /* EvJobFonts */
+#define FONTS_SCAN_PAGES 20
+
+/* Fonts found so far in a document, as name/details string arrays, so
+ * that scanning resumes where a previous job left it and a complete scan
+ * is never repeated. It's only accessed with the doc mutex held.
+ */
+typedef struct {
+	GPtrArray *fonts;
+	gboolean   completed;
+} EvJobFontsCache;
+
+static void
+ev_job_fonts_cache_free (EvJobFontsCache *cache)
+{
+	g_ptr_array_free (cache->fonts, TRUE);
+	g_slice_free (EvJobFontsCache, cache);
+}
+
+static EvJobFontsCache *
+ev_job_fonts_get_cache (EvDocument *document)
+{
+	EvJobFontsCache *cache;
+	static GQuark    cache_key = 0;
+
+	if (!cache_key)
+		cache_key = g_quark_from_static_string ("ev-job-fonts-cache");
+
+	cache = g_object_get_qdata (G_OBJECT (document), cache_key);
+	if (!cache) {
+		cache = g_slice_new0 (EvJobFontsCache);
+		cache->fonts = g_ptr_array_new_with_free_func ((GDestroyNotify) g_strfreev);
+		g_object_set_qdata_full (G_OBJECT (document),
+					 cache_key, cache,
+					 (GDestroyNotify) ev_job_fonts_cache_free);
+	}
+
+	return cache;
+}
+
 static void
 ev_job_fonts_init (EvJobFonts *job)
 {
-	EV_JOB (job)->run_mode = EV_JOB_RUN_MAIN_LOOP;
+	EV_JOB (job)->run_mode = EV_JOB_RUN_THREAD;
+
+	g_mutex_init (&job->mutex);
+}
+
+static void
+ev_job_fonts_dispose (GObject *object)
+{
+	EvJobFonts *job = EV_JOB_FONTS (object);
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	if (job->idle_updated_id > 0) {
+		g_source_remove (job->idle_updated_id);
+		job->idle_updated_id = 0;
+	}
+
+	if (job->batches) {
+		g_list_free_full (job->batches, (GDestroyNotify) g_ptr_array_unref);
+		job->batches = NULL;
+	}
+
+	(* G_OBJECT_CLASS (ev_job_fonts_parent_class)->dispose) (object);
+}
+
+static void
+ev_job_fonts_finalize (GObject *object)
+{
+	EvJobFonts *job = EV_JOB_FONTS (object);
+
+	g_mutex_clear (&job->mutex);
+
+	(* G_OBJECT_CLASS (ev_job_fonts_parent_class)->finalize) (object);
+}
+
+static gboolean
+ev_job_fonts_emit_updated (EvJobFonts *job)
+{
+	gdouble progress;
+
+	g_mutex_lock (&job->mutex);
+	job->idle_updated_id = 0;
+	progress = job->progress;
+	g_mutex_unlock (&job->mutex);
+
+	if (!g_cancellable_is_cancelled (EV_JOB (job)->cancellable))
+		g_signal_emit (job, job_fonts_signals[FONTS_UPDATED], 0, progress);
+
+	return FALSE;
+}
+
+/* Called from the job thread: hand the fonts found in the last chunk
+ * over to the main loop, coalescing updates that arrive faster than
+ * they are consumed.
+ */
+static void
+ev_job_fonts_push_batch (EvJobFonts *job,
+			 GPtrArray  *batch,
+			 gdouble     progress)
+{
+	g_mutex_lock (&job->mutex);
+	job->batches = g_list_append (job->batches, batch);
+	job->progress = progress;
+	if (job->idle_updated_id == 0) {
+		job->idle_updated_id =
+			g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+					 (GSourceFunc)ev_job_fonts_emit_updated,
+					 g_object_ref (job),
+					 (GDestroyNotify)g_object_unref);
+	}
+	g_mutex_unlock (&job->mutex);
 }
 
 static gboolean
@@ -913,15 +1099,14 @@ ev_job_fonts_run (EvJob *job)
 {
 	EvJobFonts      *job_fonts = EV_JOB_FONTS (job);
 	EvDocumentFonts *fonts = EV_DOCUMENT_FONTS (job->document);
+	EvJobFontsCache *cache;
+	GPtrArray       *batch;
+	gdouble          progress;
+	guint            i;
 
 	ev_debug_message (DEBUG_JOBS, NULL);
-	
-	/* Do not block the main loop */
-	if (!ev_document_doc_mutex_trylock ())
-		return TRUE;
-	
-	if (!ev_document_fc_mutex_trylock ())
-		return TRUE;
+
+	ev_document_doc_mutex_lock ();
 
 #ifdef EV_ENABLE_DEBUG
 	/* We use the #ifdef in this case because of the if */
@@ -929,24 +1114,41 @@ ev_job_fonts_run (EvJob *job)
 		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
 #endif
 
-	job_fonts->scan_completed = !ev_document_fonts_scan (fonts, 20);
-	g_signal_emit (job_fonts, job_fonts_signals[FONTS_UPDATED], 0,
-		       ev_document_fonts_get_progress (fonts));
+	cache = ev_job_fonts_get_cache (job->document);
+	if (!cache->completed) {
+		ev_document_fc_mutex_lock ();
+		cache->completed = !ev_document_fonts_scan (fonts, FONTS_SCAN_PAGES);
+		ev_document_fonts_get_fonts (fonts, cache->fonts);
+		ev_document_fc_mutex_unlock ();
+	}
+	job_fonts->scan_completed = cache->completed;
+	progress = ev_document_fonts_get_progress (fonts);
+
+	/* Fonts found by a previous job are sent with the first batch */
+	batch = g_ptr_array_new_with_free_func ((GDestroyNotify) g_strfreev);
+	for (i = job_fonts->n_fonts; i < cache->fonts->len; i++)
+		g_ptr_array_add (batch, g_strdupv (g_ptr_array_index (cache->fonts, i)));
+	job_fonts->n_fonts = cache->fonts->len;
 
-	ev_document_fc_mutex_unlock ();
 	ev_document_doc_mutex_unlock ();
 
+	ev_job_fonts_push_batch (job_fonts, batch, progress);
+
 	if (job_fonts->scan_completed)
 		ev_job_succeeded (job);
-	
+
+	/* The scheduler requeues the job, so other jobs can run between chunks */
 	return !job_fonts->scan_completed;
 }
 
 static void
 ev_job_fonts_class_init (EvJobFontsClass *class)
 {
-	EvJobClass *job_class = EV_JOB_CLASS (class);
-	
+	GObjectClass *oclass = G_OBJECT_CLASS (class);
+	EvJobClass   *job_class = EV_JOB_CLASS (class);
+
+	oclass->dispose = ev_job_fonts_dispose;
+	oclass->finalize = ev_job_fonts_finalize;
 	job_class->run = ev_job_fonts_run;
 	
 	job_fonts_signals[FONTS_UPDATED] =
@@ -974,6 +1176,40 @@ ev_job_fonts_new (EvDocument *document)
 	return EV_JOB (job);
 }
 
+/* Appends the fonts found since the last call to @model. It must be
+ * called from the main thread, usually from the updated signal handler.
+ */
+void
+ev_job_fonts_fill_model (EvJobFonts   *job,
+			 GtkTreeModel *model)
+{
+	GList *batches, *l;
+	guint  i;
+
+	g_return_if_fail (EV_IS_JOB_FONTS (job));
+	g_return_if_fail (GTK_IS_LIST_STORE (model));
+
+	g_mutex_lock (&job->mutex);
+	batches = job->batches;
+	job->batches = NULL;
+	g_mutex_unlock (&job->mutex);
+
+	for (l = batches; l; l = g_list_next (l)) {
+		GPtrArray *batch = l->data;
+
+		for (i = 0; i < batch->len; i++) {
+			gchar **font = g_ptr_array_index (batch, i);
+
+			gtk_list_store_insert_with_values (GTK_LIST_STORE (model), NULL, -1,
+							   EV_DOCUMENT_FONTS_COLUMN_NAME, font[0],
+							   EV_DOCUMENT_FONTS_COLUMN_DETAILS, font[1],
+							   -1);
+		}
+	}
+
+	g_list_free_full (batches, (GDestroyNotify) g_ptr_array_unref);
+}
+
 /* EvJobLoad */
 static void
 ev_job_load_init (EvJobLoad *job)
@@ -1005,11 +1241,14 @@ static gboolean
 ev_job_load_run (EvJob *job)
 {
 	EvJobLoad *job_load = EV_JOB_LOAD (job);
+	GFile     *file;
 	GError    *error = NULL;
 	
 	ev_debug_message (DEBUG_JOBS, "%s", job_load->uri);
 	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
 	
+	file = g_file_new_for_uri (job_load->uri);
+
 	ev_document_fc_mutex_lock ();
 
 	/* This job may already have a document even if the job didn't complete
@@ -1029,15 +1268,31 @@ ev_job_load_run (EvJob *job)
 
 		uncompressed_uri = g_object_get_data (G_OBJECT (job->document),
 						      "uri-uncompressed");
-		ev_document_load (job->document,
-				  uncompressed_uri ? uncompressed_uri : job_load->uri,
-				  &error);
+		if (!g_file_is_native (file)) {
+			ev_document_load_gfile (job->document, file,
+						EV_DOCUMENT_LOAD_FLAG_NONE,
+						job->cancellable,
+						&error);
+		} else {
+			ev_document_load (job->document,
+					  uncompressed_uri ? uncompressed_uri : job_load->uri,
+					  &error);
+		}
+	} else if (!g_file_is_native (file)) {
+		/* Remote documents are read in place when the backend
+		 * supports it, G_IO_ERROR_NOT_SUPPORTED is returned
+		 * otherwise so that a local copy is loaded instead */
+		job->document = ev_document_factory_get_document_for_gfile (file,
+									    EV_DOCUMENT_LOAD_FLAG_NONE,
+									    job->cancellable,
+									    &error);
 	} else {
 		job->document = ev_document_factory_get_document (job_load->uri,
 								  &error);
 	}
 
 	ev_document_fc_mutex_unlock ();
+	g_object_unref (file);
 
 	if (error) {
 		ev_job_failed_from_error (job, error);
@@ -1405,11 +1660,119 @@ ev_job_save_dispose (GObject *object)
 	(* G_OBJECT_CLASS (ev_job_save_parent_class)->dispose) (object);
 }
 
+/* Returns the target file name when the document can be saved in place:
+ * to a temp file next to the target that is then renamed over it */
+static gchar *
+ev_job_save_get_local_filename (EvJobSave *job_save)
+{
+	GFile    *file;
+	gchar    *filename = NULL;
+	GStatBuf  statbuf;
+
+	/* Compressed documents are saved uncompressed and need
+	 * to be compressed again into a temp file anyway */
+	if (g_object_get_data (G_OBJECT (EV_JOB (job_save)->document), "uri-uncompressed"))
+		return NULL;
+
+	file = g_file_new_for_uri (job_save->uri);
+	if (g_file_is_native (file))
+		filename = g_file_get_path (file);
+	g_object_unref (file);
+
+	if (filename && g_file_test (filename, G_FILE_TEST_IS_SYMLINK)) {
+		g_free (filename);
+		filename = NULL;
+	}
+
+	/* Renaming would break hard links, and the temp file can't be
+	 * given somebody else's ownership, so overwrite those instead */
+	if (filename && g_stat (filename, &statbuf) == 0 &&
+	    (statbuf.st_nlink > 1 ||
+	     (statbuf.st_uid != geteuid () && geteuid () != 0))) {
+		g_free (filename);
+		filename = NULL;
+	}
+
+	return filename;
+}
+
+static gboolean
+ev_job_save_to_local_file (EvJobSave   *job_save,
+			   const gchar *filename,
+			   GError     **error)
+{
+	EvJob    *job = EV_JOB (job_save);
+	gchar    *dirname;
+	gchar    *basename;
+	gchar    *tmp_basename;
+	gchar    *tmp_filename;
+	gchar    *tmp_uri;
+	gint      fd;
+	gboolean  retval;
+	GStatBuf  statbuf;
+
+	dirname = g_path_get_dirname (filename);
+	basename = g_path_get_basename (filename);
+	tmp_basename = g_strdup_printf (".%s.XXXXXX", basename);
+	tmp_filename = g_build_filename (dirname, tmp_basename, NULL);
+	g_free (tmp_basename);
+	g_free (basename);
+	g_free (dirname);
+
+	fd = g_mkstemp_full (tmp_filename, O_RDWR, 0666);
+	if (fd == -1) {
+		int errsv = errno;
+
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     _("Failed to create a temporary file: %s"),
+			     g_strerror (errsv));
+		g_free (tmp_filename);
+
+		return FALSE;
+	}
+
+	/* The temp file replaces the target, so it must look the same */
+	if (g_stat (filename, &statbuf) == 0) {
+		fchmod (fd, statbuf.st_mode & 07777);
+		if (fchown (fd, statbuf.st_uid, statbuf.st_gid) == -1)
+			fchown (fd, -1, statbuf.st_gid);
+	}
+	close (fd);
+
+	/* Backends copying their source file do it straight into the
+	 * temp file, and modified documents are written only once */
+	tmp_uri = g_filename_to_uri (tmp_filename, NULL, error);
+	retval = tmp_uri != NULL;
+	if (retval) {
+		ev_document_doc_mutex_lock ();
+		retval = ev_document_save (job->document, tmp_uri, error);
+		ev_document_doc_mutex_unlock ();
+		g_free (tmp_uri);
+	}
+
+	/* Renaming keeps the previous file intact if saving failed, and
+	 * is safe when overwriting the file the document was loaded from */
+	if (retval && g_rename (tmp_filename, filename) == -1) {
+		int errsv = errno;
+
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     "%s", g_strerror (errsv));
+		retval = FALSE;
+	}
+
+	if (!retval)
+		g_unlink (tmp_filename);
+	g_free (tmp_filename);
+
+	return retval;
+}
+
 static gboolean
 ev_job_save_run (EvJob *job)
 {
 	EvJobSave *job_save = EV_JOB_SAVE (job);
 	gint       fd;
+	gchar     *filename;
 	gchar     *tmp_filename = NULL;
 	gchar     *local_uri;
 	GError    *error = NULL;
@@ -1417,6 +1780,25 @@ ev_job_save_run (EvJob *job)
 	ev_debug_message (DEBUG_JOBS, "uri: %s, document_uri: %s", job_save->uri, job_save->document_uri);
 	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
 
+	filename = ev_job_save_get_local_filename (job_save);
+	if (filename) {
+		ev_job_save_to_local_file (job_save, filename, &error);
+		g_free (filename);
+
+		/* Copy the metadata from the original file */
+		if (!error)
+			ev_file_copy_metadata (job_save->document_uri, job_save->uri, &error);
+
+		if (error) {
+			ev_job_failed_from_error (job, error);
+			g_error_free (error);
+		} else {
+			ev_job_succeeded (job);
+		}
+
+		return FALSE;
+	}
+
         fd = ev_mkstemp ("saveacopy.XXXXXX", &tmp_filename, &error);
         if (fd == -1) {
                 ev_job_failed_from_error (job, error);
@@ -1460,6 +1842,10 @@ ev_job_save_run (EvJob *job)
 		if (ext && g_ascii_strcasecmp (ext, ".bz2") == 0)
 			ctype = EV_COMPRESSION_BZIP2;
 
+		ext = g_strrstr (job_save->document_uri, ".xz");
+		if (ext && g_ascii_strcasecmp (ext, ".xz") == 0)
+			ctype = EV_COMPRESSION_LZMA;
+
 		uri_comp = ev_file_compress (local_uri, ctype, &error);
 		g_free (local_uri);
 		g_unlink (tmp_filename);
@@ -1778,6 +2164,11 @@ ev_job_layers_new (EvDocument *document)
 }
 
 /* EvJobExport */
+
+/* Steps other than page numbers queued with ev_job_export_queue_*() */
+#define EXPORT_STEP_BEGIN_PAGE -2
+#define EXPORT_STEP_END_PAGE   -3
+
 static void
 ev_job_export_init (EvJobExport *job)
 {
@@ -1799,38 +2190,88 @@ ev_job_export_dispose (GObject *object)
 		job->rc = NULL;
 	}
 
+	if (job->steps) {
+		g_array_free (job->steps, TRUE);
+		job->steps = NULL;
+	}
+
 	(* G_OBJECT_CLASS (ev_job_export_parent_class)->dispose) (object);
 }
 
+static void
+ev_job_export_do_page (EvJobExport *job_export,
+		       gint         page)
+{
+	EvJob  *job = EV_JOB (job_export);
+	EvPage *ev_page;
+
+	ev_page = ev_document_get_page (job->document, page);
+	if (job_export->rc)
+		ev_render_context_set_page (job_export->rc, ev_page);
+	else
+		job_export->rc = ev_render_context_new (ev_page, 0, 1.0);
+	g_object_unref (ev_page);
+
+	ev_file_exporter_do_page (EV_FILE_EXPORTER (job->document), job_export->rc);
+}
+
 static gboolean
 ev_job_export_run (EvJob *job)
 {
-	EvJobExport *job_export = EV_JOB_EXPORT (job);
-	EvPage      *ev_page;
-
-	g_assert (job_export->page != -1);
+	EvJobExport    *job_export = EV_JOB_EXPORT (job);
+	EvFileExporter *exporter = EV_FILE_EXPORTER (job->document);
+	guint           i;
 
 	ev_debug_message (DEBUG_JOBS, NULL);
 	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
-	
-	ev_document_doc_mutex_lock ();
-	
-	ev_page = ev_document_get_page (job->document, job_export->page);
-	if (job_export->rc) {
-		job->failed = FALSE;
-		job->finished = FALSE;
-		g_clear_error (&job->error);
-		
-		ev_render_context_set_page (job_export->rc, ev_page);
-	} else {
-		job_export->rc = ev_render_context_new (ev_page, 0, 1.0);
+
+	if (job_export->page != -1) {
+		ev_document_doc_mutex_lock ();
+
+		if (job_export->rc) {
+			job->failed = FALSE;
+			job->finished = FALSE;
+			g_clear_error (&job->error);
+		}
+		ev_job_export_do_page (job_export, job_export->page);
+
+		ev_document_doc_mutex_unlock ();
+
+		ev_job_succeeded (job);
+
+		return FALSE;
 	}
-	g_object_unref (ev_page);
-	
-	ev_file_exporter_do_page (EV_FILE_EXPORTER (job->document), job_export->rc);
-	
-	ev_document_doc_mutex_unlock ();
-	
+
+	/* The doc mutex is taken per step rather than for the whole
+	 * batch, so that rendering for the view can go on meanwhile.
+	 * Cancellation is checked with the mutex held: the owner of the
+	 * job ends the exporter once it has cancelled it, and no step
+	 * must run after that */
+	for (i = 0; job_export->steps && i < job_export->steps->len; i++) {
+		gint step = g_array_index (job_export->steps, gint, i);
+
+		ev_document_doc_mutex_lock ();
+
+		if (g_cancellable_is_cancelled (job->cancellable)) {
+			ev_document_doc_mutex_unlock ();
+
+			return FALSE;
+		}
+
+		switch (step) {
+		case EXPORT_STEP_BEGIN_PAGE:
+			ev_file_exporter_begin_page (exporter);
+			break;
+		case EXPORT_STEP_END_PAGE:
+			ev_file_exporter_end_page (exporter);
+			break;
+		default:
+			ev_job_export_do_page (job_export, step);
+		}
+
+		ev_document_doc_mutex_unlock ();
+	}
+
 	ev_job_succeeded (job);
 	
 	return FALSE;
@@ -1866,6 +2307,39 @@ ev_job_export_set_page (EvJobExport *job,
 	job->page = page;
 }
 
+static void
+ev_job_export_queue_step (EvJobExport *job,
+			  gint         step)
+{
+	if (!job->steps)
+		job->steps = g_array_new (FALSE, FALSE, sizeof (gint));
+	g_array_append_val (job->steps, step);
+}
+
+/* A job with queued steps runs all of them in order in a single
+ * trip to the job thread, instead of exporting the page given by
+ * ev_job_export_set_page() */
+void
+ev_job_export_queue_begin_page (EvJobExport *job)
+{
+	ev_job_export_queue_step (job, EXPORT_STEP_BEGIN_PAGE);
+}
+
+void
+ev_job_export_queue_page (EvJobExport *job,
+			  gint         page)
+{
+	g_return_if_fail (page >= 0);
+
+	ev_job_export_queue_step (job, page);
+}
+
+void
+ev_job_export_queue_end_page (EvJobExport *job)
+{
+	ev_job_export_queue_step (job, EXPORT_STEP_END_PAGE);
+}
+
 /* EvJobPrint */
 static void
 ev_job_print_init (EvJobPrint *job)
@@ -1976,3 +2450,205 @@ ev_job_print_set_cairo (EvJobPrint *job,
 		cairo_destroy (job->cr);
 	job->cr = cr ? cairo_reference (cr) : NULL;
 }
+
+/* EvJobCopy */
+typedef struct {
+	gint             page;
+	EvSelectionStyle style;
+	EvRectangle      rect;
+} EvJobCopySelection;
+
+static void
+ev_job_copy_init (EvJobCopy *job)
+{
+	EV_JOB (job)->run_mode = EV_JOB_RUN_THREAD;
+
+	job->selections = g_array_new (FALSE, FALSE, sizeof (EvJobCopySelection));
+	job->buffer = g_string_new (NULL);
+	g_mutex_init (&job->mutex);
+}
+
+static void
+ev_job_copy_dispose (GObject *object)
+{
+	EvJobCopy *job = EV_JOB_COPY (object);
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	if (job->idle_updated_id > 0) {
+		g_source_remove (job->idle_updated_id);
+		job->idle_updated_id = 0;
+	}
+
+	if (job->selections) {
+		g_array_free (job->selections, TRUE);
+		job->selections = NULL;
+	}
+
+	if (job->buffer) {
+		g_string_free (job->buffer, TRUE);
+		job->buffer = NULL;
+	}
+
+	if (job->text) {
+		g_free (job->text);
+		job->text = NULL;
+	}
+
+	(* G_OBJECT_CLASS (ev_job_copy_parent_class)->dispose) (object);
+}
+
+static void
+ev_job_copy_finalize (GObject *object)
+{
+	EvJobCopy *job = EV_JOB_COPY (object);
+
+	g_mutex_clear (&job->mutex);
+
+	(* G_OBJECT_CLASS (ev_job_copy_parent_class)->finalize) (object);
+}
+
+static gboolean
+ev_job_copy_emit_updated (EvJobCopy *job)
+{
+	gdouble progress;
+
+	g_mutex_lock (&job->mutex);
+	job->idle_updated_id = 0;
+	progress = job->progress;
+	g_mutex_unlock (&job->mutex);
+
+	if (!g_cancellable_is_cancelled (EV_JOB (job)->cancellable))
+		g_signal_emit (job, job_copy_signals[COPY_UPDATED], 0, progress);
+
+	return FALSE;
+}
+
+/* Called from the job thread after every page */
+static void
+ev_job_copy_set_progress (EvJobCopy *job,
+			  gdouble    progress)
+{
+	g_mutex_lock (&job->mutex);
+	job->progress = progress;
+	if (job->idle_updated_id == 0) {
+		job->idle_updated_id =
+			g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+					 (GSourceFunc)ev_job_copy_emit_updated,
+					 g_object_ref (job),
+					 (GDestroyNotify)g_object_unref);
+	}
+	g_mutex_unlock (&job->mutex);
+}
+
+static gboolean
+ev_job_copy_run (EvJob *job)
+{
+	EvJobCopy *job_copy = EV_JOB_COPY (job);
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+#ifdef EV_ENABLE_DEBUG
+	/* We use the #ifdef in this case because of the if */
+	if (job_copy->current == 0)
+		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+#endif
+
+	if (job_copy->current < job_copy->selections->len) {
+		EvJobCopySelection *selection;
+		EvPage             *page;
+		gchar              *text;
+
+		selection = &g_array_index (job_copy->selections, EvJobCopySelection,
+					    job_copy->current);
+
+		ev_document_doc_mutex_lock ();
+		page = ev_document_get_page (job->document, selection->page);
+		text = ev_selection_get_selected_text (EV_SELECTION (job->document),
+						       page, selection->style,
+						       &selection->rect);
+		g_object_unref (page);
+		ev_document_doc_mutex_unlock ();
+
+		if (text) {
+			g_string_append (job_copy->buffer, text);
+			g_free (text);
+		}
+
+		/* One page per run, the scheduler requeues the job so
+		 * that rendering isn't blocked while copying */
+		if (++job_copy->current < job_copy->selections->len) {
+			ev_job_copy_set_progress (job_copy,
+						  (gdouble)job_copy->current / job_copy->selections->len);
+			return TRUE;
+		}
+	}
+
+	job_copy->text = g_utf8_normalize (job_copy->buffer->str,
+					   job_copy->buffer->len,
+					   G_NORMALIZE_NFKC);
+	g_string_free (job_copy->buffer, TRUE);
+	job_copy->buffer = NULL;
+
+	ev_job_succeeded (job);
+
+	return FALSE;
+}
+
+static void
+ev_job_copy_class_init (EvJobCopyClass *class)
+{
+	GObjectClass *oclass = G_OBJECT_CLASS (class);
+	EvJobClass   *job_class = EV_JOB_CLASS (class);
+
+	oclass->dispose = ev_job_copy_dispose;
+	oclass->finalize = ev_job_copy_finalize;
+	job_class->run = ev_job_copy_run;
+
+	job_copy_signals[COPY_UPDATED] =
+		g_signal_new ("updated",
+			      EV_TYPE_JOB_COPY,
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (EvJobCopyClass, updated),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__DOUBLE,
+			      G_TYPE_NONE,
+			      1, G_TYPE_DOUBLE);
+}
+
+EvJob *
+ev_job_copy_new (EvDocument *document)
+{
+	EvJob *job;
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	job = g_object_new (EV_TYPE_JOB_COPY, NULL);
+	job->document = g_object_ref (document);
+
+	return job;
+}
+
+void
+ev_job_copy_add_selection (EvJobCopy       *job,
+			   gint             page,
+			   EvSelectionStyle style,
+			   EvRectangle     *rect)
+{
+	EvJobCopySelection selection;
+
+	g_return_if_fail (EV_IS_JOB_COPY (job));
+
+	selection.page = page;
+	selection.style = style;
+	selection.rect = *rect;
+	g_array_append_val (job->selections, selection);
+}
+
+const gchar *
+ev_job_copy_get_text (EvJobCopy *job)
+{
+	g_return_val_if_fail (EV_IS_JOB_COPY (job), NULL);
+
+	return job->text;
+}
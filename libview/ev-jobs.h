@@ -81,6 +81,9 @@ typedef struct _EvJobExportClass EvJobExportClass;
 typedef struct _EvJobPrint EvJobPrint;
 typedef struct _EvJobPrintClass EvJobPrintClass;
 
+typedef struct _EvJobCopy EvJobCopy;
+typedef struct _EvJobCopyClass EvJobCopyClass;
+
 #define EV_TYPE_JOB		     	     (ev_job_get_type())
 #define EV_JOB(object)		             (G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_JOB, EvJob))
 #define EV_JOB_CLASS(klass)	             (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB, EvJobClass))
@@ -162,6 +165,11 @@ typedef struct _EvJobPrintClass EvJobPrintClass;
 #define EV_JOB_PRINT_CLASS(klass)            (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_PRINT, EvJobPrintClass))
 #define EV_IS_JOB_PRINT(object)              (G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_JOB_PRINT))
 
+#define EV_TYPE_JOB_COPY                     (ev_job_copy_get_type())
+#define EV_JOB_COPY(object)                  (G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_JOB_COPY, EvJobCopy))
+#define EV_JOB_COPY_CLASS(klass)             (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_COPY, EvJobCopyClass))
+#define EV_IS_JOB_COPY(object)               (G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_JOB_COPY))
+
 typedef enum {
 	EV_JOB_RUN_THREAD,
 	EV_JOB_RUN_MAIN_LOOP
@@ -197,11 +205,17 @@ struct _EvJobClass
 	void     (* finished)   (EvJob *job);
 };
 
+typedef struct {
+	gint         page;
+	GtkTreePath *path;
+} EvJobLinksPageEntry;
+
 struct _EvJobLinks
 {
 	EvJob parent;
 
 	GtkTreeModel *model;
+	GArray       *page_index; /* EvJobLinksPageEntry sorted by page */
 };
 
 struct _EvJobLinksClass
@@ -286,6 +300,7 @@ struct _EvJobPageData
 	EvMappingList  *form_field_mapping;
 	EvMappingList  *annot_mapping;
 	cairo_region_t *text_mapping;
+	EvPageText *page_text;
 	gchar *text;
 	EvRectangle *text_layout;
 	guint text_layout_length;
@@ -320,6 +335,12 @@ struct _EvJobFonts
 {
 	EvJob parent;
 	gboolean scan_completed;
+	gint n_fonts;
+
+	GMutex mutex;
+	GList *batches; /* GPtrArray of name/details string arrays */
+	gdouble progress;
+	guint idle_updated_id;
 };
 
 struct _EvJobFontsClass
@@ -426,6 +447,7 @@ struct _EvJobExport
 
 	gint page;
 	EvRenderContext *rc;
+	GArray *steps;
 };
 
 struct _EvJobExportClass
@@ -446,6 +468,29 @@ struct _EvJobPrintClass
 	EvJobClass parent_class;
 };
 
+struct _EvJobCopy
+{
+	EvJob parent;
+
+	GArray *selections;
+	guint current;
+	GString *buffer;
+	gchar *text;
+
+	GMutex mutex;
+	gdouble progress;
+	guint idle_updated_id;
+};
+
+struct _EvJobCopyClass
+{
+	EvJobClass parent_class;
+
+	/* Signals */
+	void (* updated) (EvJobCopy *job,
+			  gdouble    progress);
+};
+
 /* Base job class */
 GType           ev_job_get_type           (void) G_GNUC_CONST;
 gboolean        ev_job_run                (EvJob          *job);
@@ -507,6 +552,8 @@ void            ev_job_thumbnail_set_has_frame (EvJobThumbnail  *job,
 /* EvJobFonts */
 GType 		ev_job_fonts_get_type 	  (void) G_GNUC_CONST;
 EvJob 	       *ev_job_fonts_new 	  (EvDocument      *document);
+void            ev_job_fonts_fill_model   (EvJobFonts      *job,
+					   GtkTreeModel    *model);
 
 /* EvJobLoad */
 GType 		ev_job_load_get_type 	  (void) G_GNUC_CONST;
@@ -568,6 +615,10 @@ GType           ev_job_export_get_type    (void) G_GNUC_CONST;
 EvJob          *ev_job_export_new         (EvDocument     *document);
 void            ev_job_export_set_page    (EvJobExport    *job,
 					   gint            page);
+void            ev_job_export_queue_begin_page (EvJobExport *job);
+void            ev_job_export_queue_page       (EvJobExport *job,
+						gint         page);
+void            ev_job_export_queue_end_page   (EvJobExport *job);
 /* EvJobPrint */
 GType           ev_job_print_get_type    (void) G_GNUC_CONST;
 EvJob          *ev_job_print_new         (EvDocument     *document);
@@ -576,6 +627,15 @@ void            ev_job_print_set_page    (EvJobPrint     *job,
 void            ev_job_print_set_cairo   (EvJobPrint     *job,
 					  cairo_t        *cr);
 
+/* EvJobCopy */
+GType           ev_job_copy_get_type      (void) G_GNUC_CONST;
+EvJob          *ev_job_copy_new           (EvDocument      *document);
+void            ev_job_copy_add_selection (EvJobCopy       *job,
+					   gint             page,
+					   EvSelectionStyle style,
+					   EvRectangle     *rect);
+const gchar    *ev_job_copy_get_text      (EvJobCopy       *job);
+
 G_END_DECLS
 
 #endif /* __EV_JOBS_H__ */
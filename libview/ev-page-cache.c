@@ -42,6 +42,7 @@ typedef struct _EvPageCacheData {
 	EvMappingList     *form_field_mapping;
 	EvMappingList     *annot_mapping;
 	cairo_region_t    *text_mapping;
+	EvPageText        *page_text;
 	EvRectangle       *text_layout;
 	guint              text_layout_length;
 	gchar             *text;
@@ -77,6 +78,13 @@ struct _EvPageCacheClass {
 
 #define PRE_CACHE_SIZE 1
 
+enum {
+	PAGE_CACHED,
+	N_SIGNALS
+};
+
+static guint signals[N_SIGNALS] = { 0 };
+
 static void job_page_data_finished_cb (EvJob       *job,
 				       EvPageCache *cache);
 static void job_page_data_cancelled_cb (EvJob       *job,
@@ -117,15 +125,15 @@ ev_page_cache_data_free (EvPageCacheData *data)
 		data->text_mapping = NULL;
 	}
 
-	if (data->text_layout) {
-		g_free (data->text_layout);
+	/* The text, its layout and log attrs belong to page_text */
+	if (data->page_text) {
+		ev_page_text_unref (data->page_text);
+		data->page_text = NULL;
+		data->text = NULL;
 		data->text_layout = NULL;
 		data->text_layout_length = 0;
-	}
-
-	if (data->text) {
-		g_free (data->text);
-		data->text = NULL;
+		data->text_log_attrs = NULL;
+		data->text_log_attrs_length = 0;
 	}
 
 	if (data->text_attrs) {
@@ -133,11 +141,6 @@ ev_page_cache_data_free (EvPageCacheData *data)
 		data->text_attrs = NULL;
 	}
 
-        if (data->text_log_attrs) {
-                g_free (data->text_log_attrs);
-                data->text_log_attrs = NULL;
-                data->text_log_attrs_length = 0;
-        }
 }
 
 static void
@@ -187,6 +190,16 @@ ev_page_cache_class_init (EvPageCacheClass *klass)
 	GObjectClass *g_object_class = G_OBJECT_CLASS (klass);
 
 	g_object_class->finalize = ev_page_cache_finalize;
+
+	signals[PAGE_CACHED] =
+		g_signal_new ("page-cached",
+			      G_OBJECT_CLASS_TYPE (g_object_class),
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__INT,
+			      G_TYPE_NONE, 1,
+			      G_TYPE_INT);
 }
 
 static EvJobPageDataFlags
@@ -291,6 +304,14 @@ job_page_data_finished_cb (EvJob       *job,
 		data->annot_mapping = job_data->annot_mapping;
 	if (job_data->flags & EV_PAGE_DATA_INCLUDE_TEXT_MAPPING)
 		data->text_mapping = job_data->text_mapping;
+	if (job_data->page_text) {
+		/* While the cache holds the page text the job gets the same
+		 * one, so the text fetched earlier stays valid */
+		ev_page_text_ref (job_data->page_text);
+		if (data->page_text)
+			ev_page_text_unref (data->page_text);
+		data->page_text = job_data->page_text;
+	}
 	if (job_data->flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT) {
 		data->text_layout = job_data->text_layout;
 		data->text_layout_length = job_data->text_layout_length;
@@ -309,6 +330,8 @@ job_page_data_finished_cb (EvJob       *job,
 
 	g_object_unref (data->job);
 	data->job = NULL;
+
+	g_signal_emit (cache, signals[PAGE_CACHED], 0, job_data->page);
 }
 
 static void
@@ -26,6 +26,9 @@
 #endif
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "ev-jobs.h"
@@ -371,14 +374,28 @@ typedef struct _EvPrintOperationExportClass EvPrintOperationExportClass;
 static GType    ev_print_operation_export_get_type (void) G_GNUC_CONST;
 
 static void     ev_print_operation_export_begin    (EvPrintOperationExport *export);
-static gboolean export_print_page                  (EvPrintOperationExport *export);
+static gboolean export_print_fill_pipeline         (EvPrintOperationExport *export);
 static void     export_cancel                      (EvPrintOperationExport *export);
+static void     export_job_finished                (EvJobExport            *job,
+						    EvPrintOperationExport *export);
+static void     export_job_cancelled               (EvJobExport            *job,
+						    EvPrintOperationExport *export);
+
+/* Pages planned into each export job, and how many jobs may be
+ * queued in the scheduler so that the job thread never waits for
+ * the main loop between pages */
+#define EXPORT_JOB_PAGES 8
+#define EXPORT_MAX_JOBS  2
 
 struct _EvPrintOperationExport {
 	EvPrintOperation parent;
 
 	GtkWindow *parent_window;
 	EvJob *job_export;
+	GList *export_jobs;
+	gint job_pages;
+	gboolean planned;
+	gboolean exporting;
 	GError *error;
 
 	gboolean print_preview;
@@ -394,6 +411,7 @@ struct _EvPrintOperationExport {
 	gint pages_per_sheet;
 	gint fd;
 	gchar *temp_file;
+	gchar *output_file;
 	gchar *job_name;
 	gboolean embed_page_setup;
 
@@ -721,9 +739,6 @@ export_print_inc_page (EvPrintOperationExport *export)
 				if (export->pages_per_sheet > 1 && export->collate == 1 &&
 				    (export->page_count - 1) % export->pages_per_sheet != 0) {
 
-					EvPrintOperation *op = EV_PRINT_OPERATION (export);
-					ev_document_doc_mutex_lock ();
-
 					/* keep track of all blanks but only actualise those
 					 * which are in the current odd / even sheet set */
 
@@ -731,9 +746,8 @@ export_print_inc_page (EvPrintOperationExport *export)
 					if (export->page_set == GTK_PAGE_SET_ALL ||
 						(export->page_set == GTK_PAGE_SET_EVEN && export->sheet % 2 == 0) ||
 						(export->page_set == GTK_PAGE_SET_ODD && export->sheet % 2 == 1) ) {
-						ev_file_exporter_end_page (EV_FILE_EXPORTER (op->document));
+						ev_job_export_queue_end_page (EV_JOB_EXPORT (export->job_export));
 					}
-					ev_document_doc_mutex_unlock ();
 					export->sheet = 1 + (export->page_count - 1) / export->pages_per_sheet;
 				}
 
@@ -814,6 +828,38 @@ export_print_done (EvPrintOperationExport *export)
 	GError *error = NULL;
 
 	g_assert (export->temp_file != NULL);
+
+	if (export->output_file) {
+		/* The document was exported next to the output file, so
+		 * there's nothing left to send to the printer, just move
+		 * the file in place of the output */
+		if (g_rename (export->temp_file, export->output_file) == -1) {
+			gint   errsv = errno;
+			gchar *display_name;
+
+			display_name = g_filename_display_name (export->output_file);
+			g_set_error (&export->error,
+				     GTK_PRINT_ERROR,
+				     GTK_PRINT_ERROR_GENERAL,
+				     _("Failed to create file “%s”: %s"),
+				     display_name, g_strerror (errsv));
+			g_free (display_name);
+
+			ev_print_operation_export_clear_temp_file (export);
+			g_signal_emit (op, signals[DONE], 0, GTK_PRINT_OPERATION_RESULT_ERROR);
+		} else {
+			g_free (export->temp_file);
+			export->temp_file = NULL;
+			g_signal_emit (op, signals[DONE], 0, GTK_PRINT_OPERATION_RESULT_APPLY);
+		}
+
+		g_free (export->output_file);
+		export->output_file = NULL;
+
+		ev_print_operation_export_run_next (export);
+
+		return;
+	}
 	
 	/* Some printers take into account some print settings,
 	 * and others don't. However we have exported the document
@@ -943,28 +989,102 @@ export_print_page_idle_finished (EvPrintOperationExport *export)
 	export->idle_id = 0;
 }
 
+static void
+export_job_free (EvJob                  *job,
+		 EvPrintOperationExport *export)
+{
+	g_signal_handlers_disconnect_by_func (job,
+					      export_job_finished,
+					      export);
+	g_signal_handlers_disconnect_by_func (job,
+					      export_job_cancelled,
+					      export);
+	if (!ev_job_is_finished (job))
+		ev_job_cancel (job);
+	g_object_unref (job);
+}
+
+/* Begin and end are called on the main thread, the export jobs only
+ * render pages in between. Jobs check for cancellation with the doc
+ * mutex held, so once they are cancelled none of them touches the
+ * exporter after this */
+static void
+export_end (EvPrintOperationExport *export)
+{
+	EvPrintOperation *op = EV_PRINT_OPERATION (export);
+
+	if (!export->exporting)
+		return;
+
+	ev_document_doc_mutex_lock ();
+	ev_file_exporter_end (EV_FILE_EXPORTER (op->document));
+	ev_document_doc_mutex_unlock ();
+
+	export->exporting = FALSE;
+}
+
+static void
+export_clear_jobs (EvPrintOperationExport *export)
+{
+	if (export->job_export) {
+		g_object_unref (export->job_export);
+		export->job_export = NULL;
+	}
+
+	while (export->export_jobs) {
+		EvJob *job = export->export_jobs->data;
+
+		export->export_jobs = g_list_delete_link (export->export_jobs,
+							  export->export_jobs);
+		export_job_free (job, export);
+	}
+
+	export_end (export);
+}
+
+static void
+export_print_finished (EvPrintOperationExport *export)
+{
+	export_end (export);
+
+	close (export->fd);
+	export->fd = -1;
+
+	export_print_done (export);
+}
+
 static void
 export_job_finished (EvJobExport            *job,
 		     EvPrintOperationExport *export)
 {
 	EvPrintOperation *op = EV_PRINT_OPERATION (export);
+	gint              total;
 
-	if (export->pages_per_sheet == 1 ||
-	   ( export->page_count % export->pages_per_sheet == 0 &&
-	   ( export->page_set == GTK_PAGE_SET_ALL ||
-	   ( export->page_set == GTK_PAGE_SET_EVEN && export->sheet % 2 == 0 ) ||
-	   ( export->page_set == GTK_PAGE_SET_ODD && export->sheet % 2 == 1 ) ) ) ) {
+	/* Jobs run in the order they were pushed, so this is always
+	 * the first one of the list and every page planned before
+	 * it was pushed has been exported */
+	total = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (job), "total"));
+	ev_print_operation_update_status (op, total,
+					  export->n_pages_to_print,
+					  total / (gdouble)export->n_pages_to_print);
+
+	export->export_jobs = g_list_remove (export->export_jobs, job);
+	export_job_free (EV_JOB (job), export);
 
-		ev_document_doc_mutex_lock ();
-		ev_file_exporter_end_page (EV_FILE_EXPORTER (op->document));
-		ev_document_doc_mutex_unlock ();
+	if (export->planned) {
+		if (!export->export_jobs)
+			export_print_finished (export);
+
+		return;
 	}
 
 	/* Reschedule */
-	export->idle_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
-					   (GSourceFunc)export_print_page,
-					   export,
-					   (GDestroyNotify)export_print_page_idle_finished);
+	if (export->idle_id == 0) {
+		export->idle_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+						   (GSourceFunc)export_print_fill_pipeline,
+						   export,
+						   (GDestroyNotify)export_print_page_idle_finished);
+	}
 }
 
 static void
@@ -983,16 +1103,7 @@ export_cancel (EvPrintOperationExport *export)
 		g_source_remove (export->idle_id);
 	export->idle_id = 0;
 
-	if (export->job_export) {
-		g_signal_handlers_disconnect_by_func (export->job_export,
-						      export_job_finished,
-						      export);
-		g_signal_handlers_disconnect_by_func (export->job_export,
-						      export_job_cancelled,
-						      export);
-		g_object_unref (export->job_export);
-		export->job_export = NULL;
-	}
+	export_clear_jobs (export);
 	
 	if (export->fd != -1) {
 		close (export->fd);
@@ -1006,23 +1117,15 @@ export_cancel (EvPrintOperationExport *export)
 	ev_print_operation_export_run_next (export);
 }
 
-static void
-update_progress (EvPrintOperationExport *export)
-{
-	EvPrintOperation *op = EV_PRINT_OPERATION (export);
-
-	ev_print_operation_update_status (op, export->total,
-					  export->n_pages_to_print,
-					  export->total / (gdouble)export->n_pages_to_print);
-}
-
 static gboolean
 export_print_page (EvPrintOperationExport *export)
 {
 	EvPrintOperation *op = EV_PRINT_OPERATION (export);
+	EvJobExport      *job;
 
-	if (!export->temp_file)
-		return FALSE; /* cancelled */
+	if (!export->job_export)
+		export->job_export = ev_job_export_new (op->document);
+	job = EV_JOB_EXPORT (export->job_export);
 
 	export->total++;
 	export->collated++;
@@ -1035,18 +1138,8 @@ export_print_page (EvPrintOperationExport *export)
 
 	if (export->collated == export->collated_copies) {
 		export->collated = 0;
-		if (!export_print_inc_page (export)) {
-			ev_document_doc_mutex_lock ();
-			ev_file_exporter_end (EV_FILE_EXPORTER (op->document));
-			ev_document_doc_mutex_unlock ();
-
-			close (export->fd);
-			export->fd = -1;
-			update_progress (export);
-			export_print_done (export);
-
+		if (!export_print_inc_page (export))
 			return FALSE;
-		}
 	}
 
 	/* we're not collating and we've reached a sheet from the wrong sheet set */
@@ -1062,19 +1155,8 @@ export_print_page (EvPrintOperationExport *export)
 			if (export->collated == export->collated_copies) {
 				export->collated = 0;
 
-				if (!export_print_inc_page (export)) {
-					ev_document_doc_mutex_lock ();
-					ev_file_exporter_end (EV_FILE_EXPORTER (op->document));
-					ev_document_doc_mutex_unlock ();
-
-					close (export->fd);
-					export->fd = -1;
-
-					update_progress (export);
-
-					export_print_done (export);
+				if (!export_print_inc_page (export))
 					return FALSE;
-				}
 			}
 
 		} while ((export->page_set == GTK_PAGE_SET_EVEN && export->sheet % 2 != 0) ||
@@ -1087,26 +1169,64 @@ export_print_page (EvPrintOperationExport *export)
 	    (export->page_set == GTK_PAGE_SET_ALL ||
 	    (export->page_set == GTK_PAGE_SET_EVEN && export->sheet % 2 == 0) ||
 	    (export->page_set == GTK_PAGE_SET_ODD && export->sheet % 2 == 1)))) {
-		ev_document_doc_mutex_lock ();
-		ev_file_exporter_begin_page (EV_FILE_EXPORTER (op->document));
-		ev_document_doc_mutex_unlock ();
+		ev_job_export_queue_begin_page (job);
 	}
 
-	if (!export->job_export) {
-		export->job_export = ev_job_export_new (op->document);
-		g_signal_connect (export->job_export, "finished",
-				  G_CALLBACK (export_job_finished),
-				  (gpointer)export);
-		g_signal_connect (export->job_export, "cancelled",
-				  G_CALLBACK (export_job_cancelled),
-				  (gpointer)export);
+	ev_job_export_queue_page (job, export->page);
+	export->job_pages++;
+
+	if (export->pages_per_sheet == 1 ||
+	   ( export->page_count % export->pages_per_sheet == 0 &&
+	   ( export->page_set == GTK_PAGE_SET_ALL ||
+	   ( export->page_set == GTK_PAGE_SET_EVEN && export->sheet % 2 == 0 ) ||
+	   ( export->page_set == GTK_PAGE_SET_ODD && export->sheet % 2 == 1 ) ) ) ) {
+		ev_job_export_queue_end_page (job);
 	}
 
-	ev_job_export_set_page (EV_JOB_EXPORT (export->job_export), export->page);
-	ev_job_scheduler_push_job (export->job_export, EV_JOB_PRIORITY_NONE);
+	return TRUE;
+}
+
+static void
+export_push_job (EvPrintOperationExport *export)
+{
+	EvJob *job = export->job_export;
+
+	export->job_export = NULL;
+	export->job_pages = 0;
+
+	/* Pages planned so far, reported as exported when it finishes */
+	g_object_set_data (G_OBJECT (job), "total", GINT_TO_POINTER (export->total));
+
+	g_signal_connect (job, "finished",
+			  G_CALLBACK (export_job_finished),
+			  (gpointer)export);
+	g_signal_connect (job, "cancelled",
+			  G_CALLBACK (export_job_cancelled),
+			  (gpointer)export);
+	export->export_jobs = g_list_append (export->export_jobs, job);
+
+	ev_job_scheduler_push_job (job, EV_JOB_PRIORITY_NONE);
+}
+
+/* Plans the exporter calls for the next pages on the main thread,
+ * keeping the bounded queue of export jobs full. The scheduler runs
+ * jobs of the same priority in order, so the output is written in
+ * the planned order */
+static gboolean
+export_print_fill_pipeline (EvPrintOperationExport *export)
+{
+	if (!export->temp_file)
+		return FALSE; /* cancelled */
+
+	while (!export->planned &&
+	       g_list_length (export->export_jobs) < EXPORT_MAX_JOBS) {
+		do {
+			export->planned = !export_print_page (export);
+		} while (!export->planned && export->job_pages < EXPORT_JOB_PAGES);
+
+		export_push_job (export);
+	}
 
-	update_progress (export);
-	
 	return FALSE;
 }
 
@@ -1121,13 +1241,42 @@ ev_print_operation_export_begin (EvPrintOperationExport *export)
 	ev_document_doc_mutex_lock ();
 	ev_file_exporter_begin (EV_FILE_EXPORTER (op->document), &export->fc);
 	ev_document_doc_mutex_unlock ();
+	export->exporting = TRUE;
 
 	export->idle_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
-					   (GSourceFunc)export_print_page,
+					   (GSourceFunc)export_print_fill_pipeline,
 					   export,
 					   (GDestroyNotify)export_print_page_idle_finished);	
 }
 
+/* When printing to a local file in a format we export to, the file print
+ * backend would only copy our temp file to the output, so export to a
+ * temp file next to the output and rename it when the export is done */
+static gchar *
+ev_print_operation_export_get_output_filename (EvPrintOperationExport *export,
+					       const gchar            *file_format)
+{
+	const gchar *uri;
+
+	if (export->print_preview || !file_format)
+		return NULL;
+
+	if (g_ascii_strcasecmp (file_format, "pdf") != 0 &&
+	    g_ascii_strcasecmp (file_format, "ps") != 0)
+		return NULL;
+
+	/* Only the print to file printer is virtual and has an output URI */
+	if (!gtk_printer_is_virtual (export->printer))
+		return NULL;
+
+	uri = gtk_print_settings_get (export->print_settings, GTK_PRINT_SETTINGS_OUTPUT_URI);
+	if (!uri)
+		return NULL;
+
+	/* NULL for non local URIs, those still go through the backend */
+	return g_filename_from_uri (uri, NULL, NULL);
+}
+
 static void
 ev_print_operation_export_print_dialog_response_cb (GtkDialog              *dialog,
 						    gint                    response,
@@ -1144,6 +1293,7 @@ ev_print_operation_export_print_dialog_response_cb (GtkDialog              *dial
 	gint              last_page;
 	const gchar      *file_format;
 	gchar            *filename;
+	gchar            *output_filename;
 	GError           *error = NULL;
 	EvPrintOperation *op = EV_PRINT_OPERATION (export);
 	
@@ -1180,9 +1330,43 @@ ev_print_operation_export_print_dialog_response_cb (GtkDialog              *dial
 
 	file_format = gtk_print_settings_get (print_settings, GTK_PRINT_SETTINGS_OUTPUT_FILE_FORMAT);
 	
-	filename = g_strdup_printf ("evince_print.%s.XXXXXX", file_format != NULL ? file_format : "");
-	export->fd = g_file_open_tmp (filename, &export->temp_file, &error);
-	g_free (filename);
+	output_filename = ev_print_operation_export_get_output_filename (export, file_format);
+	if (output_filename) {
+		gchar *dirname;
+
+		/* The output file is left untouched until the export is done */
+		dirname = g_path_get_dirname (output_filename);
+		filename = g_build_filename (dirname, ".evince_print.XXXXXX", NULL);
+		g_free (dirname);
+
+		export->fd = g_mkstemp_full (filename, O_RDWR, 0666);
+		if (export->fd == -1) {
+			gint   errsv = errno;
+			gchar *display_name;
+
+			display_name = g_filename_display_name (output_filename);
+			g_set_error (&error, G_FILE_ERROR,
+				     g_file_error_from_errno (errsv),
+				     _("Failed to create file “%s”: %s"),
+				     display_name, g_strerror (errsv));
+			g_free (display_name);
+			g_free (output_filename);
+			g_free (filename);
+		} else {
+			struct stat st;
+
+			/* Keep the permissions of the file being replaced */
+			if (g_stat (output_filename, &st) == 0)
+				fchmod (export->fd, st.st_mode & 07777);
+
+			export->temp_file = filename;
+			export->output_file = output_filename;
+		}
+	} else {
+		filename = g_strdup_printf ("evince_print.%s.XXXXXX", file_format != NULL ? file_format : "");
+		export->fd = g_file_open_tmp (filename, &export->temp_file, &error);
+		g_free (filename);
+	}
 	if (export->fd <= -1) {
 		gtk_widget_destroy (GTK_WIDGET (dialog));
 		
@@ -1352,12 +1536,7 @@ ev_print_operation_export_cancel (EvPrintOperation *op)
 {
 	EvPrintOperationExport *export = EV_PRINT_OPERATION_EXPORT (op);
 
-	if (export->job_export &&
-	    !ev_job_is_finished (export->job_export)) {
-		ev_job_cancel (export->job_export);
-	} else {
-		export_cancel (export);
-	}
+	export_cancel (export);
 }
 
 static void
@@ -1414,23 +1593,17 @@ ev_print_operation_export_finalize (GObject *object)
 		export->temp_file = NULL;
 	}
 
+	if (export->output_file) {
+		g_free (export->output_file);
+		export->output_file = NULL;
+	}
+
 	if (export->job_name) {
 		g_free (export->job_name);
 		export->job_name = NULL;
 	}
 
-	if (export->job_export) {
-		if (!ev_job_is_finished (export->job_export))
-			ev_job_cancel (export->job_export);
-		g_signal_handlers_disconnect_by_func (export->job_export,
-						      export_job_finished,
-						      export);
-		g_signal_handlers_disconnect_by_func (export->job_export,
-						      export_job_cancelled,
-						      export);
-		g_object_unref (export->job_export);
-		export->job_export = NULL;
-	}
+	export_clear_jobs (export);
 
 	if (export->error) {
 		g_error_free (export->error);
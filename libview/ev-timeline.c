@@ -21,7 +21,7 @@
 
 #include <glib.h>
 #include <math.h>
-#include <gdk/gdk.h>
+#include <gtk/gtk.h>
 #include "ev-timeline.h"
 
 #define EV_TIMELINE_GET_PRIV(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), EV_TYPE_TIMELINE, EvTimelinePriv))
@@ -36,6 +36,10 @@ struct EvTimelinePriv {
 	guint fps;
 	guint source_id;
 
+	/* When a widget is set frames follow its frame clock */
+	GtkWidget *widget;
+	guint      tick_id;
+
 	GTimer *timer;
 
 	guint loop : 1;
@@ -125,6 +129,21 @@ ev_timeline_get_property (GObject    *object,
 	}
 }
 
+static void
+ev_timeline_remove_source (EvTimelinePriv *priv)
+{
+	if (priv->source_id) {
+		g_source_remove (priv->source_id);
+		priv->source_id = 0;
+	}
+
+	if (priv->tick_id) {
+		if (priv->widget)
+			gtk_widget_remove_tick_callback (priv->widget, priv->tick_id);
+		priv->tick_id = 0;
+	}
+}
+
 static void
 ev_timeline_finalize (GObject *object)
 {
@@ -132,10 +151,11 @@ ev_timeline_finalize (GObject *object)
 
 	priv = EV_TIMELINE_GET_PRIV (object);
 
-	if (priv->source_id) {
-		g_source_remove (priv->source_id);
-		priv->source_id = 0;
-	}
+	ev_timeline_remove_source (priv);
+
+	if (priv->widget)
+		g_object_remove_weak_pointer (G_OBJECT (priv->widget),
+					      (gpointer *)&priv->widget);
 
 	if (priv->timer)
 		g_timer_destroy (priv->timer);
@@ -144,14 +164,12 @@ ev_timeline_finalize (GObject *object)
 }
 
 static gboolean
-ev_timeline_run_frame (EvTimeline *timeline)
+ev_timeline_update (EvTimeline *timeline)
 {
 	EvTimelinePriv *priv;
 	gdouble         progress;
 	guint           elapsed_time;
 
-	gdk_threads_enter ();
-
 	priv = EV_TIMELINE_GET_PRIV (timeline);
 
 	elapsed_time = (guint) (g_timer_elapsed (priv->timer, NULL) * 1000);
@@ -162,10 +180,7 @@ ev_timeline_run_frame (EvTimeline *timeline)
 
 	if (progress >= 1.0) {
 		if (!priv->loop) {
-			if (priv->source_id) {
-				g_source_remove (priv->source_id);
-				priv->source_id = 0;
-			}
+			ev_timeline_remove_source (priv);
 
 			g_signal_emit (timeline, signals [FINISHED], 0);
 			return FALSE;
@@ -174,9 +189,45 @@ ev_timeline_run_frame (EvTimeline *timeline)
 		}
 	}
 
+	return TRUE;
+}
+
+static gboolean
+ev_timeline_run_frame (EvTimeline *timeline)
+{
+	gboolean retval;
+
+	gdk_threads_enter ();
+	retval = ev_timeline_update (timeline);
 	gdk_threads_leave ();
 
-	return TRUE;
+	return retval;
+}
+
+static gboolean
+ev_timeline_tick_cb (GtkWidget     *widget,
+		     GdkFrameClock *frame_clock,
+		     EvTimeline    *timeline)
+{
+	return ev_timeline_update (timeline);
+}
+
+static void
+ev_timeline_add_source (EvTimeline *timeline)
+{
+	EvTimelinePriv *priv;
+
+	priv = EV_TIMELINE_GET_PRIV (timeline);
+
+	if (priv->widget) {
+		priv->tick_id = gtk_widget_add_tick_callback (priv->widget,
+							      (GtkTickCallback) ev_timeline_tick_cb,
+							      timeline, NULL);
+	} else {
+		priv->source_id = g_timeout_add (FRAME_INTERVAL (priv->fps),
+						 (GSourceFunc) ev_timeline_run_frame,
+						 timeline);
+	}
 }
 
 static void
@@ -186,7 +237,7 @@ ev_timeline_real_start (EvTimeline *timeline)
 
 	priv = EV_TIMELINE_GET_PRIV (timeline);
 
-	if (!priv->source_id) {
+	if (!ev_timeline_is_running (timeline)) {
 		if (priv->timer)
 			g_timer_continue (priv->timer);
 		else
@@ -197,9 +248,7 @@ ev_timeline_real_start (EvTimeline *timeline)
 
 		g_signal_emit (timeline, signals [STARTED], 0);
 
-		priv->source_id = g_timeout_add (FRAME_INTERVAL (priv->fps),
-						 (GSourceFunc) ev_timeline_run_frame,
-						 timeline);
+		ev_timeline_add_source (timeline);
 	}
 }
 
@@ -307,9 +356,8 @@ ev_timeline_pause (EvTimeline *timeline)
 
 	priv = EV_TIMELINE_GET_PRIV (timeline);
 
-	if (priv->source_id) {
-		g_source_remove (priv->source_id);
-		priv->source_id = 0;
+	if (ev_timeline_is_running (timeline)) {
+		ev_timeline_remove_source (priv);
 		g_timer_stop (priv->timer);
 		g_signal_emit (timeline, signals [PAUSED], 0);
 	}
@@ -344,7 +392,7 @@ ev_timeline_is_running (EvTimeline *timeline)
 
 	priv = EV_TIMELINE_GET_PRIV (timeline);
 
-	return (priv->source_id != 0);
+	return (priv->source_id != 0 || priv->tick_id != 0);
 }
 
 guint
@@ -370,7 +418,7 @@ ev_timeline_set_fps (EvTimeline *timeline,
 
 	priv->fps = fps;
 
-	if (ev_timeline_is_running (timeline)) {
+	if (priv->source_id) {
 		g_source_remove (priv->source_id);
 		priv->source_id = g_timeout_add (FRAME_INTERVAL (priv->fps),
 						 (GSourceFunc) ev_timeline_run_frame,
@@ -451,3 +499,36 @@ ev_timeline_get_progress (EvTimeline *timeline)
 
 	return CLAMP (progress, 0., 1.);
 }
+
+/* Frames are emitted from the frame clock of the widget, in sync
+ * with its redraws, instead of from a timeout at the timeline fps.
+ */
+void
+ev_timeline_set_widget (EvTimeline *timeline,
+			GtkWidget  *widget)
+{
+	EvTimelinePriv *priv;
+	gboolean        running;
+
+	g_return_if_fail (EV_IS_TIMELINE (timeline));
+	g_return_if_fail (widget == NULL || GTK_IS_WIDGET (widget));
+
+	priv = EV_TIMELINE_GET_PRIV (timeline);
+
+	if (priv->widget == widget)
+		return;
+
+	running = ev_timeline_is_running (timeline);
+	ev_timeline_remove_source (priv);
+
+	if (priv->widget)
+		g_object_remove_weak_pointer (G_OBJECT (priv->widget),
+					      (gpointer *)&priv->widget);
+	priv->widget = widget;
+	if (priv->widget)
+		g_object_add_weak_pointer (G_OBJECT (priv->widget),
+					   (gpointer *)&priv->widget);
+
+	if (running)
+		ev_timeline_add_source (timeline);
+}
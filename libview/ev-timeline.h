@@ -26,7 +26,7 @@
 #ifndef __EV_TIMELINE_H__
 #define __EV_TIMELINE_H__
 
-#include <glib-object.h>
+#include <gtk/gtk.h>
 
 G_BEGIN_DECLS
 
@@ -84,6 +84,9 @@ void                  ev_timeline_set_duration       (EvTimeline             *ti
 
 gdouble               ev_timeline_get_progress       (EvTimeline             *timeline);
 
+void                  ev_timeline_set_widget         (EvTimeline             *timeline,
+						      GtkWidget              *widget);
+
 
 G_END_DECLS
 
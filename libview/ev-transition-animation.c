@@ -19,10 +19,14 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <config.h>
+
+#include <math.h>
 #include <cairo.h>
 #include <gdk/gdk.h>
 #include "ev-transition-animation.h"
 #include "ev-timeline.h"
+#include "ev-debug.h"
 
 #define EV_TRANSITION_ANIMATION_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), EV_TYPE_TRANSITION_ANIMATION, EvTransitionAnimationPriv))
 #define N_BLINDS 6
@@ -33,6 +37,23 @@ struct EvTransitionAnimationPriv {
 	EvTransitionEffect *effect;
 	cairo_surface_t *origin_surface;
 	cairo_surface_t *dest_surface;
+
+	/* Copies of the slides in the format of the target */
+	cairo_surface_t *origin_similar;
+	cairo_surface_t *dest_similar;
+
+	/* Effect properties, they don't change during the animation */
+	EvTransitionEffectType      type;
+	EvTransitionEffectAlignment alignment;
+	EvTransitionEffectDirection direction;
+	gint                        angle;
+
+#ifdef EV_ENABLE_DEBUG
+	/* Frame times in microseconds, summarized when profiling */
+	guint  n_frames;
+	gint64 frames_time;
+	gint64 max_frame_time;
+#endif
 };
 
 enum {
@@ -113,6 +134,15 @@ ev_transition_animation_finalize (GObject *object)
 
 	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (object);
 
+#ifdef EV_ENABLE_DEBUG
+	if (priv->n_frames > 0 && ev_profiler_is_enabled (EV_PROFILE_TRANSITIONS)) {
+		g_print ("[ Transition (%p) ] %u frames, %f s mean, %f s worst\n",
+			 object, priv->n_frames,
+			 priv->frames_time / (gdouble)priv->n_frames / G_USEC_PER_SEC,
+			 priv->max_frame_time / (gdouble)G_USEC_PER_SEC);
+	}
+#endif
+
 	if (priv->effect)
 		g_object_unref (priv->effect);
 
@@ -122,6 +152,12 @@ ev_transition_animation_finalize (GObject *object)
 	if (priv->dest_surface)
 		cairo_surface_destroy (priv->dest_surface);
 
+	if (priv->origin_similar)
+		cairo_surface_destroy (priv->origin_similar);
+
+	if (priv->dest_similar)
+		cairo_surface_destroy (priv->dest_similar);
+
 	G_OBJECT_CLASS (ev_transition_animation_parent_class)->finalize (object);
 }
 
@@ -142,7 +178,13 @@ ev_transition_animation_constructor (GType                  type,
 	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (object);
 	effect = priv->effect;
 
-	g_object_get (effect, "duration", &duration, NULL);
+	g_object_get (effect,
+		      "duration", &duration,
+		      "type", &priv->type,
+		      "alignment", &priv->alignment,
+		      "direction", &priv->direction,
+		      "angle", &priv->angle,
+		      NULL);
 	ev_timeline_set_duration (EV_TIMELINE (object), duration * 1000);
 
 	return object;
@@ -184,11 +226,45 @@ ev_transition_animation_class_init (EvTransitionAnimationClass *klass)
 	g_type_class_add_private (klass, sizeof (EvTransitionAnimationPriv));
 }
 
+/* Slides are copied once into a surface similar to the target, so that
+ * every frame is a native blit instead of converting (or uploading) the
+ * full page image again. The copy has no alpha channel, slides are
+ * opaque, so cairo and pixman reduce OVER to a plain copy.
+ */
+static cairo_surface_t *
+get_similar_surface (cairo_t          *cr,
+		     cairo_surface_t  *surface,
+		     cairo_surface_t **similar)
+{
+	cairo_t *copy_cr;
+	gint     width, height;
+
+	if (*similar)
+		return *similar;
+
+	if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE)
+		return surface;
+
+	width = cairo_image_surface_get_width (surface);
+	height = cairo_image_surface_get_height (surface);
+
+	*similar = cairo_surface_create_similar (cairo_get_target (cr),
+						 CAIRO_CONTENT_COLOR,
+						 width, height);
+	copy_cr = cairo_create (*similar);
+	cairo_set_operator (copy_cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface (copy_cr, surface, 0, 0);
+	cairo_paint (copy_cr);
+	cairo_destroy (copy_cr);
+
+	return *similar;
+}
+
 static void
 paint_surface (cairo_t         *cr,
 	       cairo_surface_t *surface,
-	       gdouble          x_offset,
-	       gdouble          y_offset,
+	       gint             x,
+	       gint             y,
 	       gdouble          alpha,
 	       GdkRectangle     page_area)
 {
@@ -196,8 +272,7 @@ paint_surface (cairo_t         *cr,
 
 	gdk_cairo_rectangle (cr, &page_area);
 	cairo_clip (cr);
-	cairo_surface_set_device_offset (surface, x_offset, y_offset);
-	cairo_set_source_surface (cr, surface, 0, 0);
+	cairo_set_source_surface (cr, surface, x, y);
 
 	if (alpha == 1.)
 		cairo_paint (cr);
@@ -207,391 +282,380 @@ paint_surface (cairo_t         *cr,
 	cairo_restore (cr);
 }
 
+static void
+paint_surface_in_region (cairo_t         *cr,
+			 cairo_surface_t *surface,
+			 gint             x,
+			 gint             y,
+			 cairo_region_t  *region)
+{
+	if (cairo_region_is_empty (region))
+		return;
+
+	cairo_save (cr);
+
+	gdk_cairo_region (cr, region);
+	cairo_clip (cr);
+	cairo_set_source_surface (cr, surface, x, y);
+	cairo_paint (cr);
+
+	cairo_restore (cr);
+}
+
+static void
+region_add_rectangle (cairo_region_t *region,
+		      gdouble         x,
+		      gdouble         y,
+		      gdouble         width,
+		      gdouble         height)
+{
+	cairo_rectangle_int_t rect;
+
+	rect.x = (gint) floor (x + 0.5);
+	rect.y = (gint) floor (y + 0.5);
+	rect.width = (gint) floor (x + width + 0.5) - rect.x;
+	rect.height = (gint) floor (y + height + 0.5) - rect.y;
+
+	if (rect.width > 0 && rect.height > 0)
+		cairo_region_union_rectangle (region, &rect);
+}
+
+/* Paints the destination slide inside dest_region and the origin slide
+ * in the rest of the page, so every pixel is written exactly once.
+ */
+static void
+paint_regions (cairo_t                   *cr,
+	       EvTransitionAnimationPriv *priv,
+	       cairo_region_t            *dest_region,
+	       GdkRectangle               page_area)
+{
+	cairo_region_t *origin_region;
+
+	origin_region = cairo_region_create_rectangle (&page_area);
+	cairo_region_intersect (dest_region, origin_region);
+	cairo_region_subtract (origin_region, dest_region);
+
+	paint_surface_in_region (cr, priv->origin_surface, 0, 0, origin_region);
+	paint_surface_in_region (cr, priv->dest_surface, 0, 0, dest_region);
+
+	cairo_region_destroy (origin_region);
+}
+
 /* animations */
 static void
-ev_transition_animation_split (cairo_t               *cr,
-			       EvTransitionAnimation *animation,
-			       EvTransitionEffect    *effect,
-			       gdouble                progress,
-			       GdkRectangle           page_area)
+ev_transition_animation_split (EvTransitionAnimationPriv *priv,
+			       cairo_region_t            *dest_region,
+			       gdouble                    progress,
+			       GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
-	EvTransitionEffectAlignment alignment;
-	EvTransitionEffectDirection direction;
 	gint width, height;
 
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
 	width = page_area.width;
 	height = page_area.height;
 
-	g_object_get (effect,
-		      "alignment", &alignment,
-		      "direction", &direction,
-		      NULL);
+	if (priv->direction == EV_TRANSITION_DIRECTION_INWARD) {
+		cairo_region_t *origin_region;
 
-	if (direction == EV_TRANSITION_DIRECTION_INWARD) {
-		paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
+		origin_region = cairo_region_create ();
 
-		if (alignment == EV_TRANSITION_ALIGNMENT_HORIZONTAL) {
-			cairo_rectangle (cr,
-					 0,
-					 height * progress / 2,
-					 width,
-					 height * (1 - progress));
+		if (priv->alignment == EV_TRANSITION_ALIGNMENT_HORIZONTAL) {
+			region_add_rectangle (origin_region,
+					      0,
+					      height * progress / 2,
+					      width,
+					      height * (1 - progress));
 		} else {
-			cairo_rectangle (cr,
-					 width * progress / 2,
-					 0,
-					 width * (1 - progress),
-					 height);
+			region_add_rectangle (origin_region,
+					      width * progress / 2,
+					      0,
+					      width * (1 - progress),
+					      height);
 		}
 
-		cairo_clip (cr);
-
-		paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
+		region_add_rectangle (dest_region, 0, 0, width, height);
+		cairo_region_subtract (dest_region, origin_region);
+		cairo_region_destroy (origin_region);
 	} else {
-		paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
-
-		if (alignment == EV_TRANSITION_ALIGNMENT_HORIZONTAL) {
-			cairo_rectangle (cr,
-					 0,
-					 (height / 2) - (height * progress / 2),
-					 width,
-					 height * progress);
+		if (priv->alignment == EV_TRANSITION_ALIGNMENT_HORIZONTAL) {
+			region_add_rectangle (dest_region,
+					      0,
+					      (height / 2) - (height * progress / 2),
+					      width,
+					      height * progress);
 		} else {
-			cairo_rectangle (cr,
-					 (width / 2) - (width * progress / 2),
-					 0,
-					 width * progress,
-					 height);
+			region_add_rectangle (dest_region,
+					      (width / 2) - (width * progress / 2),
+					      0,
+					      width * progress,
+					      height);
 		}
-
-		cairo_clip (cr);
-
-		paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
 	}
 }
 
 static void
-ev_transition_animation_blinds (cairo_t               *cr,
-				EvTransitionAnimation *animation,
-				EvTransitionEffect    *effect,
-				gdouble                progress,
-				GdkRectangle           page_area)
+ev_transition_animation_blinds (EvTransitionAnimationPriv *priv,
+				cairo_region_t            *dest_region,
+				gdouble                    progress,
+				GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
-	EvTransitionEffectAlignment alignment;
 	gint width, height, i;
 
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
 	width = page_area.width;
 	height = page_area.height;
 
-	g_object_get (effect,
-		      "alignment", &alignment,
-		      NULL);
-
-	paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
-
 	for (i = 0; i < N_BLINDS; i++) {
-		cairo_save (cr);
-
-		if (alignment == EV_TRANSITION_ALIGNMENT_HORIZONTAL) {
-			cairo_rectangle (cr,
-					 0,
-					 height / N_BLINDS * i,
-					 width,
-					 height / N_BLINDS * progress);
+		if (priv->alignment == EV_TRANSITION_ALIGNMENT_HORIZONTAL) {
+			region_add_rectangle (dest_region,
+					      0,
+					      height / N_BLINDS * i,
+					      width,
+					      height / N_BLINDS * progress);
 		} else {
-			cairo_rectangle (cr,
-					 width / N_BLINDS * i,
-					 0,
-					 width / N_BLINDS * progress,
-					 height);
+			region_add_rectangle (dest_region,
+					      width / N_BLINDS * i,
+					      0,
+					      width / N_BLINDS * progress,
+					      height);
 		}
-
-		cairo_clip (cr);
-		paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
-		cairo_restore (cr);
 	}
 }
 
 static void
-ev_transition_animation_box (cairo_t               *cr,
-			     EvTransitionAnimation *animation,
-			     EvTransitionEffect    *effect,
-			     gdouble                progress,
-			     GdkRectangle           page_area)
+ev_transition_animation_box (EvTransitionAnimationPriv *priv,
+			     cairo_region_t            *dest_region,
+			     gdouble                    progress,
+			     GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
-	EvTransitionEffectDirection direction;
 	gint width, height;
 
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
 	width = page_area.width;
 	height = page_area.height;
 
-	g_object_get (effect,
-		      "direction", &direction,
-		      NULL);
-
-	if (direction == EV_TRANSITION_DIRECTION_INWARD) {
-		paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
+	if (priv->direction == EV_TRANSITION_DIRECTION_INWARD) {
+		cairo_region_t *origin_region;
 
-		cairo_rectangle (cr,
-				 width * progress / 2,
-				 height * progress / 2,
-				 width * (1 - progress),
-				 height * (1 - progress));
-		cairo_clip (cr);
+		origin_region = cairo_region_create ();
+		region_add_rectangle (origin_region,
+				      width * progress / 2,
+				      height * progress / 2,
+				      width * (1 - progress),
+				      height * (1 - progress));
 
-		paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
+		region_add_rectangle (dest_region, 0, 0, width, height);
+		cairo_region_subtract (dest_region, origin_region);
+		cairo_region_destroy (origin_region);
 	} else {
-		paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
-
-		cairo_rectangle (cr,
-				 (width / 2) - (width * progress / 2),
-				 (height / 2) - (height * progress / 2),
-				 width * progress,
-				 height * progress);
-		cairo_clip (cr);
-
-		paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
+		region_add_rectangle (dest_region,
+				      (width / 2) - (width * progress / 2),
+				      (height / 2) - (height * progress / 2),
+				      width * progress,
+				      height * progress);
 	}
 }
 
 static void
-ev_transition_animation_wipe (cairo_t               *cr,
-			      EvTransitionAnimation *animation,
-			      EvTransitionEffect    *effect,
-			      gdouble                progress,
-			      GdkRectangle           page_area)
+ev_transition_animation_wipe (EvTransitionAnimationPriv *priv,
+			      cairo_region_t            *dest_region,
+			      gdouble                    progress,
+			      GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
 	gint width, height;
-	gint angle;
 
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
 	width = page_area.width;
 	height = page_area.height;
 
-	g_object_get (effect,
-		      "angle", &angle,
-		      NULL);
-
-	paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
-
-	if (angle == 0) {
+	if (priv->angle == 0) {
 		/* left to right */
-		cairo_rectangle (cr,
-				 0, 0,
-				 width * progress,
-				 height);
-	} else if (angle <= 90) {
+		region_add_rectangle (dest_region,
+				      0, 0,
+				      width * progress,
+				      height);
+	} else if (priv->angle <= 90) {
 		/* bottom to top */
-		cairo_rectangle (cr,
-				 0,
-				 height * (1 - progress),
-				 width,
-				 height * progress);
-	} else if (angle <= 180) {
+		region_add_rectangle (dest_region,
+				      0,
+				      height * (1 - progress),
+				      width,
+				      height * progress);
+	} else if (priv->angle <= 180) {
 		/* right to left */
-		cairo_rectangle (cr,
-				 width * (1 - progress),
-				 0,
-				 width * progress,
-				 height);
-	} else if (angle <= 270) {
+		region_add_rectangle (dest_region,
+				      width * (1 - progress),
+				      0,
+				      width * progress,
+				      height);
+	} else if (priv->angle <= 270) {
 		/* top to bottom */
-		cairo_rectangle (cr,
-				 0, 0,
-				 width,
-				 height * progress);
+		region_add_rectangle (dest_region,
+				      0, 0,
+				      width,
+				      height * progress);
 	}
-
-	cairo_clip (cr);
-
-	paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
 }
 
 static void
-ev_transition_animation_dissolve (cairo_t               *cr,
-				  EvTransitionAnimation *animation,
-				  EvTransitionEffect    *effect,
-				  gdouble                progress,
-				  GdkRectangle           page_area)
+ev_transition_animation_dissolve (cairo_t                   *cr,
+				  EvTransitionAnimationPriv *priv,
+				  gdouble                    progress,
+				  GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
-
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
-
 	paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
 	paint_surface (cr, priv->origin_surface, 0, 0, 1 - progress, page_area);
 }
 
 static void
-ev_transition_animation_push (cairo_t               *cr,
-			      EvTransitionAnimation *animation,
-			      EvTransitionEffect    *effect,
-			      gdouble                progress,
-			      GdkRectangle           page_area)
+ev_transition_animation_push (cairo_t                   *cr,
+			      EvTransitionAnimationPriv *priv,
+			      gdouble                    progress,
+			      GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
 	gint width, height;
-	gint angle;
 
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
 	width = page_area.width;
 	height = page_area.height;
 
-	g_object_get (effect,
-		      "angle", &angle,
-		      NULL);
-
-	if (angle == 0) {
+	/* Both slides are moved by whole pixels, so that they
+	 * are blitted instead of being resampled on every frame
+	 */
+	if (priv->angle == 0) {
 		/* left to right */
-		paint_surface (cr, priv->origin_surface, - (width * progress), 0, 1., page_area);
-		paint_surface (cr, priv->dest_surface, width * (1 - progress), 0, 1., page_area);
+		gint offset = (gint) floor (width * progress + 0.5);
+
+		paint_surface (cr, priv->origin_surface, offset, 0, 1., page_area);
+		paint_surface (cr, priv->dest_surface, offset - width, 0, 1., page_area);
 	} else {
 		/* top to bottom */
-		paint_surface (cr, priv->origin_surface, 0, - (height * progress), 1., page_area);
-		paint_surface (cr, priv->dest_surface, 0, height * (1 - progress), 1., page_area);
+		gint offset = (gint) floor (height * progress + 0.5);
+
+		paint_surface (cr, priv->origin_surface, 0, offset, 1., page_area);
+		paint_surface (cr, priv->dest_surface, 0, offset - height, 1., page_area);
 	}
 }
 
 static void
-ev_transition_animation_cover (cairo_t               *cr,
-			       EvTransitionAnimation *animation,
-			       EvTransitionEffect    *effect,
-			       gdouble                progress,
-			       GdkRectangle           page_area)
+ev_transition_animation_cover (cairo_t                   *cr,
+			       EvTransitionAnimationPriv *priv,
+			       gdouble                    progress,
+			       GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
-	gint width, height;
-	gint angle;
+	cairo_region_t        *origin_region;
+	cairo_rectangle_int_t  dest_rect;
+	gint                   width, height;
 
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
 	width = page_area.width;
 	height = page_area.height;
 
-	g_object_get (effect,
-		      "angle", &angle,
-		      NULL);
-
-	paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
-
-	if (angle == 0) {
+	dest_rect = page_area;
+	if (priv->angle == 0) {
 		/* left to right */
-		paint_surface (cr, priv->dest_surface, width * (1 - progress), 0, 1., page_area);
+		dest_rect.x = (gint) floor (width * progress + 0.5) - width;
 	} else {
 		/* top to bottom */
-		paint_surface (cr, priv->dest_surface, 0, height * (1 - progress), 1., page_area);
+		dest_rect.y = (gint) floor (height * progress + 0.5) - height;
 	}
+
+	/* The origin slide is only painted where it's not covered yet */
+	origin_region = cairo_region_create_rectangle (&page_area);
+	cairo_region_subtract_rectangle (origin_region, &dest_rect);
+	paint_surface_in_region (cr, priv->origin_surface, 0, 0, origin_region);
+	cairo_region_destroy (origin_region);
+
+	paint_surface (cr, priv->dest_surface, dest_rect.x, dest_rect.y, 1., page_area);
 }
 
 static void
-ev_transition_animation_uncover (cairo_t               *cr,
-				 EvTransitionAnimation *animation,
-				 EvTransitionEffect    *effect,
-				 gdouble                progress,
-				 GdkRectangle           page_area)
+ev_transition_animation_uncover (cairo_t                   *cr,
+				 EvTransitionAnimationPriv *priv,
+				 gdouble                    progress,
+				 GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
-	gint width, height;
-	gint angle;
+	cairo_region_t        *dest_region;
+	cairo_rectangle_int_t  origin_rect;
+	gint                   width, height;
 
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
 	width = page_area.width;
 	height = page_area.height;
 
-	g_object_get (effect,
-		      "angle", &angle,
-		      NULL);
-
-	paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
-
-	if (angle == 0) {
+	origin_rect = page_area;
+	if (priv->angle == 0) {
 		/* left to right */
-		paint_surface (cr, priv->origin_surface, - (width * progress), 0, 1., page_area);
+		origin_rect.x = (gint) floor (width * progress + 0.5);
 	} else {
 		/* top to bottom */
-		paint_surface (cr, priv->origin_surface, 0, - (height * progress), 1., page_area);
+		origin_rect.y = (gint) floor (height * progress + 0.5);
 	}
+
+	/* The destination slide is only painted where it's been uncovered */
+	dest_region = cairo_region_create_rectangle (&page_area);
+	cairo_region_subtract_rectangle (dest_region, &origin_rect);
+	paint_surface_in_region (cr, priv->dest_surface, 0, 0, dest_region);
+	cairo_region_destroy (dest_region);
+
+	paint_surface (cr, priv->origin_surface, origin_rect.x, origin_rect.y, 1., page_area);
 }
 
 static void
-ev_transition_animation_fade (cairo_t               *cr,
-			      EvTransitionAnimation *animation,
-			      EvTransitionEffect    *effect,
-			      gdouble                progress,
-			      GdkRectangle           page_area)
+ev_transition_animation_fade (cairo_t                   *cr,
+			      EvTransitionAnimationPriv *priv,
+			      gdouble                    progress,
+			      GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
-
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
-
 	paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
 	paint_surface (cr, priv->dest_surface, 0, 0, progress, page_area);
 }
 
-void
-ev_transition_animation_paint (EvTransitionAnimation *animation,
-			       cairo_t               *cr,
-			       GdkRectangle           page_area)
+static void
+ev_transition_animation_paint_frame (EvTransitionAnimationPriv *priv,
+				     cairo_t                   *cr,
+				     gdouble                    progress,
+				     GdkRectangle               page_area)
 {
-	EvTransitionAnimationPriv *priv;
-	EvTransitionEffectType type;
-	gdouble progress;
+	cairo_region_t *dest_region;
 
-	g_return_if_fail (EV_IS_TRANSITION_ANIMATION (animation));
-
-	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
-
-	if (!priv->dest_surface) {
-		/* animation is still not ready, paint the origin surface */
-		paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
-		return;
-	}
-
-	g_object_get (priv->effect, "type", &type, NULL);
-	progress = ev_timeline_get_progress (EV_TIMELINE (animation));
-
-	switch (type) {
+	switch (priv->type) {
 	case EV_TRANSITION_EFFECT_REPLACE:
 		/* just paint the destination slide */
 		paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
+		return;
+	case EV_TRANSITION_EFFECT_DISSOLVE:
+		ev_transition_animation_dissolve (cr, priv, progress, page_area);
+		return;
+	case EV_TRANSITION_EFFECT_PUSH:
+		ev_transition_animation_push (cr, priv, progress, page_area);
+		return;
+	case EV_TRANSITION_EFFECT_COVER:
+		ev_transition_animation_cover (cr, priv, progress, page_area);
+		return;
+	case EV_TRANSITION_EFFECT_UNCOVER:
+		ev_transition_animation_uncover (cr, priv, progress, page_area);
+		return;
+	case EV_TRANSITION_EFFECT_FADE:
+		ev_transition_animation_fade (cr, priv, progress, page_area);
+		return;
+	default:
 		break;
+	}
+
+	/* Geometric effects only compute the area of the destination slide */
+	dest_region = cairo_region_create ();
+
+	switch (priv->type) {
 	case EV_TRANSITION_EFFECT_SPLIT:
-		ev_transition_animation_split (cr, animation, priv->effect, progress, page_area);
+		ev_transition_animation_split (priv, dest_region, progress, page_area);
 		break;
 	case EV_TRANSITION_EFFECT_BLINDS:
-		ev_transition_animation_blinds (cr, animation, priv->effect, progress, page_area);
+		ev_transition_animation_blinds (priv, dest_region, progress, page_area);
 		break;
 	case EV_TRANSITION_EFFECT_BOX:
-		ev_transition_animation_box (cr, animation, priv->effect, progress, page_area);
+		ev_transition_animation_box (priv, dest_region, progress, page_area);
 		break;
 	case EV_TRANSITION_EFFECT_WIPE:
-		ev_transition_animation_wipe (cr, animation, priv->effect, progress, page_area);
-		break;
-	case EV_TRANSITION_EFFECT_DISSOLVE:
-		ev_transition_animation_dissolve (cr, animation, priv->effect, progress, page_area);
-		break;
-	case EV_TRANSITION_EFFECT_PUSH:
-		ev_transition_animation_push (cr, animation, priv->effect, progress, page_area);
-		break;
-	case EV_TRANSITION_EFFECT_COVER:
-		ev_transition_animation_cover (cr, animation, priv->effect, progress, page_area);
-		break;
-	case EV_TRANSITION_EFFECT_UNCOVER:
-		ev_transition_animation_uncover (cr, animation, priv->effect, progress, page_area);
-		break;
-	case EV_TRANSITION_EFFECT_FADE:
-		ev_transition_animation_fade (cr, animation, priv->effect, progress, page_area);
+		ev_transition_animation_wipe (priv, dest_region, progress, page_area);
 		break;
 	default: {
 		GEnumValue *enum_value;
 
-		enum_value = g_enum_get_value (g_type_class_peek (EV_TYPE_TRANSITION_EFFECT_TYPE), type);
+		enum_value = g_enum_get_value (g_type_class_peek (EV_TYPE_TRANSITION_EFFECT_TYPE), priv->type);
 
 		g_warning ("Unimplemented transition animation: '%s', "
 			   "please post a bug report in Evince bugzilla "
@@ -599,9 +663,58 @@ ev_transition_animation_paint (EvTransitionAnimation *animation,
 			   enum_value->value_nick);
 
 		/* just paint the destination slide */
-		paint_surface (cr, priv->dest_surface, 0, 0, 1., page_area);
+		region_add_rectangle (dest_region, 0, 0, page_area.width, page_area.height);
 		}
 	}
+
+	paint_regions (cr, priv, dest_region, page_area);
+	cairo_region_destroy (dest_region);
+}
+
+void
+ev_transition_animation_paint (EvTransitionAnimation *animation,
+			       cairo_t               *cr,
+			       GdkRectangle           page_area)
+{
+	EvTransitionAnimationPriv *priv;
+	EvTransitionAnimationPriv  frame;
+	gdouble                    progress;
+#ifdef EV_ENABLE_DEBUG
+	gint64                     frame_time;
+#endif
+
+	g_return_if_fail (EV_IS_TRANSITION_ANIMATION (animation));
+
+	priv = EV_TRANSITION_ANIMATION_GET_PRIVATE (animation);
+
+	if (!priv->dest_surface) {
+		/* animation is still not ready, paint the origin surface */
+		paint_surface (cr, priv->origin_surface, 0, 0, 1., page_area);
+		return;
+	}
+
+	progress = ev_timeline_get_progress (EV_TIMELINE (animation));
+
+	ev_profiler_start (EV_PROFILE_TRANSITIONS, "Transition frame (%p)", animation);
+#ifdef EV_ENABLE_DEBUG
+	frame_time = g_get_monotonic_time ();
+#endif
+
+	/* Paint from the copies in the target format */
+	frame = *priv;
+	frame.origin_surface = get_similar_surface (cr, priv->origin_surface, &priv->origin_similar);
+	frame.dest_surface = get_similar_surface (cr, priv->dest_surface, &priv->dest_similar);
+
+	ev_transition_animation_paint_frame (&frame, cr, progress, page_area);
+
+#ifdef EV_ENABLE_DEBUG
+	frame_time = g_get_monotonic_time () - frame_time;
+	priv->n_frames++;
+	priv->frames_time += frame_time;
+	priv->max_frame_time = MAX (priv->max_frame_time, frame_time);
+#endif
+
+	ev_profiler_stop (EV_PROFILE_TRANSITIONS, "Transition frame (%p) progress %.2f", animation, progress);
 }
 
 EvTransitionAnimation *
@@ -633,6 +746,11 @@ ev_transition_animation_set_origin_surface (EvTransitionAnimation *animation,
 	if (priv->origin_surface)
 		cairo_surface_destroy (priv->origin_surface);
 
+	if (priv->origin_similar) {
+		cairo_surface_destroy (priv->origin_similar);
+		priv->origin_similar = NULL;
+	}
+
 	priv->origin_surface = surface;
 	g_object_notify (G_OBJECT (animation), "origin-surface");
 
@@ -659,6 +777,11 @@ ev_transition_animation_set_dest_surface (EvTransitionAnimation *animation,
 	if (priv->dest_surface)
 		cairo_surface_destroy (priv->dest_surface);
 
+	if (priv->dest_similar) {
+		cairo_surface_destroy (priv->dest_similar);
+		priv->dest_similar = NULL;
+	}
+
 	priv->dest_surface = surface;
 	g_object_notify (G_OBJECT (animation), "dest-surface");
 
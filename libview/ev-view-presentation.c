@@ -87,9 +87,13 @@ struct _EvViewPresentation
 	/* Links */
 	EvPageCache           *page_cache;
 
-	EvJob *prev_job;
-	EvJob *curr_job;
-	EvJob *next_job;
+	/* Slides */
+	EvJob                **slide_jobs;
+	gint                   n_slides;
+	gint                   direction;
+	guint                  lookahead;
+	gsize                  page_cache_size;
+	GList                 *linked_pages;
 };
 
 struct _EvViewPresentationClass
@@ -112,6 +116,10 @@ static void ev_view_presentation_set_cursor_for_location (EvViewPresentation *pv
 
 #define HIDE_CURSOR_TIMEOUT 5
 
+/* Slides rendered ahead and behind the current one */
+#define DEFAULT_LOOKAHEAD       3
+#define DEFAULT_PAGE_CACHE_SIZE (100 * 1024 * 1024)
+
 G_DEFINE_TYPE (EvViewPresentation, ev_view_presentation, GTK_TYPE_WIDGET)
 
 static GdkRGBA black = { 0., 0., 0., 1. };
@@ -257,6 +265,28 @@ ev_view_presentation_transition_start (EvViewPresentation *pview)
 	}
 }
 
+/* Slides */
+static EvJob *
+ev_view_presentation_get_slide_job (EvViewPresentation *pview,
+				    gint                page)
+{
+	if (!pview->slide_jobs || page < 0 || page >= pview->n_slides)
+		return NULL;
+
+	return pview->slide_jobs[page];
+}
+
+static cairo_surface_t *
+ev_view_presentation_get_slide_surface (EvViewPresentation *pview,
+					gint                page)
+{
+	EvJob *job;
+
+	job = ev_view_presentation_get_slide_job (pview, page);
+
+	return job ? EV_JOB_RENDER (job)->surface : NULL;
+}
+
 /* Animations */
 static void
 ev_view_presentation_animation_cancel (EvViewPresentation *pview)
@@ -288,7 +318,6 @@ ev_view_presentation_animation_start (EvViewPresentation *pview,
 {
 	EvTransitionEffect *effect = NULL;
 	cairo_surface_t    *surface;
-	gint                jump;
 
 	if (!pview->enable_animations)
 		return;
@@ -302,19 +331,14 @@ ev_view_presentation_animation_start (EvViewPresentation *pview,
 		return;
 
 	pview->animation = ev_transition_animation_new (effect);
+	ev_timeline_set_widget (EV_TIMELINE (pview->animation), GTK_WIDGET (pview));
 
-	surface = pview->curr_job ? EV_JOB_RENDER (pview->curr_job)->surface : NULL;
+	surface = ev_view_presentation_get_slide_surface (pview, pview->current_page);
 	ev_transition_animation_set_origin_surface (pview->animation,
 						    surface != NULL ?
 						    surface : pview->current_surface);
 
-	jump = new_page - pview->current_page;
-	if (jump == -1)
-		surface = pview->prev_job ? EV_JOB_RENDER (pview->prev_job)->surface : NULL;
-	else if (jump == 1)
-		surface = pview->next_job ? EV_JOB_RENDER (pview->next_job)->surface : NULL;
-	else
-		surface = NULL;
+	surface = ev_view_presentation_get_slide_surface (pview, new_page);
 	if (surface)
 		ev_transition_animation_set_dest_surface (pview->animation, surface);
 
@@ -336,7 +360,7 @@ job_finished_cb (EvJob              *job,
 	if (pview->inverted_colors)
 		ev_document_misc_invert_surface (job_render->surface);
 
-	if (job != pview->curr_job)
+	if (job != ev_view_presentation_get_slide_job (pview, pview->current_page))
 		return;
 
 	if (pview->animation) {
@@ -384,111 +408,216 @@ ev_view_presentation_delete_job (EvViewPresentation *pview,
 static void
 ev_view_presentation_reset_jobs (EvViewPresentation *pview)
 {
-        if (pview->curr_job) {
-                ev_view_presentation_delete_job (pview, pview->curr_job);
-                pview->curr_job = NULL;
-        }
+	gint i;
 
-        if (pview->prev_job) {
-                ev_view_presentation_delete_job (pview, pview->prev_job);
-                pview->prev_job = NULL;
-        }
+	if (!pview->slide_jobs)
+		return;
 
-        if (pview->next_job) {
-                ev_view_presentation_delete_job (pview, pview->next_job);
-                pview->next_job = NULL;
-        }
+	for (i = 0; i < pview->n_slides; i++) {
+		ev_view_presentation_delete_job (pview, pview->slide_jobs[i]);
+		pview->slide_jobs[i] = NULL;
+	}
 }
 
-static void
-ev_view_presentation_update_current_page (EvViewPresentation *pview,
-					  guint               page)
+static gsize
+ev_view_presentation_get_slide_size (EvViewPresentation *pview,
+				     gint                page)
 {
-	gint jump;
+	gdouble width, height;
+	gdouble scale;
 
-	if (page < 0 || page >= ev_document_get_n_pages (pview->document))
-		return;
+	ev_document_get_page_size (pview->document, page, &width, &height);
+	scale = ev_view_presentation_get_scale_for_page (pview, page);
 
-	ev_view_presentation_animation_cancel (pview);
-	ev_view_presentation_animation_start (pview, page);
+	return (gsize)(width * scale + 0.5) * (gsize)(height * scale + 0.5) * 4;
+}
 
-	jump = page - pview->current_page;
+static gboolean
+ev_view_presentation_keep_slide (EvViewPresentation *pview,
+				 gint                page,
+				 EvJobPriority       priority,
+				 gboolean            ignore_cache_size,
+				 gboolean           *keep,
+				 gsize              *cache_used)
+{
+	gsize size;
 
-	switch (jump) {
-	case 0:
-		if (!pview->curr_job)
-			pview->curr_job = ev_view_presentation_schedule_new_job (pview, page, EV_JOB_PRIORITY_URGENT);
-		if (!pview->next_job)
-			pview->next_job = ev_view_presentation_schedule_new_job (pview, page + 1, EV_JOB_PRIORITY_HIGH);
-		if (!pview->prev_job)
-			pview->prev_job = ev_view_presentation_schedule_new_job (pview, page - 1, EV_JOB_PRIORITY_LOW);
-		break;
-	case -1:
-		ev_view_presentation_delete_job (pview, pview->next_job);
-		pview->next_job = pview->curr_job;
-		pview->curr_job = pview->prev_job;
+	if (page < 0 || page >= pview->n_slides || keep[page])
+		return TRUE;
 
-		if (!pview->curr_job)
-			pview->curr_job = ev_view_presentation_schedule_new_job (pview, page, EV_JOB_PRIORITY_URGENT);
-		else
-			ev_job_scheduler_update_job (pview->curr_job, EV_JOB_PRIORITY_URGENT);
-		pview->prev_job = ev_view_presentation_schedule_new_job (pview, page - 1, EV_JOB_PRIORITY_HIGH);
-		ev_job_scheduler_update_job (pview->next_job, EV_JOB_PRIORITY_LOW);
+	size = ev_view_presentation_get_slide_size (pview, page);
+	if (!ignore_cache_size && *cache_used + size > pview->page_cache_size)
+		return FALSE;
 
-		break;
-	case 1:
-		ev_view_presentation_delete_job (pview, pview->prev_job);
-		pview->prev_job = pview->curr_job;
-		pview->curr_job = pview->next_job;
+	*cache_used += size;
+	keep[page] = TRUE;
 
-		if (!pview->curr_job)
-			pview->curr_job = ev_view_presentation_schedule_new_job (pview, page, EV_JOB_PRIORITY_URGENT);
-		else
-			ev_job_scheduler_update_job (pview->curr_job, EV_JOB_PRIORITY_URGENT);
-		pview->next_job = ev_view_presentation_schedule_new_job (pview, page + 1, EV_JOB_PRIORITY_HIGH);
-		ev_job_scheduler_update_job (pview->prev_job, EV_JOB_PRIORITY_LOW);
+	if (pview->slide_jobs[page])
+		ev_job_scheduler_update_job (pview->slide_jobs[page], priority);
+	else
+		pview->slide_jobs[page] = ev_view_presentation_schedule_new_job (pview, page, priority);
 
-		break;
-	case -2:
-		ev_view_presentation_delete_job (pview, pview->next_job);
-		ev_view_presentation_delete_job (pview, pview->curr_job);
-		pview->next_job = pview->prev_job;
-
-		pview->curr_job = ev_view_presentation_schedule_new_job (pview, page, EV_JOB_PRIORITY_URGENT);
-		pview->prev_job = ev_view_presentation_schedule_new_job (pview, page - 1, EV_JOB_PRIORITY_HIGH);
-		if (!pview->next_job)
-			pview->next_job = ev_view_presentation_schedule_new_job (pview, page + 1, EV_JOB_PRIORITY_LOW);
-		else
-			ev_job_scheduler_update_job (pview->next_job, EV_JOB_PRIORITY_LOW);
-		break;
-	case 2:
-		ev_view_presentation_delete_job (pview, pview->prev_job);
-		ev_view_presentation_delete_job (pview, pview->curr_job);
-		pview->prev_job = pview->next_job;
-
-		pview->curr_job = ev_view_presentation_schedule_new_job (pview, page, EV_JOB_PRIORITY_URGENT);
-		pview->next_job = ev_view_presentation_schedule_new_job (pview, page + 1, EV_JOB_PRIORITY_HIGH);
-		if (!pview->prev_job)
-			pview->prev_job = ev_view_presentation_schedule_new_job (pview, page - 1, EV_JOB_PRIORITY_LOW);
-		else
-			ev_job_scheduler_update_job (pview->prev_job, EV_JOB_PRIORITY_LOW);
+	return TRUE;
+}
+
+/* Renders the current slide and its neighbours first, then as many slides
+ * of the lookahead window as fit in the cache, in the direction of the
+ * presentation first, and finally the slides linked from the current one.
+ * Slides no longer needed are released.
+ */
+static void
+ev_view_presentation_update_slides (EvViewPresentation *pview)
+{
+	gint      page = pview->current_page;
+	gint      direction = pview->direction;
+	gboolean *keep;
+	gsize     cache_used = 0;
+	GList    *l;
+	gint      i;
+
+	if (!pview->slide_jobs) {
+		pview->n_slides = ev_document_get_n_pages (pview->document);
+		pview->slide_jobs = g_new0 (EvJob *, pview->n_slides);
+	}
+
+	keep = g_new0 (gboolean, pview->n_slides);
+
+	ev_view_presentation_keep_slide (pview, page, EV_JOB_PRIORITY_URGENT,
+					 TRUE, keep, &cache_used);
+	ev_view_presentation_keep_slide (pview, page + direction, EV_JOB_PRIORITY_HIGH,
+					 TRUE, keep, &cache_used);
+	ev_view_presentation_keep_slide (pview, page - direction, EV_JOB_PRIORITY_LOW,
+					 TRUE, keep, &cache_used);
+
+	for (i = 2; i <= pview->lookahead; i++) {
+		if (!ev_view_presentation_keep_slide (pview, page + i * direction,
+						      EV_JOB_PRIORITY_LOW,
+						      FALSE, keep, &cache_used))
+			break;
+		if (!ev_view_presentation_keep_slide (pview, page - i * direction,
+						      EV_JOB_PRIORITY_LOW,
+						      FALSE, keep, &cache_used))
+			break;
+	}
+
+	for (l = pview->linked_pages; l; l = g_list_next (l)) {
+		if (!ev_view_presentation_keep_slide (pview, GPOINTER_TO_INT (l->data),
+						      EV_JOB_PRIORITY_NONE,
+						      FALSE, keep, &cache_used))
+			break;
+	}
+
+	for (i = 0; i < pview->n_slides; i++) {
+		if (keep[i] || !pview->slide_jobs[i])
+			continue;
+
+		ev_view_presentation_delete_job (pview, pview->slide_jobs[i]);
+		pview->slide_jobs[i] = NULL;
+	}
+
+	g_free (keep);
+}
+
+static gint
+ev_view_presentation_get_link_dest_page (EvViewPresentation *pview,
+					 EvLink             *link)
+{
+	EvLinkAction *action;
+
+	action = ev_link_get_action (link);
+	if (!action)
+		return -1;
+
+	switch (ev_link_action_get_action_type (action)) {
+	case EV_LINK_ACTION_TYPE_GOTO_DEST: {
+		EvLinkDest *dest;
+
+		dest = ev_link_action_get_dest (action);
+		if (!dest)
+			return -1;
+
+		/* Resolving named destinations requires the backend,
+		 * so they are not preloaded */
+		switch (ev_link_dest_get_dest_type (dest)) {
+		case EV_LINK_DEST_TYPE_NAMED:
+		case EV_LINK_DEST_TYPE_PAGE_LABEL:
+		case EV_LINK_DEST_TYPE_UNKNOWN:
+			return -1;
+		default:
+			return ev_link_dest_get_page (dest);
+		}
+	}
+	case EV_LINK_ACTION_TYPE_NAMED: {
+		const gchar *name = ev_link_action_get_name (action);
+
+		if (g_ascii_strcasecmp (name, "FirstPage") == 0)
+			return 0;
+		else if (g_ascii_strcasecmp (name, "LastPage") == 0)
+			return ev_document_get_n_pages (pview->document) - 1;
+	}
 		break;
 	default:
-		ev_view_presentation_delete_job (pview, pview->prev_job);
-		ev_view_presentation_delete_job (pview, pview->curr_job);
-		ev_view_presentation_delete_job (pview, pview->next_job);
-
-		pview->curr_job = ev_view_presentation_schedule_new_job (pview, page, EV_JOB_PRIORITY_URGENT);
-		if (jump > 0) {
-			pview->next_job = ev_view_presentation_schedule_new_job (pview, page + 1, EV_JOB_PRIORITY_HIGH);
-			pview->prev_job = ev_view_presentation_schedule_new_job (pview, page - 1, EV_JOB_PRIORITY_LOW);
-		} else {
-			pview->prev_job = ev_view_presentation_schedule_new_job (pview, page - 1, EV_JOB_PRIORITY_HIGH);
-			pview->next_job = ev_view_presentation_schedule_new_job (pview, page + 1, EV_JOB_PRIORITY_LOW);
-		}
+		break;
 	}
 
+	return -1;
+}
+
+static void
+ev_view_presentation_update_linked_pages (EvViewPresentation *pview)
+{
+	EvMappingList *link_mapping;
+	GList         *l;
+
+	g_list_free (pview->linked_pages);
+	pview->linked_pages = NULL;
+
+	link_mapping = pview->page_cache ?
+		ev_page_cache_get_link_mapping (pview->page_cache, pview->current_page) : NULL;
+	if (!link_mapping)
+		return;
+
+	for (l = ev_mapping_list_get_list (link_mapping); l; l = g_list_next (l)) {
+		EvMapping *mapping = (EvMapping *)l->data;
+		gint       page;
+
+		page = ev_view_presentation_get_link_dest_page (pview, EV_LINK (mapping->data));
+		if (page < 0 || page == pview->current_page ||
+		    g_list_find (pview->linked_pages, GINT_TO_POINTER (page)))
+			continue;
+
+		pview->linked_pages = g_list_prepend (pview->linked_pages,
+						      GINT_TO_POINTER (page));
+	}
+
+	pview->linked_pages = g_list_reverse (pview->linked_pages);
+}
+
+static void
+page_cached_cb (EvPageCache        *page_cache,
+		gint                page,
+		EvViewPresentation *pview)
+{
+	if (page != pview->current_page)
+		return;
+
+	ev_view_presentation_update_linked_pages (pview);
+	if (pview->linked_pages)
+		ev_view_presentation_update_slides (pview);
+}
+
+static void
+ev_view_presentation_update_current_page (EvViewPresentation *pview,
+					  guint               page)
+{
+	if (page < 0 || page >= ev_document_get_n_pages (pview->document))
+		return;
+
+	ev_view_presentation_animation_cancel (pview);
+	ev_view_presentation_animation_start (pview, page);
+
 	if (pview->current_page != page) {
+		pview->direction = page > pview->current_page ? 1 : -1;
 		pview->current_page = page;
 		g_object_notify (G_OBJECT (pview), "current-page");
 	}
@@ -496,6 +625,9 @@ ev_view_presentation_update_current_page (EvViewPresentation *pview,
 	if (pview->page_cache)
 		ev_page_cache_set_page_range (pview->page_cache, page, page);
 
+	ev_view_presentation_update_linked_pages (pview);
+	ev_view_presentation_update_slides (pview);
+
 	if (pview->cursor != EV_VIEW_CURSOR_HIDDEN) {
 		gint x, y;
 
@@ -503,7 +635,7 @@ ev_view_presentation_update_current_page (EvViewPresentation *pview,
 		ev_view_presentation_set_cursor_for_location (pview, x, y);
 	}
 
-	if (EV_JOB_RENDER (pview->curr_job)->surface)
+	if (ev_view_presentation_get_slide_surface (pview, page))
 		gtk_widget_queue_draw (GTK_WIDGET (pview));
 }
 
@@ -968,6 +1100,9 @@ ev_view_presentation_dispose (GObject *object)
 	ev_view_presentation_transition_stop (pview);
 	ev_view_presentation_hide_cursor_timeout_stop (pview);
         ev_view_presentation_reset_jobs (pview);
+	g_clear_pointer (&pview->slide_jobs, g_free);
+	g_list_free (pview->linked_pages);
+	pview->linked_pages = NULL;
 
 	if (pview->current_surface) {
 		cairo_surface_destroy (pview->current_surface);
@@ -975,6 +1110,9 @@ ev_view_presentation_dispose (GObject *object)
 	}
 
 	if (pview->page_cache) {
+		g_signal_handlers_disconnect_by_func (pview->page_cache,
+						      page_cached_cb,
+						      pview);
 		g_object_unref (pview->page_cache);
 		pview->page_cache = NULL;
 	}
@@ -1078,7 +1216,7 @@ ev_view_presentation_draw (GtkWidget *widget,
 		return TRUE;
 	}
 
-	surface = pview->curr_job ? EV_JOB_RENDER (pview->curr_job)->surface : NULL;
+	surface = ev_view_presentation_get_slide_surface (pview, pview->current_page);
 	if (surface) {
 		ev_view_presentation_update_current_surface (pview, surface);
 	} else if (pview->current_surface) {
@@ -1414,6 +1552,9 @@ ev_view_presentation_constructor (GType                  type,
 	if (EV_IS_DOCUMENT_LINKS (pview->document)) {
 		pview->page_cache = ev_page_cache_new (pview->document);
 		ev_page_cache_set_flags (pview->page_cache, EV_PAGE_DATA_INCLUDE_LINKS);
+		g_signal_connect (pview->page_cache, "page-cached",
+				  G_CALLBACK (page_cached_cb),
+				  pview);
 	}
 
 	return object;
@@ -1556,6 +1697,9 @@ ev_view_presentation_init (EvViewPresentation *pview)
 {
 	gtk_widget_set_can_focus (GTK_WIDGET (pview), TRUE);
         pview->is_constructing = TRUE;
+	pview->direction = 1;
+	pview->lookahead = DEFAULT_LOOKAHEAD;
+	pview->page_cache_size = DEFAULT_PAGE_CACHE_SIZE;
 }
 
 GtkWidget *
@@ -1608,3 +1752,52 @@ ev_view_presentation_get_rotation (EvViewPresentation *pview)
 {
         return pview->rotation;
 }
+
+/**
+ * ev_view_presentation_set_lookahead:
+ * @pview: a #EvViewPresentation
+ * @n_slides: the number of slides
+ *
+ * Sets the number of slides that are rendered in advance in both
+ * directions from the current one, as long as they fit in the
+ * cache size set with ev_view_presentation_set_page_cache_size().
+ *
+ * Since: 3.10
+ */
+void
+ev_view_presentation_set_lookahead (EvViewPresentation *pview,
+				    guint               n_slides)
+{
+	g_return_if_fail (EV_IS_VIEW_PRESENTATION (pview));
+
+	if (pview->lookahead == n_slides)
+		return;
+
+	pview->lookahead = n_slides;
+	if (pview->slide_jobs)
+		ev_view_presentation_update_slides (pview);
+}
+
+/**
+ * ev_view_presentation_set_page_cache_size:
+ * @pview: a #EvViewPresentation
+ * @cache_size: size in bytes
+ *
+ * Sets the maximum memory used by the slides rendered in advance.
+ * The current slide and its immediate neighbours are always rendered.
+ *
+ * Since: 3.10
+ */
+void
+ev_view_presentation_set_page_cache_size (EvViewPresentation *pview,
+					  gsize               cache_size)
+{
+	g_return_if_fail (EV_IS_VIEW_PRESENTATION (pview));
+
+	if (pview->page_cache_size == cache_size)
+		return;
+
+	pview->page_cache_size = cache_size;
+	if (pview->slide_jobs)
+		ev_view_presentation_update_slides (pview);
+}
@@ -50,6 +50,10 @@ void            ev_view_presentation_previous_page    (EvViewPresentation *pview
 void            ev_view_presentation_set_rotation     (EvViewPresentation *pview,
                                                        gint                rotation);
 guint           ev_view_presentation_get_rotation     (EvViewPresentation *pview);
+void            ev_view_presentation_set_lookahead    (EvViewPresentation *pview,
+                                                       guint               n_slides);
+void            ev_view_presentation_set_page_cache_size (EvViewPresentation *pview,
+                                                          gsize               cache_size);
 
 G_END_DECLS
 
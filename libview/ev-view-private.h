@@ -101,10 +101,14 @@ typedef enum {
 } PendingScroll;
 
 typedef struct _EvHeightToPageCache {
-	gint rotation;
-	gboolean dual_even_left;
-	gdouble *height_to_page;
-	gdouble *dual_height_to_page;
+	gint n_pages;
+	gboolean uniform;
+	gdouble uniform_width;
+	gdouble uniform_height;
+	/* Built on demand, indexed by whether the rotation swaps the
+	 * page dimensions and, for dual pages, by dual_even_left */
+	gdouble *height_to_page[2];
+	gdouble *dual_height_to_page[2][2];
 } EvHeightToPageCache;
 
 struct _EvView {
@@ -189,6 +193,9 @@ struct _EvView {
 	guint selection_scroll_id;
 
 	SelectionInfo selection_info;
+	EvJob *copy_job;
+	GtkClipboard *copy_clipboard;
+	guint32 copy_time;
 
 	/* Copy link address selection */
 	EvLinkAction *link_selected;
@@ -36,6 +36,7 @@
 #include "ev-document-misc.h"
 #include "ev-pixbuf-cache.h"
 #include "ev-page-cache.h"
+#include "ev-job-scheduler.h"
 #include "ev-view-marshal.h"
 #include "ev-document-annotations.h"
 #include "ev-annotation-window.h"
@@ -60,6 +61,7 @@ enum {
 	SIGNAL_LAYERS_CHANGED,
 	SIGNAL_MOVE_CURSOR,
 	SIGNAL_CURSOR_MOVED,
+	SIGNAL_COPY_PROGRESS,
 	N_SIGNALS
 };
 
@@ -105,6 +107,9 @@ typedef struct {
 
 #define SCROLL_TIME 150
 
+/* Selections spanning more pages are copied in a job */
+#define COPY_SYNC_MAX_PAGES 20
+
 #define DEFAULT_PIXBUF_CACHE_SIZE 52428800 /* 50MB */
 
 #define EV_STYLE_CLASS_DOCUMENT_PAGE "document-page"
@@ -287,6 +292,7 @@ static void       ev_view_primary_get_cb                     (GtkClipboard
 static void       ev_view_primary_clear_cb                   (GtkClipboard       *clipboard,
 							      gpointer            data);
 static void       ev_view_update_primary_selection           (EvView             *ev_view);
+static void       ev_view_copy_cancel                        (EvView             *view);
 
 G_DEFINE_TYPE_WITH_CODE (EvView, ev_view, GTK_TYPE_CONTAINER,
 			 G_IMPLEMENT_INTERFACE (GTK_TYPE_SCROLLABLE, NULL))
@@ -294,109 +300,109 @@ G_DEFINE_TYPE_WITH_CODE (EvView, ev_view, GTK_TYPE_CONTAINER,
 /* HeightToPage cache */
 #define EV_HEIGHT_TO_PAGE_CACHE_KEY "ev-height-to-page-cache"
 
+static gdouble
+get_page_height (EvDocument *document,
+		 gint        page,
+		 gboolean    swap)
+{
+	gdouble w, h;
+
+	ev_document_get_page_size (document, page, &w, &h);
+
+	return swap ? w : h;
+}
+
 static void
 ev_view_build_height_to_page_cache (EvView		*view,
                                     EvHeightToPageCache *cache)
 {
-	gboolean swap, uniform;
-	int i;
-	double uniform_height, page_height, next_page_height;
-	double saved_height;
-	gdouble u_width, u_height;
-	gint n_pages;
 	EvDocument *document = view->document;
 
-	swap = (view->rotation == 90 || view->rotation == 270);
-
-	uniform = ev_document_is_page_size_uniform (document);
-	n_pages = ev_document_get_n_pages (document);
-
-	g_free (cache->height_to_page);
-	g_free (cache->dual_height_to_page);
-
-	cache->rotation = view->rotation;
-	cache->dual_even_left = view->dual_even_left;
-	cache->height_to_page = g_new0 (gdouble, n_pages + 1);
-	cache->dual_height_to_page = g_new0 (gdouble, n_pages + 2);
+	cache->n_pages = ev_document_get_n_pages (document);
+	cache->uniform = ev_document_is_page_size_uniform (document);
+	if (cache->uniform)
+		ev_document_get_page_size (document, 0,
+					   &cache->uniform_width,
+					   &cache->uniform_height);
+}
 
-	if (uniform)
-		ev_document_get_page_size (document, 0, &u_width, &u_height);
+/* Prefix sums of the page heights, for the pages laid out with or
+ * without their dimensions swapped by the rotation */
+static gdouble *
+ev_height_to_page_cache_get_heights (EvHeightToPageCache *cache,
+				     EvDocument          *document,
+				     gboolean             swap)
+{
+	gdouble saved_height = 0;
+	gdouble *heights;
+	gint i;
 
-	saved_height = 0;
-	for (i = 0; i <= n_pages; i++) {
-		if (uniform) {
-			uniform_height = swap ? u_width : u_height;
-			cache->height_to_page[i] = i * uniform_height;
-		} else {
-			if (i < n_pages) {
-				gdouble w, h;
+	if (cache->height_to_page[swap])
+		return cache->height_to_page[swap];
 
-				ev_document_get_page_size (document, i, &w, &h);
-				page_height = swap ? w : h;
-			} else {
-				page_height = 0;
-			}
-			cache->height_to_page[i] = saved_height;
-			saved_height += page_height;
-		}
+	heights = g_new (gdouble, cache->n_pages + 1);
+	for (i = 0; i < cache->n_pages; i++) {
+		heights[i] = saved_height;
+		saved_height += get_page_height (document, i, swap);
 	}
+	heights[cache->n_pages] = saved_height;
 
-	if (cache->dual_even_left && !uniform) {
-		gdouble w, h;
+	cache->height_to_page[swap] = heights;
 
-		ev_document_get_page_size (document, 0, &w, &h);
-		saved_height = swap ? w : h;
-	} else {
-		saved_height = 0;
-	}
+	return heights;
+}
 
-	for (i = cache->dual_even_left; i < n_pages + 2; i += 2) {
-    		if (uniform) {
-			uniform_height = swap ? u_width : u_height;
-			cache->dual_height_to_page[i] = ((i + cache->dual_even_left) / 2) * uniform_height;
-			if (i + 1 < n_pages + 2)
-				cache->dual_height_to_page[i + 1] = ((i + cache->dual_even_left) / 2) * uniform_height;
-		} else {
-			if (i + 1 < n_pages) {
-				gdouble w, h;
+/* Same as above for rows of two pages, starting with a single page
+ * row when the first page is shown on the right */
+static gdouble *
+ev_height_to_page_cache_get_dual_heights (EvHeightToPageCache *cache,
+					  EvDocument          *document,
+					  gboolean             swap,
+					  gboolean             dual_even_left)
+{
+	gdouble saved_height;
+	gdouble page_height, next_page_height;
+	gdouble *heights;
+	gint n_pages = cache->n_pages;
+	gint i;
 
-				ev_document_get_page_size (document, i + 1, &w, &h);
-				next_page_height = swap ? w : h;
-			} else {
-				next_page_height = 0;
-			}
+	if (cache->dual_height_to_page[swap][dual_even_left])
+		return cache->dual_height_to_page[swap][dual_even_left];
 
-			if (i < n_pages) {
-				gdouble w, h;
+	heights = g_new0 (gdouble, n_pages + 2);
 
-				ev_document_get_page_size (document, i, &w, &h);
-				page_height = swap ? w : h;
-			} else {
-				page_height = 0;
-			}
+	if (dual_even_left)
+		saved_height = get_page_height (document, 0, swap);
+	else
+		saved_height = 0;
 
-			if (i + 1 < n_pages + 2) {
-				cache->dual_height_to_page[i] = saved_height;
-				cache->dual_height_to_page[i + 1] = saved_height;
-				saved_height += MAX(page_height, next_page_height);
-			} else {
-				cache->dual_height_to_page[i] = saved_height;
-			}
+	for (i = dual_even_left; i < n_pages + 2; i += 2) {
+		next_page_height = i + 1 < n_pages ? get_page_height (document, i + 1, swap) : 0;
+		page_height = i < n_pages ? get_page_height (document, i, swap) : 0;
+
+		if (i + 1 < n_pages + 2) {
+			heights[i] = saved_height;
+			heights[i + 1] = saved_height;
+			saved_height += MAX(page_height, next_page_height);
+		} else {
+			heights[i] = saved_height;
 		}
 	}
+
+	cache->dual_height_to_page[swap][dual_even_left] = heights;
+
+	return heights;
 }
 
 static void
 ev_height_to_page_cache_free (EvHeightToPageCache *cache)
 {
-	if (cache->height_to_page) {
-		g_free (cache->height_to_page);
-		cache->height_to_page = NULL;
-	}
+	gint i;
 
-	if (cache->dual_height_to_page) {
-		g_free (cache->dual_height_to_page);
-		cache->dual_height_to_page = NULL;
+	for (i = 0; i < 2; i++) {
+		g_free (cache->height_to_page[i]);
+		g_free (cache->dual_height_to_page[i][0]);
+		g_free (cache->dual_height_to_page[i][1]);
 	}
 	g_free (cache);
 }
@@ -429,24 +435,32 @@ ev_view_get_height_to_page (EvView *view,
 			    gint   *dual_height)
 {
 	EvHeightToPageCache *cache = NULL;
+	gboolean swap, dual_even_left;
 	gdouble h, dh;
 
 	if (!view->height_to_page_cache)
 		return;
 
 	cache = view->height_to_page_cache;
-	if (cache->rotation != view->rotation ||
-	    cache->dual_even_left != view->dual_even_left) {
-		ev_view_build_height_to_page_cache (view, cache);
-	}
-	h = cache->height_to_page[page];
-	dh = cache->dual_height_to_page[page];
+	swap = (view->rotation == 90 || view->rotation == 270);
+	dual_even_left = view->dual_even_left ? 1 : 0;
 
-	if (height)
+	if (height) {
+		if (cache->uniform)
+			h = page * (swap ? cache->uniform_width : cache->uniform_height);
+		else
+			h = ev_height_to_page_cache_get_heights (cache, view->document, swap)[page];
 		*height = (gint)(h * view->scale + 0.5);
+	}
 
-	if (dual_height)
+	if (dual_height) {
+		if (cache->uniform)
+			dh = ((page + dual_even_left) / 2) * (swap ? cache->uniform_width : cache->uniform_height);
+		else
+			dh = ev_height_to_page_cache_get_dual_heights (cache, view->document,
+								       swap, dual_even_left)[page];
 		*dual_height = (gint)(dh * view->scale + 0.5);
+	}
 }
 
 static gint
@@ -675,6 +689,29 @@ ev_view_set_adjustment_values (EvView         *view,
 	gtk_adjustment_changed (adjustment);
 }
 
+/* Returns the last page whose top is above @y, binary searching the
+ * offsets from the height to page cache */
+static gint
+find_page_at_y_offset (EvView *view,
+		       gint    y)
+{
+	gint low = 0;
+	gint high = ev_document_get_n_pages (view->document) - 1;
+
+	while (low < high) {
+		gint mid = low + (high - low + 1) / 2;
+		gint offset;
+
+		get_page_y_offset (view, mid, &offset);
+		if (offset <= y)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+
+	return low;
+}
+
 static void
 view_update_range_and_current_page (EvView *view)
 {
@@ -692,6 +729,7 @@ view_update_range_and_current_page (EvView *view)
 		gboolean found = FALSE;
 		gint area_max = -1, area;
 		gint best_current_page = -1;
+		gint n_pages;
 		int i, j = 0;
 
 		if (!(view->vadjustment && view->hadjustment))
@@ -702,10 +740,19 @@ view_update_range_and_current_page (EvView *view)
 		current_area.y = gtk_adjustment_get_value (view->vadjustment);
 		current_area.height = gtk_adjustment_get_page_size (view->vadjustment);
 
-		for (i = 0; i < ev_document_get_n_pages (view->document); i++) {
+		/* Pages are laid out top to bottom, so start right above the
+		 * first page that can be visible; going back one more row
+		 * accounts for page heights and offsets being rounded apart */
+		n_pages = ev_document_get_n_pages (view->document);
+		i = MAX (0, find_page_at_y_offset (view, current_area.y) - 2);
+
+		for (; i < n_pages; i++) {
 
 			ev_view_get_page_extents (view, i, &page_area, &border);
 
+			if (page_area.y >= current_area.y + current_area.height)
+				break;
+
 			if (gdk_rectangle_intersect (&current_area, &page_area, &unused)) {
 				area = unused.width * unused.height;
 
@@ -1256,6 +1303,34 @@ ev_view_get_page_extents (EvView       *view,
 	return TRUE;
 }
 
+/**
+ * ev_view_get_page_surface:
+ * @view: an #EvView
+ * @page: the page index
+ * @rotation: the rotation the rendering must have
+ *
+ * Returns the rendering of @page currently cached by @view, at the view's
+ * scale, if any and if the view is rotated by @rotation. Colors are
+ * inverted when the model has inverted colors. The surface is modified
+ * by @view, so it must only be used from the main thread, and callers
+ * that keep it must reference it.
+ *
+ * Returns: (transfer none): a #cairo_surface_t, or %NULL
+ */
+cairo_surface_t *
+ev_view_get_page_surface (EvView *view,
+			  gint    page,
+			  gint    rotation)
+{
+	g_return_val_if_fail (EV_IS_VIEW (view), NULL);
+
+	/* The view may not have been notified of a new rotation yet */
+	if (!view->pixbuf_cache || view->rotation != rotation)
+		return NULL;
+
+	return ev_pixbuf_cache_get_surface (view->pixbuf_cache, page);
+}
+
 static void
 get_doc_page_size (EvView  *view,
 		   gint     page,
@@ -4766,9 +4841,13 @@ ev_view_motion_notify_event (GtkWidget      *widget,
 		 * handling any selection events in the motion could be slower	
 		 * than new motion events reach us.  We always put it in the	
 		 * idle to make sure we catch up and don't visibly lag the	
-		 * mouse. */
+		 * mouse. The idle runs before the redraw, so that the
+		 * frame shows the selection for the latest motion. */
 		if (!view->selection_update_id)
-			view->selection_update_id = g_idle_add ((GSourceFunc)selection_update_idle_cb, view);
+			view->selection_update_id =
+				g_idle_add_full (GDK_PRIORITY_REDRAW - 1,
+						 (GSourceFunc)selection_update_idle_cb,
+						 view, NULL);
 
 		return TRUE;
 	case 2:
@@ -4888,6 +4967,9 @@ ev_view_button_release_event (GtkWidget      *widget,
 	if (view->selection_scroll_id) {
 	    g_source_remove (view->selection_scroll_id);
 	    view->selection_scroll_id = 0;
+
+	    /* Render the selected text now that the selection is done */
+	    gtk_widget_queue_draw (widget);
 	}
 	if (view->selection_update_id) {
 	    g_source_remove (view->selection_update_id);
@@ -5762,13 +5844,19 @@ draw_one_page (EvView       *view,
 		if (!find_selection_for_page (view, page))
 			return;
 
-		selection_surface = ev_pixbuf_cache_get_selection_surface (view->pixbuf_cache,
-									   page,
-									   view->scale);
-		if (selection_surface) {
-			draw_surface (cr, selection_surface, overlap.x, overlap.y, offset_x, offset_y,
-				      width, height);
-			return;
+		/* While the pointer is extending the selection only the
+		 * highlighted region is drawn, rendering the selected text
+		 * again for the whole page on every motion is too slow.
+		 */
+		if (!view->selection_scroll_id) {
+			selection_surface = ev_pixbuf_cache_get_selection_surface (view->pixbuf_cache,
+										   page,
+										   view->scale);
+			if (selection_surface) {
+				draw_surface (cr, selection_surface, overlap.x, overlap.y, offset_x, offset_y,
+					      width, height);
+				return;
+			}
 		}
 
 		region = ev_pixbuf_cache_get_selection_region (view->pixbuf_cache,
@@ -5839,6 +5927,7 @@ ev_view_dispose (GObject *object)
 	}
 
 	ev_view_find_cancel (view);
+	ev_view_copy_cancel (view);
 
 	ev_view_window_children_free (view);
 
@@ -6238,6 +6327,23 @@ ev_view_class_init (EvViewClass *class)
 		         G_TYPE_NONE, 2,
 		         G_TYPE_INT,
 			 G_TYPE_INT);
+	/**
+	 * EvView::copy-progress:
+	 * @view: the #EvView
+	 * @fraction: the fraction of the selection copied so far
+	 *
+	 * Emitted while the text of a long selection is being copied to the
+	 * clipboard in the background. @fraction is 1.0 once the copy is
+	 * over, whether it completed or was cancelled.
+	 */
+	signals[SIGNAL_COPY_PROGRESS] = g_signal_new ("copy-progress",
+			 G_TYPE_FROM_CLASS (object_class),
+			 G_SIGNAL_RUN_LAST,
+		         0,
+		         NULL, NULL,
+		         g_cclosure_marshal_VOID__DOUBLE,
+		         G_TYPE_NONE, 1,
+		         G_TYPE_DOUBLE);
 
 	binding_set = gtk_binding_set_by_class (class);
 
@@ -6625,6 +6731,7 @@ ev_view_document_changed_cb (EvDocumentModel *model,
 		gint current_page;
 
 		ev_view_remove_all (view);
+		ev_view_copy_cancel (view);
 		clear_caches (view);
 
 		if (view->document) {
@@ -7425,6 +7532,30 @@ gdk_point_equal (GdkPoint *a,
 	return a->x == b->x && a->y == b->y;
 }
 
+static gint
+get_selection_page_at_point (EvView   *view,
+			     GdkPoint *point,
+			     gint      start_page,
+			     gint      end_page)
+{
+	gint i;
+
+	for (i = start_page; i <= end_page; i++) {
+		GdkRectangle page_area;
+		GtkBorder    border;
+
+		ev_view_get_page_extents (view, i, &page_area, &border);
+		page_area.x -= border.left;
+		page_area.y -= border.top;
+		page_area.width += border.left + border.right;
+		page_area.height += border.top + border.bottom;
+		if (gdk_rectangle_point_in (&page_area, point))
+			return i;
+	}
+
+	return -1;
+}
+
 static gboolean
 get_selection_page_range (EvView          *view,
 			  EvSelectionStyle style,
@@ -7433,53 +7564,51 @@ get_selection_page_range (EvView          *view,
 			  gint            *first_page,
 			  gint            *last_page)
 {
-	gint start_page, end_page;
+	gint start_first, start_last;
+	gint stop_first, stop_last;
 	gint first, last;
-	gint i, n_pages;
+	gint n_pages;
 
 	n_pages = ev_document_get_n_pages (view->document);
 
 	if (gdk_point_equal (start, stop)) {
-		start_page = view->start_page;
-		end_page = view->end_page;
+		start_first = stop_first = view->start_page;
+		start_last = stop_last = view->end_page;
 	} else if (view->continuous) {
-		start_page = 0;
-		end_page = n_pages - 1;
+		gint page;
+
+		/* Only the rows around each point can contain it, so
+		 * don't walk the whole document on every motion. */
+		page = find_page_at_y_offset (view, start->y);
+		start_first = MAX (0, page - 2);
+		start_last = MIN (n_pages - 1, page + 2);
+
+		page = find_page_at_y_offset (view, stop->y);
+		stop_first = MAX (0, page - 2);
+		stop_last = MIN (n_pages - 1, page + 2);
 	} else if (is_dual_page (view, NULL)) {
-		start_page = view->start_page;
-		end_page = view->end_page;
+		start_first = stop_first = view->start_page;
+		start_last = stop_last = view->end_page;
 	} else {
-		start_page = view->current_page;
-		end_page = view->current_page;
+		start_first = stop_first = view->current_page;
+		start_last = stop_last = view->current_page;
 	}
 
-	first = -1;
-	last = -1;
-	for (i = start_page; i <= end_page; i++) {
-		GdkRectangle page_area;
-		GtkBorder    border;
+	first = get_selection_page_at_point (view, start, start_first, start_last);
+	last = get_selection_page_at_point (view, stop, stop_first, stop_last);
 
-		ev_view_get_page_extents (view, i, &page_area, &border);
-		page_area.x -= border.left;
-		page_area.y -= border.top;
-		page_area.width += border.left + border.right;
-		page_area.height += border.top + border.bottom;
-		if (gdk_rectangle_point_in (&page_area, start) ||
-		    gdk_rectangle_point_in (&page_area, stop)) {
-			if (first == -1)
-				first = i;
-			last = i;
-		}
-	}
+	if (first == -1 && last == -1)
+		return FALSE;
 
-	if (first != -1 && last != -1) {
-		*first_page = first;
-		*last_page = last;
+	if (first == -1)
+		first = last;
+	else if (last == -1)
+		last = first;
 
-		return TRUE;
-	}
+	*first_page = MIN (first, last);
+	*last_page = MAX (first, last);
 
-	return FALSE;
+	return TRUE;
 }
 
 static GList *
@@ -7789,14 +7918,106 @@ ev_view_clipboard_copy (EvView      *view,
 	gtk_clipboard_set_text (clipboard, text, -1);
 }
 
+static void
+ev_view_copy_clear (EvView *view)
+{
+	g_signal_handlers_disconnect_by_data (view->copy_job, view);
+	g_object_unref (view->copy_job);
+	view->copy_job = NULL;
+
+	g_signal_handlers_disconnect_by_data (view->copy_clipboard, view);
+	view->copy_clipboard = NULL;
+
+	g_signal_emit (view, signals[SIGNAL_COPY_PROGRESS], 0, 1.0);
+}
+
+static void
+ev_view_copy_cancel (EvView *view)
+{
+	if (!view->copy_job)
+		return;
+
+	ev_job_cancel (view->copy_job);
+	ev_view_copy_clear (view);
+}
+
+static void
+copy_job_updated_cb (EvJobCopy *job,
+		     gdouble    progress,
+		     EvView    *view)
+{
+	g_signal_emit (view, signals[SIGNAL_COPY_PROGRESS], 0, progress);
+}
+
+static void
+copy_job_finished_cb (EvJobCopy *job,
+		      EvView    *view)
+{
+	ev_view_clipboard_copy (view, ev_job_copy_get_text (job));
+	ev_view_copy_clear (view);
+}
+
+/* Somebody else copied something while the text of the selection was
+ * being extracted, putting it on the clipboard would overwrite that.
+ */
+static void
+copy_clipboard_owner_change_cb (GtkClipboard        *clipboard,
+				GdkEventOwnerChange *event,
+				EvView              *view)
+{
+	/* Late notification of a previous copy */
+	if (event->selection_time != GDK_CURRENT_TIME &&
+	    view->copy_time != GDK_CURRENT_TIME &&
+	    event->selection_time <= view->copy_time)
+		return;
+
+	ev_view_copy_cancel (view);
+}
+
 void
 ev_view_copy (EvView *ev_view)
 {
-	char *text;
+	GList *l;
+	char  *text;
 
 	if (!EV_IS_SELECTION (ev_view->document))
 		return;
 
+	ev_view_copy_cancel (ev_view);
+
+	/* Extracting the text of a long selection (think select all on
+	 * a book) would block the UI, so it's done in the job thread and
+	 * the clipboard is filled when it's ready. */
+	if (g_list_length (ev_view->selection_info.selections) > COPY_SYNC_MAX_PAGES) {
+		ev_view->copy_job = ev_job_copy_new (ev_view->document);
+		for (l = ev_view->selection_info.selections; l; l = g_list_next (l)) {
+			EvViewSelection *selection = (EvViewSelection *)l->data;
+
+			ev_job_copy_add_selection (EV_JOB_COPY (ev_view->copy_job),
+						   selection->page,
+						   selection->style,
+						   &selection->rect);
+		}
+		g_signal_connect (ev_view->copy_job, "updated",
+				  G_CALLBACK (copy_job_updated_cb),
+				  ev_view);
+		g_signal_connect (ev_view->copy_job, "finished",
+				  G_CALLBACK (copy_job_finished_cb),
+				  ev_view);
+
+		ev_view->copy_time = gtk_get_current_event_time ();
+		ev_view->copy_clipboard = gtk_widget_get_clipboard (GTK_WIDGET (ev_view),
+								    GDK_SELECTION_CLIPBOARD);
+		g_signal_connect (ev_view->copy_clipboard, "owner-change",
+				  G_CALLBACK (copy_clipboard_owner_change_cb),
+				  ev_view);
+
+		ev_job_scheduler_push_job (ev_view->copy_job, EV_JOB_PRIORITY_LOW);
+		g_signal_emit (ev_view, signals[SIGNAL_COPY_PROGRESS], 0, 0.0);
+
+		return;
+	}
+
 	text = get_selected_text (ev_view);
 	ev_view_clipboard_copy (ev_view, text);
 	g_free (text);
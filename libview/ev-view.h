@@ -108,6 +108,9 @@ gboolean       ev_view_get_page_extents   (EvView       *view,
                                            gint          page,
                                            GdkRectangle *page_area,
                                            GtkBorder    *border);
+cairo_surface_t *ev_view_get_page_surface (EvView       *view,
+                                          gint          page,
+                                          gint          rotation);
 /* Annotations */
 void           ev_view_focus_annotation      (EvView          *view,
 					      EvMapping       *annot_mapping);
@@ -263,12 +263,12 @@ sanitized_substring (const gchar  *text,
 }
 
 static gchar *
-get_surrounding_text_markup (const gchar  *text,
-                             const gchar  *find_text,
-                             gboolean      case_sensitive,
-                             PangoLogAttr *log_attrs,
-                             gint          log_attrs_length,
-                             gint          offset)
+get_surrounding_text_markup (const gchar        *text,
+                             const gchar        *find_text,
+                             gboolean            case_sensitive,
+                             const PangoLogAttr *log_attrs,
+                             gint                log_attrs_length,
+                             gint                offset)
 {
         gint   iter;
         gchar *prec = NULL;
@@ -313,33 +313,26 @@ get_surrounding_text_markup (const gchar  *text,
         return markup;
 }
 
-static gchar *
-get_page_text (EvDocument   *document,
-               EvPage       *page,
-               EvRectangle **areas,
-               guint        *n_areas)
+/* The page text is shared with the view page cache, so it's only
+ * extracted again when the view doesn't hold it */
+static EvPageText *
+get_page_text (EvDocument *document,
+               EvPage     *page)
 {
-        gchar   *text;
-        gboolean success;
+        EvPageText *page_text;
 
         ev_document_doc_mutex_lock ();
-        text = ev_document_text_get_text (EV_DOCUMENT_TEXT (document), page);
-        success = ev_document_text_get_text_layout (EV_DOCUMENT_TEXT (document), page, areas, n_areas);
+        page_text = ev_page_text_get (document, page);
         ev_document_doc_mutex_unlock ();
 
-        if (!success) {
-                g_free (text);
-                return NULL;
-        }
-
-        return text;
+        return page_text;
 }
 
 static gint
-get_match_offset (EvRectangle *areas,
-                  guint        n_areas,
-                  EvRectangle *match,
-                  gint         offset)
+get_match_offset (const EvRectangle *areas,
+                  guint              n_areas,
+                  EvRectangle       *match,
+                  gint               offset)
 {
         gdouble x, y;
         gint i;
@@ -350,7 +343,7 @@ get_match_offset (EvRectangle *areas,
         i = offset;
 
         do {
-                EvRectangle *area = areas + i;
+                const EvRectangle *area = areas + i;
 
                 if (x >= area->x1 && x < area->x2 &&
                     y >= area->y1 && y <= area->y2) {
@@ -385,13 +378,14 @@ process_matches_idle (EvFindSidebar *sidebar)
         do {
                 GList        *matches, *l;
                 EvPage       *page;
-                gint          result;
-                gchar        *page_text;
-                EvRectangle  *areas = NULL;
-                guint         n_areas;
-                PangoLogAttr *text_log_attrs;
-                gulong        text_log_attrs_length;
-                gint          offset;
+                gint                result;
+                EvPageText         *page_text;
+                const gchar        *text;
+                const EvRectangle  *areas;
+                guint               n_areas;
+                const PangoLogAttr *text_log_attrs;
+                gulong              text_log_attrs_length;
+                gint                offset;
 
                 current_page = priv->current_page;
                 priv->current_page = (priv->current_page + 1) % priv->job->n_pages;
@@ -401,13 +395,19 @@ process_matches_idle (EvFindSidebar *sidebar)
                         continue;
 
                 page = ev_document_get_page (document, current_page);
-                page_text = get_page_text (document, page, &areas, &n_areas);
+                page_text = get_page_text (document, page);
+                g_object_unref (page);
                 if (!page_text)
                         continue;
 
-                text_log_attrs_length = g_utf8_strlen (page_text, -1);
-                text_log_attrs = g_new0 (PangoLogAttr, text_log_attrs_length + 1);
-                pango_get_log_attrs (page_text, -1, -1, NULL, text_log_attrs, text_log_attrs_length + 1);
+                areas = ev_page_text_get_layout (page_text, &n_areas);
+                if (!areas) {
+                        ev_page_text_unref (page_text);
+                        continue;
+                }
+
+                text = ev_page_text_get_text (page_text);
+                text_log_attrs = ev_page_text_get_log_attrs (page_text, &text_log_attrs_length);
 
                 if (priv->first_match_page == -1)
                         priv->first_match_page = current_page;
@@ -434,7 +434,7 @@ process_matches_idle (EvFindSidebar *sidebar)
                                 priv->insert_position++;
                         }
 
-                        markup = get_surrounding_text_markup (page_text,
+                        markup = get_surrounding_text_markup (text,
                                                               priv->job->text,
                                                               priv->job->case_sensitive,
                                                               text_log_attrs,
@@ -448,9 +448,7 @@ process_matches_idle (EvFindSidebar *sidebar)
                         g_free (markup);
                 }
 
-                g_free (page_text);
-                g_free (text_log_attrs);
-                g_free (areas);
+                ev_page_text_unref (page_text);
         } while (current_page != priv->job_current_page);
 
         if (ev_job_is_finished (EV_JOB (priv->job)) && priv->current_page == priv->job->start_page) {
@@ -47,6 +47,9 @@ struct _EvSidebarLinksPrivate {
 	GtkTreeModel *model;
 	EvDocument *document;
 	EvDocumentModel *doc_model;
+
+	/* Outline entries sorted by destination page */
+	GArray *page_index;
 };
 
 enum {
@@ -152,6 +155,11 @@ ev_sidebar_links_dispose (GObject *object)
 		sidebar->priv->model = NULL;
 	}
 
+	if (sidebar->priv->page_index) {
+		g_array_free (sidebar->priv->page_index, TRUE);
+		sidebar->priv->page_index = NULL;
+	}
+
 	if (sidebar->priv->document) {
 		g_object_unref (sidebar->priv->document);
 		sidebar->priv->document = NULL;
@@ -473,40 +481,35 @@ ev_sidebar_links_new (void)
 	return ev_sidebar_links;
 }
 
-static gboolean
-update_page_callback_foreach (GtkTreeModel *model,
-			      GtkTreePath  *path,
-			      GtkTreeIter  *iter,
-			      gpointer      data)
+static GtkTreePath *
+ev_sidebar_links_find_page (EvSidebarLinks *sidebar_links,
+			    gint            page)
 {
-	EvSidebarLinks *sidebar_links = (data);
-	EvLink *link;
-
-	gtk_tree_model_get (model, iter,
-			    EV_DOCUMENT_LINKS_COLUMN_LINK, &link,
-			    -1);
+	GArray *page_index = sidebar_links->priv->page_index;
+	EvJobLinksPageEntry *entry;
+	guint low = 0;
+	guint high;
+
+	if (!page_index)
+		return NULL;
+
+	high = page_index->len;
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+
+		entry = &g_array_index (page_index, EvJobLinksPageEntry, mid);
+		if (entry->page < page)
+			low = mid + 1;
+		else
+			high = mid;
+	}
 
-	if (link) {
-		int current_page;
-		int dest_page;
-		EvDocumentLinks *document_links = EV_DOCUMENT_LINKS (sidebar_links->priv->document);
+	if (low == page_index->len)
+		return NULL;
 
-		dest_page = ev_document_links_get_link_page (document_links, link);
-		g_object_unref (link);
-		
-		current_page = ev_document_model_get_page (sidebar_links->priv->doc_model);
-			 
-		if (dest_page == current_page) {
-			gtk_tree_view_expand_to_path (GTK_TREE_VIEW (sidebar_links->priv->tree_view),
-						      path);
-			gtk_tree_view_set_cursor (GTK_TREE_VIEW (sidebar_links->priv->tree_view),
-						  path, NULL, FALSE);
-			
-			return TRUE;
-		}
-	}
+	entry = &g_array_index (page_index, EvJobLinksPageEntry, low);
 
-	return FALSE;
+	return entry->page == page ? entry->path : NULL;
 }
 
 static void
@@ -516,6 +519,7 @@ ev_sidebar_links_set_current_page (EvSidebarLinks *sidebar_links,
 	GtkTreeSelection *selection;
 	GtkTreeModel *model;
 	GtkTreeIter iter;
+	GtkTreePath *path;
 
 	/* Widget is not currently visible */
 	if (!gtk_widget_get_mapped (GTK_WIDGET (sidebar_links)))
@@ -541,17 +545,17 @@ ev_sidebar_links_set_current_page (EvSidebarLinks *sidebar_links,
 		}
 	}		
 
-	/* We go through the tree linearly looking for the first page that
-	 * matches.  This is pretty inefficient.  We can do something neat with
-	 * a GtkTreeModelSort here to make it faster, if it turns out to be
-	 * slow.
-	 */
+	path = ev_sidebar_links_find_page (sidebar_links, current_page);
+	if (!path)
+		return;
+
 	g_signal_handler_block (selection, sidebar_links->priv->selection_id);
 	g_signal_handler_block (sidebar_links->priv->tree_view, sidebar_links->priv->row_activated_id);
 
-	gtk_tree_model_foreach (model,
-				update_page_callback_foreach,
-				sidebar_links);
+	gtk_tree_view_expand_to_path (GTK_TREE_VIEW (sidebar_links->priv->tree_view),
+				      path);
+	gtk_tree_view_set_cursor (GTK_TREE_VIEW (sidebar_links->priv->tree_view),
+				  path, NULL, FALSE);
 	
 	g_signal_handler_unblock (selection, sidebar_links->priv->selection_id);
 	g_signal_handler_unblock (sidebar_links->priv->tree_view, sidebar_links->priv->row_activated_id);
@@ -627,6 +631,11 @@ job_finished_callback (EvJobLinks     *job,
 
 	ev_sidebar_links_set_links_model (sidebar_links, job->model);
 
+	if (priv->page_index)
+		g_array_free (priv->page_index, TRUE);
+	priv->page_index = job->page_index;
+	job->page_index = NULL;
+
 	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), job->model);
 	
 	g_object_unref (job);
@@ -677,6 +686,11 @@ ev_sidebar_links_document_changed_cb (EvDocumentModel *model,
 		g_object_unref (priv->document);
 	}
 
+	if (priv->page_index) {
+		g_array_free (priv->page_index, TRUE);
+		priv->page_index = NULL;
+	}
+
 	priv->document = g_object_ref (document);
 
 	if (priv->job) {
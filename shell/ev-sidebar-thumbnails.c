@@ -35,6 +35,7 @@
 #include "ev-job-scheduler.h"
 #include "ev-sidebar-page.h"
 #include "ev-sidebar-thumbnails.h"
+#include "ev-thumbnails-cache.h"
 #include "ev-utils.h"
 #include "ev-window.h"
 
@@ -44,6 +45,11 @@
  * limit its use */
 #define MAX_ICON_VIEW_PAGE_COUNT 1500
 
+/* While scrolling faster than this (in pixels per second) no thumbnail jobs
+ * are queued; the visible range is rendered once scrolling settles */
+#define FAST_SCROLL_VELOCITY 2500.0
+#define SCROLL_SETTLE_TIMEOUT 150
+
 typedef struct _EvThumbsSize
 {
 	gint width;
@@ -66,7 +72,10 @@ struct _EvSidebarThumbnailsPrivate {
 	GHashTable *loading_icons;
 	EvDocument *document;
 	EvDocumentModel *model;
+	EvView *view;
 	EvThumbsSizeCache *size_cache;
+	EvThumbnailsCache *thumbnails_cache;
+	GCancellable *thumbnails_cache_cancellable;
 
 	gint n_pages, pages_done;
 
@@ -75,6 +84,11 @@ struct _EvSidebarThumbnailsPrivate {
 
 	/* Visible pages */
 	gint start_page, end_page;
+
+	/* Scrolling velocity tracking */
+	gdouble last_value;
+	gint64 last_value_time;
+	guint scroll_settle_id;
 };
 
 enum {
@@ -221,12 +235,30 @@ static void
 ev_sidebar_thumbnails_dispose (GObject *object)
 {
 	EvSidebarThumbnails *sidebar_thumbnails = EV_SIDEBAR_THUMBNAILS (object);
+
+	if (sidebar_thumbnails->priv->scroll_settle_id > 0) {
+		g_source_remove (sidebar_thumbnails->priv->scroll_settle_id);
+		sidebar_thumbnails->priv->scroll_settle_id = 0;
+	}
 	
 	if (sidebar_thumbnails->priv->loading_icons) {
 		g_hash_table_destroy (sidebar_thumbnails->priv->loading_icons);
 		sidebar_thumbnails->priv->loading_icons = NULL;
 	}
 	
+	if (sidebar_thumbnails->priv->view) {
+		g_object_remove_weak_pointer (G_OBJECT (sidebar_thumbnails->priv->view),
+					      (gpointer *)&sidebar_thumbnails->priv->view);
+		sidebar_thumbnails->priv->view = NULL;
+	}
+
+	if (sidebar_thumbnails->priv->thumbnails_cache_cancellable) {
+		g_cancellable_cancel (sidebar_thumbnails->priv->thumbnails_cache_cancellable);
+		g_object_unref (sidebar_thumbnails->priv->thumbnails_cache_cancellable);
+		sidebar_thumbnails->priv->thumbnails_cache_cancellable = NULL;
+	}
+	sidebar_thumbnails->priv->thumbnails_cache = NULL;
+
 	if (sidebar_thumbnails->priv->list_store) {
 		ev_sidebar_thumbnails_clear_model (sidebar_thumbnails);
 		g_object_unref (sidebar_thumbnails->priv->list_store);
@@ -302,6 +334,30 @@ ev_sidebar_thumbnails_new (void)
 	return ev_sidebar_thumbnails;
 }
 
+/**
+ * ev_sidebar_thumbnails_set_view:
+ * @sidebar_thumbnails: an #EvSidebarThumbnails
+ * @view: the #EvView showing the same document model
+ *
+ * Pages already rendered by @view are scaled down to create their
+ * thumbnails instead of being rendered again by the backend.
+ */
+void
+ev_sidebar_thumbnails_set_view (EvSidebarThumbnails *sidebar_thumbnails,
+				EvView              *view)
+{
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
+
+	if (priv->view == view)
+		return;
+
+	if (priv->view)
+		g_object_remove_weak_pointer (G_OBJECT (priv->view), (gpointer *)&priv->view);
+	priv->view = view;
+	if (priv->view)
+		g_object_add_weak_pointer (G_OBJECT (priv->view), (gpointer *)&priv->view);
+}
+
 static GdkPixbuf *
 ev_sidebar_thumbnails_get_loading_icon (EvSidebarThumbnails *sidebar_thumbnails,
 					gint                 width,
@@ -393,10 +449,59 @@ get_scale_for_page (EvSidebarThumbnails *sidebar_thumbnails,
 	return (gdouble)THUMBNAIL_WIDTH / width;
 }
 
+static void
+ev_sidebar_thumbnails_set_thumbnail (EvSidebarThumbnails *sidebar_thumbnails,
+				     GtkTreeIter         *iter,
+				     GdkPixbuf           *thumbnail)
+{
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
+	GdkPixbuf                  *pixbuf;
+
+	pixbuf = ev_document_misc_render_thumbnail_with_frame (GTK_WIDGET (sidebar_thumbnails), thumbnail);
+	if (priv->inverted_colors)
+		ev_document_misc_invert_pixbuf (pixbuf);
+	gtk_list_store_set (priv->list_store,
+			    iter,
+			    COLUMN_PIXBUF, pixbuf,
+			    COLUMN_THUMBNAIL_SET, TRUE,
+			    COLUMN_JOB, NULL,
+			    -1);
+	g_object_unref (pixbuf);
+}
+
+/* Scales down the rendering of @page in the main view, if there's one,
+ * instead of rendering the thumbnail again. The view modifies its
+ * surfaces in place, so this must be done here and not in a job.
+ */
+static GdkPixbuf *
+get_view_thumbnail_for_page (EvSidebarThumbnails *sidebar_thumbnails,
+			     gint                 page)
+{
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
+	cairo_surface_t *surface;
+	gint width, height;
+
+	/* View surfaces are already inverted */
+	if (!priv->view || priv->inverted_colors)
+		return NULL;
+
+	surface = ev_view_get_page_surface (priv->view, page, priv->rotation);
+	if (!surface)
+		return NULL;
+
+	ev_thumbnails_size_cache_get_size (priv->size_cache, page,
+					   priv->rotation,
+					   &width, &height);
+
+	/* NULL if the surface is smaller than the thumbnail */
+	return ev_document_misc_pixbuf_from_surface_downscaled (surface, width, height);
+}
+
 static void
 add_range (EvSidebarThumbnails *sidebar_thumbnails,
 	   gint                 start_page,
-	   gint                 end_page)
+	   gint                 end_page,
+	   gboolean             cached_only)
 {
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
 	GtkTreePath *path;
@@ -419,6 +524,33 @@ add_range (EvSidebarThumbnails *sidebar_thumbnails,
 				    -1);
 
 		if (job == NULL && !thumbnail_set) {
+			GdkPixbuf *thumbnail = NULL;
+
+			if (priv->thumbnails_cache)
+				thumbnail = ev_thumbnails_cache_lookup (priv->thumbnails_cache,
+									page, priv->rotation);
+			if (thumbnail) {
+				ev_sidebar_thumbnails_set_thumbnail (sidebar_thumbnails,
+								     &iter, thumbnail);
+				g_object_unref (thumbnail);
+				continue;
+			}
+
+			if (cached_only)
+				continue;
+
+			thumbnail = get_view_thumbnail_for_page (sidebar_thumbnails, page);
+			if (thumbnail) {
+				ev_sidebar_thumbnails_set_thumbnail (sidebar_thumbnails,
+								     &iter, thumbnail);
+				if (priv->thumbnails_cache)
+					ev_thumbnails_cache_store (priv->thumbnails_cache,
+								   page, priv->rotation,
+								   thumbnail);
+				g_object_unref (thumbnail);
+				continue;
+			}
+
 			job = ev_job_thumbnail_new (priv->document,
 						    page, priv->rotation,
 						    get_scale_for_page (sidebar_thumbnails, page));
@@ -447,7 +579,8 @@ add_range (EvSidebarThumbnails *sidebar_thumbnails,
 static void
 update_visible_range (EvSidebarThumbnails *sidebar_thumbnails,
 		      gint                 start_page,
-		      gint                 end_page)
+		      gint                 end_page,
+		      gboolean             cached_only)
 {
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
 	int old_start_page, old_end_page;
@@ -466,12 +599,72 @@ update_visible_range (EvSidebarThumbnails *sidebar_thumbnails,
 	if (old_end_page > 0 && old_end_page > end_page)
 		clear_range (sidebar_thumbnails, MAX (end_page + 1, old_start_page), old_end_page);
 
-	add_range (sidebar_thumbnails, start_page, end_page);
+	add_range (sidebar_thumbnails, start_page, end_page, cached_only);
 	
 	priv->start_page = start_page;
 	priv->end_page = end_page;
 }
 
+static gboolean
+scroll_settled_cb (EvSidebarThumbnails *sidebar_thumbnails)
+{
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
+
+	priv->scroll_settle_id = 0;
+
+	/* Widget is not currently visible */
+	if (!gtk_widget_get_mapped (GTK_WIDGET (sidebar_thumbnails)))
+		return FALSE;
+
+	if (priv->start_page >= 0 && priv->end_page >= priv->start_page)
+		add_range (sidebar_thumbnails, priv->start_page, priv->end_page, FALSE);
+
+	return FALSE;
+}
+
+/* Forgets the last scroll position, so that the next change of the
+ * adjustment isn't taken into account to compute the scrolling speed.
+ * Used when the sidebar is scrolled programmatically.
+ */
+static void
+ev_sidebar_thumbnails_reset_scroll_speed (EvSidebarThumbnails *sidebar_thumbnails)
+{
+	sidebar_thumbnails->priv->last_value = 0;
+	sidebar_thumbnails->priv->last_value_time = 0;
+}
+
+/* Returns whether the sidebar is being scrolled too fast for rendering
+ * thumbnails to be worth it. In that case the visible range is scheduled
+ * to be rendered once scrolling stops.
+ */
+static gboolean
+ev_sidebar_thumbnails_is_scrolling_fast (EvSidebarThumbnails *sidebar_thumbnails,
+					 gdouble              value)
+{
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
+	gint64   now;
+	gdouble  velocity = 0;
+	gboolean fast;
+
+	now = g_get_monotonic_time ();
+	if (priv->last_value_time > 0 && now > priv->last_value_time)
+		velocity = ABS (value - priv->last_value) * G_USEC_PER_SEC / (now - priv->last_value_time);
+	priv->last_value = value;
+	priv->last_value_time = now;
+
+	fast = velocity > FAST_SCROLL_VELOCITY;
+	if (fast) {
+		if (priv->scroll_settle_id > 0)
+			g_source_remove (priv->scroll_settle_id);
+		priv->scroll_settle_id =
+			g_timeout_add (SCROLL_SETTLE_TIMEOUT,
+				       (GSourceFunc)scroll_settled_cb,
+				       sidebar_thumbnails);
+	}
+
+	return fast;
+}
+
 static void
 adjustment_changed_cb (EvSidebarThumbnails *sidebar_thumbnails)
 {
@@ -522,7 +715,8 @@ adjustment_changed_cb (EvSidebarThumbnails *sidebar_thumbnails)
 	if (path && path2) {
 		update_visible_range (sidebar_thumbnails,
 				      gtk_tree_path_get_indices (path)[0],
-				      gtk_tree_path_get_indices (path2)[0]);
+				      gtk_tree_path_get_indices (path2)[0],
+				      ev_sidebar_thumbnails_is_scrolling_fast (sidebar_thumbnails, value));
 	}
 
 	gtk_tree_path_free (path);
@@ -729,6 +923,9 @@ ev_sidebar_thumbnails_set_current_page (EvSidebarThumbnails *sidebar,
 
 	path = gtk_tree_path_new_from_indices (page, -1);
 
+	/* Following the current page is not the user scrolling */
+	ev_sidebar_thumbnails_reset_scroll_speed (sidebar);
+
 	if (sidebar->priv->tree_view) {
 		tree_view = GTK_TREE_VIEW (sidebar->priv->tree_view);
 		gtk_tree_view_set_cursor (tree_view, path, NULL, FALSE);
@@ -819,20 +1016,41 @@ thumbnail_job_completed_callback (EvJobThumbnail      *job,
 {
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
 	GtkTreeIter                *iter;
-        GdkPixbuf                  *pixbuf;
-
-        pixbuf = ev_document_misc_render_thumbnail_with_frame (GTK_WIDGET (sidebar_thumbnails), job->thumbnail);
 
 	iter = (GtkTreeIter *) g_object_get_data (G_OBJECT (job), "tree_iter");
-	if (priv->inverted_colors)
-		ev_document_misc_invert_pixbuf (pixbuf);
-	gtk_list_store_set (priv->list_store,
-			    iter,
-			    COLUMN_PIXBUF, pixbuf,
-			    COLUMN_THUMBNAIL_SET, TRUE,
-			    COLUMN_JOB, NULL,
-			    -1);
-        g_object_unref (pixbuf);
+	ev_sidebar_thumbnails_set_thumbnail (sidebar_thumbnails, iter, job->thumbnail);
+	if (priv->thumbnails_cache)
+		ev_thumbnails_cache_store (priv->thumbnails_cache,
+					   job->page, job->rotation,
+					   job->thumbnail);
+}
+
+static void
+thumbnails_cache_loaded_cb (EvDocument          *document,
+			    GAsyncResult        *result,
+			    EvSidebarThumbnails *sidebar_thumbnails)
+{
+	EvSidebarThumbnailsPrivate *priv;
+	EvThumbnailsCache          *cache;
+	GError                     *error = NULL;
+
+	cache = ev_thumbnails_cache_load_finish (document, result, &error);
+	if (!cache) {
+		/* The sidebar could be gone already */
+		g_error_free (error);
+		return;
+	}
+
+	priv = sidebar_thumbnails->priv;
+	if (document != priv->document)
+		return;
+
+	g_clear_object (&priv->thumbnails_cache_cancellable);
+	priv->thumbnails_cache = cache;
+
+	/* Pages rendered meanwhile are kept, the rest might be cached */
+	if (priv->start_page >= 0 && priv->end_page >= priv->start_page)
+		add_range (sidebar_thumbnails, priv->start_page, priv->end_page, TRUE);
 }
 
 static void
@@ -850,7 +1068,18 @@ ev_sidebar_thumbnails_document_changed_cb (EvDocumentModel     *model,
 
 	priv->size_cache = ev_thumbnails_size_cache_get (document);
 	priv->document = document;
+	priv->thumbnails_cache = NULL;
+	if (priv->thumbnails_cache_cancellable) {
+		g_cancellable_cancel (priv->thumbnails_cache_cancellable);
+		g_object_unref (priv->thumbnails_cache_cancellable);
+	}
+	priv->thumbnails_cache_cancellable = g_cancellable_new ();
+	ev_thumbnails_cache_load_async (document,
+					priv->thumbnails_cache_cancellable,
+					(GAsyncReadyCallback)thumbnails_cache_loaded_cb,
+					sidebar_thumbnails);
 	priv->n_pages = ev_document_get_n_pages (document);
+	ev_sidebar_thumbnails_reset_scroll_speed (sidebar_thumbnails);
 	priv->rotation = ev_document_model_get_rotation (model);
 	priv->inverted_colors = ev_document_model_get_inverted_colors (model);
 	priv->loading_icons = g_hash_table_new_full (g_str_hash,
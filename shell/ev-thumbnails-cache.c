@@ -0,0 +1,677 @@
+/* ev-thumbnails-cache.c
+ *  this file is part of evince, a gnome document viewer
+ *
+ * Copyright (C) 2013 Evince contributors
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "ev-thumbnails-cache.h"
+
+#define EV_THUMBNAILS_CACHE_KEY           "ev-thumbnails-cache"
+#define EV_THUMBNAILS_CACHE_MAGIC         "EVTHUMB2"
+#define EV_THUMBNAILS_CACHE_MAX_SIZE      (256 * 1024 * 1024)
+#define EV_THUMBNAILS_CACHE_MAX_DIMENSION 4096
+#define EV_THUMBNAILS_CACHE_DIR_MAX_SIZE  ((goffset)1024 * 1024 * 1024)
+#define EV_THUMBNAILS_CACHE_MAX_AGE       (30 * 24 * 60 * 60)
+#define N_ROTATIONS                       4
+
+/* A cache file contains the thumbnails of a single document:
+ *
+ *   EvThumbnailsCacheHeader
+ *   EvThumbnailsCacheEntry[n_pages * N_ROTATIONS]
+ *   pixel data
+ *
+ * Everything is stored in host byte order. The file is only valid for the
+ * document revision recorded in the header; a different modification time
+ * (in nanoseconds, a document can be rewritten several times within a
+ * second) or size replaces it with a new file, so that other processes
+ * still using the old one keep a consistent mapping. New thumbnails are
+ * appended to the pixel data and their entry is written afterwards, so an
+ * interrupted write only loses that thumbnail. Writers hold an exclusive
+ * flock() on the file, so several windows showing the same document don't
+ * overwrite each other.
+ * Entries with a zero offset haven't been rendered yet.
+ */
+typedef struct {
+	gchar   magic[8];
+	guint32 byte_order;
+	guint32 n_pages;
+	guint64 mtime;
+	guint64 size;
+} EvThumbnailsCacheHeader;
+
+typedef struct {
+	guint64 offset;
+	guint32 width;
+	guint32 height;
+	guint32 n_channels;
+	guint32 reserved;
+} EvThumbnailsCacheEntry;
+
+struct _EvThumbnailsCache {
+	gchar                  *filename;
+	gint                    n_pages;
+
+	gint                    fd;
+	EvThumbnailsCacheEntry *entries;
+
+	GMappedFile            *mapped;
+};
+
+typedef struct {
+	gchar *uri;
+	gint   n_pages;
+} EvThumbnailsCacheOpenData;
+
+typedef struct {
+	gchar   *filename;
+	goffset  size;
+	time_t   mtime;
+} EvThumbnailsCacheFile;
+
+static gsize
+entry_get_data_size (const EvThumbnailsCacheEntry *entry)
+{
+	return (gsize)entry->width * entry->height * entry->n_channels;
+}
+
+static goffset
+entries_offset (gint slot)
+{
+	return sizeof (EvThumbnailsCacheHeader) + slot * sizeof (EvThumbnailsCacheEntry);
+}
+
+static gboolean
+entry_has_valid_format (const EvThumbnailsCacheEntry *entry)
+{
+	return (entry->n_channels == 3 || entry->n_channels == 4) &&
+		entry->width > 0 && entry->width <= EV_THUMBNAILS_CACHE_MAX_DIMENSION &&
+		entry->height > 0 && entry->height <= EV_THUMBNAILS_CACHE_MAX_DIMENSION;
+}
+
+/* The file could have been truncated or written by a buggy version,
+ * so never trust an entry pointing outside the pixel data.
+ */
+static gboolean
+entry_is_valid (EvThumbnailsCache            *cache,
+		const EvThumbnailsCacheEntry *entry,
+		guint64                       length)
+{
+	guint64 data_start;
+	guint64 size;
+
+	if (!entry_has_valid_format (entry))
+		return FALSE;
+
+	data_start = entries_offset (cache->n_pages * N_ROTATIONS);
+	size = entry_get_data_size (entry);
+
+	return entry->offset >= data_start &&
+		entry->offset <= length &&
+		size <= length - entry->offset;
+}
+
+static gboolean
+write_all_at (gint          fd,
+	      gconstpointer buffer,
+	      gsize         count,
+	      goffset       offset)
+{
+	const gchar *data = buffer;
+
+	while (count > 0) {
+		gssize written;
+
+		written = pwrite (fd, data, count, offset);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+
+		data += written;
+		count -= written;
+		offset += written;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+lock_file (gint fd,
+	   gint operation)
+{
+	while (flock (fd, operation) < 0) {
+		if (errno != EINTR)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gchar *
+ev_thumbnails_cache_get_filename (const gchar *uri)
+{
+	gchar *checksum;
+	gchar *basename;
+	gchar *filename;
+
+	/* Same naming scheme as the freedesktop.org thumbnail cache */
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+	basename = g_strconcat (checksum, ".evthumbs", NULL);
+	filename = g_build_filename (g_get_user_cache_dir (),
+				     "evince", "thumbnails",
+				     basename, NULL);
+	g_free (checksum);
+	g_free (basename);
+
+	return filename;
+}
+
+static gboolean
+ev_thumbnails_cache_read (EvThumbnailsCache       *cache,
+			  EvThumbnailsCacheHeader *header)
+{
+	GMappedFile                   *mapped;
+	const gchar                   *contents;
+	gsize                          length;
+	gsize                          table_size;
+	const EvThumbnailsCacheHeader *file_header;
+	gint                           fd;
+
+	fd = g_open (cache->filename, O_RDWR, 0);
+	if (fd < 0)
+		return FALSE;
+
+	/* Don't read the table while another process is adding an entry */
+	if (!lock_file (fd, LOCK_SH)) {
+		close (fd);
+		return FALSE;
+	}
+
+	mapped = g_mapped_file_new_from_fd (fd, FALSE, NULL);
+	lock_file (fd, LOCK_UN);
+	if (!mapped) {
+		close (fd);
+		return FALSE;
+	}
+
+	contents = g_mapped_file_get_contents (mapped);
+	length = g_mapped_file_get_length (mapped);
+	table_size = cache->n_pages * N_ROTATIONS * sizeof (EvThumbnailsCacheEntry);
+	file_header = (const EvThumbnailsCacheHeader *)contents;
+
+	if (length < sizeof (EvThumbnailsCacheHeader) + table_size ||
+	    memcmp (file_header->magic, header->magic, sizeof (header->magic)) != 0 ||
+	    file_header->byte_order != header->byte_order ||
+	    file_header->n_pages != header->n_pages ||
+	    file_header->mtime != header->mtime ||
+	    file_header->size != header->size) {
+		g_mapped_file_unref (mapped);
+		close (fd);
+		return FALSE;
+	}
+
+	cache->entries = g_memdup (contents + sizeof (EvThumbnailsCacheHeader), table_size);
+	cache->mapped = mapped;
+	cache->fd = fd;
+
+	/* Recently used caches are the last ones to be evicted */
+	g_utime (cache->filename, NULL);
+
+	return TRUE;
+}
+
+static gboolean
+ev_thumbnails_cache_create (EvThumbnailsCache       *cache,
+			    EvThumbnailsCacheHeader *header)
+{
+	gchar *tmp_filename;
+	gsize  table_size;
+	gint   fd;
+
+	table_size = cache->n_pages * N_ROTATIONS * sizeof (EvThumbnailsCacheEntry);
+	cache->entries = g_malloc0 (table_size);
+
+	/* Other processes could still have the old file mapped, so replace
+	 * it instead of truncating it under their feet.
+	 */
+	tmp_filename = g_strconcat (cache->filename, ".XXXXXX", NULL);
+	fd = g_mkstemp_full (tmp_filename, O_RDWR, 0600);
+	if (fd < 0) {
+		g_warning ("Error creating thumbnails cache %s: %s",
+			   cache->filename, g_strerror (errno));
+		g_free (tmp_filename);
+		return FALSE;
+	}
+
+	if (!write_all_at (fd, header, sizeof (EvThumbnailsCacheHeader), 0) ||
+	    !write_all_at (fd, cache->entries, table_size, sizeof (EvThumbnailsCacheHeader)) ||
+	    g_rename (tmp_filename, cache->filename) < 0) {
+		g_warning ("Error writing thumbnails cache %s: %s",
+			   cache->filename, g_strerror (errno));
+		g_unlink (tmp_filename);
+		g_free (tmp_filename);
+		close (fd);
+		return FALSE;
+	}
+	g_free (tmp_filename);
+
+	cache->fd = fd;
+
+	return TRUE;
+}
+
+static void
+ev_thumbnails_cache_free (EvThumbnailsCache *cache)
+{
+	if (cache->fd >= 0)
+		close (cache->fd);
+
+	if (cache->mapped)
+		g_mapped_file_unref (cache->mapped);
+
+	g_free (cache->entries);
+	g_free (cache->filename);
+	g_free (cache);
+}
+
+static gint
+cache_file_compare_newest_first (const EvThumbnailsCacheFile *a,
+				 const EvThumbnailsCacheFile *b)
+{
+	if (a->mtime == b->mtime)
+		return 0;
+
+	return a->mtime > b->mtime ? -1 : 1;
+}
+
+static void
+cache_file_free (EvThumbnailsCacheFile *file)
+{
+	g_free (file->filename);
+	g_slice_free (EvThumbnailsCacheFile, file);
+}
+
+/* Removes the caches that haven't been used for a while, and the least
+ * recently used ones when the directory grows too big.
+ */
+static void
+ev_thumbnails_cache_evict (const gchar *dirname,
+			   const gchar *current)
+{
+	GDir        *dir;
+	const gchar *name;
+	GList       *files = NULL;
+	GList       *l;
+	goffset      total_size = 0;
+	time_t       now;
+
+	dir = g_dir_open (dirname, 0, NULL);
+	if (!dir)
+		return;
+
+	while ((name = g_dir_read_name (dir))) {
+		EvThumbnailsCacheFile *file;
+		GStatBuf               st;
+		gchar                 *filename;
+
+		/* Also catches temporary files left behind by a crash */
+		if (!strstr (name, ".evthumbs"))
+			continue;
+
+		filename = g_build_filename (dirname, name, NULL);
+		if (g_stat (filename, &st) < 0 || !S_ISREG (st.st_mode)) {
+			g_free (filename);
+			continue;
+		}
+
+		file = g_slice_new (EvThumbnailsCacheFile);
+		file->filename = filename;
+		file->size = st.st_size;
+		file->mtime = st.st_mtime;
+		files = g_list_prepend (files, file);
+	}
+	g_dir_close (dir);
+
+	files = g_list_sort (files, (GCompareFunc)cache_file_compare_newest_first);
+
+	now = time (NULL);
+	for (l = files; l; l = g_list_next (l)) {
+		EvThumbnailsCacheFile *file = (EvThumbnailsCacheFile *)l->data;
+
+		total_size += file->size;
+		if (g_strcmp0 (file->filename, current) == 0)
+			continue;
+
+		if (now - file->mtime > EV_THUMBNAILS_CACHE_MAX_AGE ||
+		    total_size > EV_THUMBNAILS_CACHE_DIR_MAX_SIZE)
+			g_unlink (file->filename);
+	}
+
+	g_list_free_full (files, (GDestroyNotify)cache_file_free);
+}
+
+/* Without sub-second timestamps, the document could still be rewritten
+ * with the same size and modification time after its thumbnails were
+ * rendered. Don't use a cache file until that can't happen anymore.
+ */
+static gboolean
+ev_thumbnails_cache_can_cache (guint64 mtime)
+{
+	guint64 seconds = mtime / G_GUINT64_CONSTANT (1000000000);
+
+	if (mtime == 0)
+		return FALSE;
+
+	return mtime % G_GUINT64_CONSTANT (1000000000) != 0 ||
+		seconds + 1 < (guint64)time (NULL);
+}
+
+/* Runs in a thread: querying the document can block on I/O */
+static EvThumbnailsCache *
+ev_thumbnails_cache_open (const gchar  *uri,
+			  gint          n_pages,
+			  GCancellable *cancellable)
+{
+	static gsize            evicted = 0;
+	EvThumbnailsCache      *cache;
+	EvThumbnailsCacheHeader header;
+	GFile                  *file;
+	GFileInfo              *info;
+	gchar                  *dirname;
+
+	cache = g_new0 (EvThumbnailsCache, 1);
+	cache->n_pages = n_pages;
+	cache->fd = -1;
+
+	if (!uri)
+		return cache;
+
+	file = g_file_new_for_uri (uri);
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				  0, cancellable, NULL);
+	g_object_unref (file);
+	if (!info)
+		return cache;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, EV_THUMBNAILS_CACHE_MAGIC, sizeof (header.magic));
+	header.byte_order = G_BYTE_ORDER;
+	header.n_pages = cache->n_pages;
+	header.mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) *
+		G_GUINT64_CONSTANT (1000000000) +
+		(guint64)g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC) * 1000;
+	header.size = g_file_info_get_size (info);
+	g_object_unref (info);
+
+	if (!ev_thumbnails_cache_can_cache (header.mtime))
+		return cache;
+
+	cache->filename = ev_thumbnails_cache_get_filename (uri);
+	dirname = g_path_get_dirname (cache->filename);
+	g_mkdir_with_parents (dirname, 0700);
+
+	if (!ev_thumbnails_cache_read (cache, &header)) {
+		g_free (cache->entries);
+		cache->entries = NULL;
+		ev_thumbnails_cache_create (cache, &header);
+	}
+
+	if (g_once_init_enter (&evicted)) {
+		ev_thumbnails_cache_evict (dirname, cache->filename);
+		g_once_init_leave (&evicted, 1);
+	}
+	g_free (dirname);
+
+	return cache;
+}
+
+static void
+ev_thumbnails_cache_open_data_free (EvThumbnailsCacheOpenData *data)
+{
+	g_free (data->uri);
+	g_slice_free (EvThumbnailsCacheOpenData, data);
+}
+
+static void
+ev_thumbnails_cache_open_thread (GTask        *task,
+				 gpointer      source_object,
+				 gpointer      task_data,
+				 GCancellable *cancellable)
+{
+	EvThumbnailsCacheOpenData *data = (EvThumbnailsCacheOpenData *)task_data;
+
+	g_task_return_pointer (task,
+			       ev_thumbnails_cache_open (data->uri, data->n_pages, cancellable),
+			       (GDestroyNotify)ev_thumbnails_cache_free);
+}
+
+/**
+ * ev_thumbnails_cache_load_async:
+ * @document: an #EvDocument
+ * @cancellable: (allow-none): a #GCancellable
+ * @callback: the function to call when the cache is ready
+ * @user_data: data to pass to @callback
+ *
+ * Opens the persistent thumbnails cache of @document in a thread, creating
+ * it the first time. Call ev_thumbnails_cache_load_finish() from @callback.
+ */
+void
+ev_thumbnails_cache_load_async (EvDocument         *document,
+				GCancellable       *cancellable,
+				GAsyncReadyCallback callback,
+				gpointer            user_data)
+{
+	EvThumbnailsCache         *cache;
+	EvThumbnailsCacheOpenData *data;
+	GTask                     *task;
+
+	task = g_task_new (document, cancellable, callback, user_data);
+
+	cache = g_object_get_data (G_OBJECT (document), EV_THUMBNAILS_CACHE_KEY);
+	if (cache) {
+		g_task_return_pointer (task, cache, NULL);
+		g_object_unref (task);
+		return;
+	}
+
+	data = g_slice_new (EvThumbnailsCacheOpenData);
+	data->uri = g_strdup (ev_document_get_uri (document));
+	data->n_pages = ev_document_get_n_pages (document);
+	g_task_set_task_data (task, data, (GDestroyNotify)ev_thumbnails_cache_open_data_free);
+	g_task_run_in_thread (task, ev_thumbnails_cache_open_thread);
+	g_object_unref (task);
+}
+
+/**
+ * ev_thumbnails_cache_load_finish:
+ * @document: an #EvDocument
+ * @result: the #GAsyncResult passed to the callback
+ * @error: (allow-none): return location for a #GError
+ *
+ * Returns: (transfer none): the #EvThumbnailsCache of @document, owned by
+ * @document, or %NULL if the load was cancelled
+ */
+EvThumbnailsCache *
+ev_thumbnails_cache_load_finish (EvDocument   *document,
+				 GAsyncResult *result,
+				 GError      **error)
+{
+	EvThumbnailsCache *cache;
+	EvThumbnailsCache *current;
+
+	g_return_val_if_fail (g_task_is_valid (result, document), NULL);
+
+	cache = g_task_propagate_pointer (G_TASK (result), error);
+	if (!cache)
+		return NULL;
+
+	/* Another load finished first */
+	current = g_object_get_data (G_OBJECT (document), EV_THUMBNAILS_CACHE_KEY);
+	if (current) {
+		if (current != cache)
+			ev_thumbnails_cache_free (cache);
+		return current;
+	}
+
+	g_object_set_data_full (G_OBJECT (document),
+				EV_THUMBNAILS_CACHE_KEY,
+				cache,
+				(GDestroyNotify)ev_thumbnails_cache_free);
+
+	return cache;
+}
+
+static void
+mapped_pixels_free (guchar  *pixels,
+		    gpointer data)
+{
+	g_mapped_file_unref ((GMappedFile *)data);
+}
+
+/**
+ * ev_thumbnails_cache_lookup:
+ * @cache: an #EvThumbnailsCache
+ * @page: the page index
+ * @rotation: the rotation in degrees
+ *
+ * Returns: (transfer full): the cached thumbnail, or %NULL. The pixels
+ * point into the mapped cache file and must not be modified.
+ */
+GdkPixbuf *
+ev_thumbnails_cache_lookup (EvThumbnailsCache *cache,
+			    gint               page,
+			    gint               rotation)
+{
+	EvThumbnailsCacheEntry *entry;
+	gint                    slot;
+
+	if (!cache->entries || page < 0 || page >= cache->n_pages)
+		return NULL;
+
+	slot = page * N_ROTATIONS + (rotation / 90) % N_ROTATIONS;
+	entry = &cache->entries[slot];
+	if (entry->offset == 0 || !entry_has_valid_format (entry))
+		return NULL;
+
+	/* Thumbnails stored after the file was mapped need a new mapping */
+	if (!cache->mapped ||
+	    !entry_is_valid (cache, entry, g_mapped_file_get_length (cache->mapped))) {
+		if (cache->mapped)
+			g_mapped_file_unref (cache->mapped);
+		cache->mapped = g_mapped_file_new_from_fd (cache->fd, FALSE, NULL);
+		if (!cache->mapped)
+			return NULL;
+	}
+
+	if (!entry_is_valid (cache, entry, g_mapped_file_get_length (cache->mapped)))
+		return NULL;
+
+	return gdk_pixbuf_new_from_data ((guchar *)g_mapped_file_get_contents (cache->mapped) + entry->offset,
+					 GDK_COLORSPACE_RGB,
+					 entry->n_channels == 4,
+					 8,
+					 entry->width,
+					 entry->height,
+					 entry->width * entry->n_channels,
+					 mapped_pixels_free,
+					 g_mapped_file_ref (cache->mapped));
+}
+
+/**
+ * ev_thumbnails_cache_store:
+ * @cache: an #EvThumbnailsCache
+ * @page: the page index
+ * @rotation: the rotation in degrees
+ * @pixbuf: the thumbnail of @page rendered with @rotation
+ *
+ * Appends @pixbuf to the cache file.
+ */
+void
+ev_thumbnails_cache_store (EvThumbnailsCache *cache,
+			   gint               page,
+			   gint               rotation,
+			   GdkPixbuf         *pixbuf)
+{
+	EvThumbnailsCacheEntry entry;
+	const guchar          *pixels;
+	gint                   rowstride;
+	gsize                  row_size;
+	struct stat            st;
+	gint                   slot;
+	guint                  i;
+
+	if (cache->fd < 0 || page < 0 || page >= cache->n_pages)
+		return;
+
+	if (gdk_pixbuf_get_colorspace (pixbuf) != GDK_COLORSPACE_RGB ||
+	    gdk_pixbuf_get_bits_per_sample (pixbuf) != 8)
+		return;
+
+	entry.width = gdk_pixbuf_get_width (pixbuf);
+	entry.height = gdk_pixbuf_get_height (pixbuf);
+	entry.n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+	entry.reserved = 0;
+	if (!entry_has_valid_format (&entry))
+		return;
+
+	if (!lock_file (cache->fd, LOCK_EX))
+		return;
+
+	/* Other processes could have appended thumbnails too, so the real
+	 * end of the file is the only safe place to write to.
+	 */
+	if (fstat (cache->fd, &st) < 0 ||
+	    st.st_size < entries_offset (cache->n_pages * N_ROTATIONS) ||
+	    st.st_size + entry_get_data_size (&entry) > EV_THUMBNAILS_CACHE_MAX_SIZE) {
+		lock_file (cache->fd, LOCK_UN);
+		return;
+	}
+	entry.offset = st.st_size;
+
+	pixels = gdk_pixbuf_get_pixels (pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	row_size = entry.width * entry.n_channels;
+	for (i = 0; i < entry.height; i++) {
+		if (!write_all_at (cache->fd, pixels + i * rowstride, row_size,
+				   entry.offset + i * row_size)) {
+			lock_file (cache->fd, LOCK_UN);
+			return;
+		}
+	}
+
+	slot = page * N_ROTATIONS + (rotation / 90) % N_ROTATIONS;
+	if (write_all_at (cache->fd, &entry, sizeof (entry), entries_offset (slot)))
+		cache->entries[slot] = entry;
+
+	lock_file (cache->fd, LOCK_UN);
+}
@@ -0,0 +1,50 @@
+/* ev-thumbnails-cache.h
+ *  this file is part of evince, a gnome document viewer
+ *
+ * Copyright (C) 2013 Evince contributors
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef EV_THUMBNAILS_CACHE_H
+#define EV_THUMBNAILS_CACHE_H
+
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "ev-document.h"
+
+G_BEGIN_DECLS
+
+typedef struct _EvThumbnailsCache EvThumbnailsCache;
+
+void               ev_thumbnails_cache_load_async  (EvDocument         *document,
+						    GCancellable       *cancellable,
+						    GAsyncReadyCallback callback,
+						    gpointer            user_data);
+EvThumbnailsCache *ev_thumbnails_cache_load_finish (EvDocument         *document,
+						    GAsyncResult       *result,
+						    GError            **error);
+GdkPixbuf         *ev_thumbnails_cache_lookup      (EvThumbnailsCache  *cache,
+						    gint                page,
+						    gint                rotation);
+void               ev_thumbnails_cache_store       (EvThumbnailsCache  *cache,
+						    gint                page,
+						    gint                rotation,
+						    GdkPixbuf          *pixbuf);
+
+G_END_DECLS
+
+#endif /* EV_THUMBNAILS_CACHE_H */
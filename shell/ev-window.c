@@ -361,6 +361,8 @@ static void     view_external_link_cb                   (EvWindow         *windo
 							 EvLinkAction     *action);
 static void     ev_window_load_file_remote              (EvWindow         *ev_window,
 							 GFile            *source_file);
+static void     ev_window_download_remote_copy          (EvWindow         *ev_window);
+static void     ev_window_reload_local                  (EvWindow         *ev_window);
 static void     ev_window_media_player_key_pressed      (EvWindow         *window,
 							 const gchar      *key,
 							 gpointer          user_data);
@@ -1566,6 +1568,19 @@ ev_window_handle_link (EvWindow *ev_window,
 	}
 }
 
+static gboolean
+ev_window_uri_is_native (const gchar *uri)
+{
+	GFile   *file;
+	gboolean is_native;
+
+	file = g_file_new_for_uri (uri);
+	is_native = g_file_is_native (file);
+	g_object_unref (file);
+
+	return is_native;
+}
+
 /* This callback will executed when load job will be finished.
  *
  * Since the flow of the error dialog is very confusing, we assume that both
@@ -1588,6 +1603,14 @@ ev_window_load_job_cb (EvJob *job,
 
 	ev_window_hide_loading_message (ev_window);
 
+	/* Remote documents loaded in place show their progress while the
+	 * load job runs, see ev_window_open_uri() */
+	if (!ev_window->priv->local_uri &&
+	    !ev_window_uri_is_native (job_load->uri)) {
+		ev_window_clear_progress_idle (ev_window);
+		ev_window_set_message_area (ev_window, NULL);
+	}
+
 	/* Success! */
 	if (!ev_job_is_failed (job)) {
 		ev_document_model_set_document (ev_window->priv->model, document);
@@ -1632,6 +1655,13 @@ ev_window_load_job_cb (EvJob *job,
 		g_signal_connect_swapped (ev_window->priv->monitor, "changed",
 					  G_CALLBACK (ev_window_document_changed),
 					  ev_window);
+
+		/* A document read in place keeps fetching data from the
+		 * remote location while it's used, so download a local
+		 * copy and switch to it once it's complete */
+		if (!ev_window->priv->local_uri &&
+		    !ev_window_uri_is_native (job_load->uri))
+			ev_window_download_remote_copy (ev_window);
 		
 		ev_window_clear_load_job (ev_window);
 		return;
@@ -1672,6 +1702,25 @@ ev_window_load_job_cb (EvJob *job,
 
 		ev_job_load_set_password (job_load, NULL);
 		ev_password_view_ask_password (EV_PASSWORD_VIEW (ev_window->priv->password_view));
+	} else if ((g_error_matches (job->error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED) ||
+		    g_error_matches (job->error, G_IO_ERROR, G_IO_ERROR_NOT_MOUNTED)) &&
+		   !ev_window->priv->local_uri &&
+		   !ev_window_uri_is_native (job_load->uri)) {
+		GFile *source_file;
+
+		/* The remote document can't be read in place, because it's
+		 * compressed or the backend can only load local files. Fall
+		 * back to loading a local copy, which also mounts the
+		 * location when needed. */
+		source_file = g_file_new_for_uri (ev_window->priv->uri);
+		ev_window_clear_load_job (ev_window);
+
+		ev_window->priv->load_job = ev_job_load_new (ev_window->priv->uri);
+		g_signal_connect (ev_window->priv->load_job,
+				  "finished",
+				  G_CALLBACK (ev_window_load_job_cb),
+				  ev_window);
+		ev_window_load_file_remote (ev_window, source_file);
 	} else {
 		text = g_uri_unescape_string (job_load->uri, NULL);
 		display_name = g_markup_escape_text (text, -1);
@@ -1789,13 +1838,30 @@ ev_window_reset_progress_cancellable (EvWindow *ev_window)
 		ev_window->priv->progress_cancellable = g_cancellable_new ();
 }
 
+static void
+ev_window_cancel_load (EvWindow *ev_window)
+{
+	ev_window_clear_load_job (ev_window);
+	ev_window_clear_local_uri (ev_window);
+	g_free (ev_window->priv->uri);
+	ev_window->priv->uri = NULL;
+
+	ev_window_hide_loading_message (ev_window);
+}
+
 static void
 ev_window_progress_response_cb (EvProgressMessageArea *area,
 				gint                   response,
 				EvWindow              *ev_window)
 {
-	if (response == GTK_RESPONSE_CANCEL)
+	if (response == GTK_RESPONSE_CANCEL) {
 		g_cancellable_cancel (ev_window->priv->progress_cancellable);
+
+		/* A remote document being read in place has no copy to
+		 * cancel, its load job does the transfer */
+		if (ev_window->priv->load_job && !ev_window->priv->local_uri)
+			ev_window_cancel_load (ev_window);
+	}
 	ev_window_set_message_area (ev_window, NULL);
 }
 
@@ -1933,13 +1999,8 @@ window_open_file_copy_ready_cb (GFile        *source,
 					       ev_window);
 		g_object_unref (operation);
 	} else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-		ev_window_clear_load_job (ev_window);
-		ev_window_clear_local_uri (ev_window);
-		g_free (ev_window->priv->uri);
-		ev_window->priv->uri = NULL;
+		ev_window_cancel_load (ev_window);
 		g_object_unref (source);
-
-		ev_window_hide_loading_message (ev_window);
 	} else {
 		ev_window_load_remote_failed (ev_window, error);
 		g_object_unref (source);
@@ -1974,6 +2035,36 @@ window_open_file_copy_progress_cb (goffset   n_bytes,
 	g_free (status);
 }
 
+static gboolean
+ev_window_create_local_uri (EvWindow *ev_window,
+			    GFile    *source_file)
+{
+	char   *base_name, *template;
+	GFile  *tmp_file;
+	GError *err = NULL;
+
+	/* We'd like to keep extension of source uri since
+	 * it helps to resolve some mime types, say cbz.
+	 */
+	base_name = g_file_get_basename (source_file);
+	template = g_strdup_printf ("document.XXXXXX-%s", base_name);
+	g_free (base_name);
+
+	tmp_file = ev_mkstemp_file (template, &err);
+	g_free (template);
+	if (tmp_file == NULL) {
+		ev_window_error_message (ev_window, err,
+					 "%s", _("Failed to load remote file."));
+		g_error_free (err);
+		return FALSE;
+	}
+
+	ev_window->priv->local_uri = g_file_get_uri (tmp_file);
+	g_object_unref (tmp_file);
+
+	return TRUE;
+}
+
 static void
 ev_window_load_file_remote (EvWindow *ev_window,
 			    GFile    *source_file)
@@ -1981,28 +2072,8 @@ ev_window_load_file_remote (EvWindow *ev_window,
 	GFile *target_file;
 	
 	if (!ev_window->priv->local_uri) {
-		char *base_name, *template;
-                GFile *tmp_file;
-                GError *err = NULL;
-
-		/* We'd like to keep extension of source uri since
-		 * it helps to resolve some mime types, say cbz.
-                 */
-		base_name = g_file_get_basename (source_file);
-                template = g_strdup_printf ("document.XXXXXX-%s", base_name);
-                g_free (base_name);
-
-                tmp_file = ev_mkstemp_file (template, &err);
-		g_free (template);
-                if (tmp_file == NULL) {
-                        ev_window_error_message (ev_window, err,
-                                                 "%s", _("Failed to load remote file."));
-                        g_error_free (err);
-                        return;
-                }
-
-		ev_window->priv->local_uri = g_file_get_uri (tmp_file);
-		g_object_unref (tmp_file);
+		if (!ev_window_create_local_uri (ev_window, source_file))
+			return;
 
 		ev_job_load_set_uri (EV_JOB_LOAD (ev_window->priv->load_job),
 				     ev_window->priv->local_uri);
@@ -2025,6 +2096,98 @@ ev_window_load_file_remote (EvWindow *ev_window,
 					 (GSourceFunc)show_loading_progress);
 }
 
+static void
+remote_copy_ready_cb (GFile        *source,
+		      GAsyncResult *async_result,
+		      EvWindow     *ev_window)
+{
+	GError  *error = NULL;
+	gchar   *uri;
+	gboolean current;
+
+	g_file_copy_finish (source, async_result, &error);
+
+	/* The window may have moved to another document meanwhile */
+	uri = g_file_get_uri (source);
+	current = ev_window->priv->uri && ev_window->priv->local_uri &&
+		g_strcmp0 (uri, ev_window->priv->uri) == 0;
+	g_free (uri);
+
+	if (!current) {
+		g_clear_error (&error);
+		g_object_unref (source);
+		g_object_unref (ev_window);
+
+		return;
+	}
+
+	ev_window_clear_progress_idle (ev_window);
+	ev_window_set_message_area (ev_window, NULL);
+
+	if (error) {
+		/* Keep reading the document in place */
+		ev_window_clear_local_uri (ev_window);
+		g_error_free (error);
+		g_object_unref (source);
+	} else {
+		EvDocument *document = ev_window->priv->document;
+
+		g_file_query_info_async (source,
+					 G_FILE_ATTRIBUTE_TIME_MODIFIED,
+					 0, G_PRIORITY_DEFAULT,
+					 NULL,
+					 (GAsyncReadyCallback)set_uri_mtime,
+					 ev_window);
+
+		/* Reloading would lose the form fields filled out and the
+		 * annotations added meanwhile. Keep reading the document in
+		 * place, the copy is still used when it's reloaded. */
+		if ((EV_IS_DOCUMENT_FORMS (document) &&
+		     ev_document_forms_document_is_modified (EV_DOCUMENT_FORMS (document))) ||
+		    (EV_IS_DOCUMENT_ANNOTATIONS (document) &&
+		     ev_document_annotations_document_is_modified (EV_DOCUMENT_ANNOTATIONS (document)))) {
+			g_object_unref (ev_window);
+
+			return;
+		}
+
+		ev_window_clear_reload_job (ev_window);
+		ev_window->priv->in_reload = TRUE;
+		ev_window_reload_local (ev_window);
+	}
+
+	g_object_unref (ev_window);
+}
+
+static void
+ev_window_download_remote_copy (EvWindow *ev_window)
+{
+	GFile *source_file;
+	GFile *target_file;
+
+	source_file = g_file_new_for_uri (ev_window->priv->uri);
+	if (!ev_window_create_local_uri (ev_window, source_file)) {
+		g_object_unref (source_file);
+		return;
+	}
+
+	ev_window_reset_progress_cancellable (ev_window);
+
+	target_file = g_file_new_for_uri (ev_window->priv->local_uri);
+	g_file_copy_async (source_file, target_file,
+			   G_FILE_COPY_OVERWRITE,
+			   G_PRIORITY_DEFAULT,
+			   ev_window->priv->progress_cancellable,
+			   (GFileProgressCallback)window_open_file_copy_progress_cb,
+			   ev_window,
+			   (GAsyncReadyCallback)remote_copy_ready_cb,
+			   g_object_ref (ev_window));
+	g_object_unref (target_file);
+
+	ev_window_show_progress_message (ev_window, 1,
+					 (GSourceFunc)show_loading_progress);
+}
+
 void
 ev_window_open_uri (EvWindow       *ev_window,
 		    const char     *uri,
@@ -2099,13 +2262,17 @@ ev_window_open_uri (EvWindow       *ev_window,
 			  G_CALLBACK (ev_window_load_job_cb),
 			  ev_window);
 
+	/* Remote documents are loaded in place when the backend supports
+	 * it, see ev_window_load_job_cb() for the fallback */
 	if (!g_file_is_native (source_file) && !ev_window->priv->local_uri) {
-		ev_window_load_file_remote (ev_window, source_file);
-	} else {
-		ev_window_show_loading_message (ev_window);
-		g_object_unref (source_file);
-		ev_job_scheduler_push_job (ev_window->priv->load_job, EV_JOB_PRIORITY_NONE);
+		ev_window_reset_progress_cancellable (ev_window);
+		ev_window_show_progress_message (ev_window, 1,
+						 (GSourceFunc)show_loading_progress);
 	}
+
+	ev_window_show_loading_message (ev_window);
+	g_object_unref (source_file);
+	ev_job_scheduler_push_job (ev_window->priv->load_job, EV_JOB_PRIORITY_NONE);
 }
 
 void
@@ -4273,6 +4440,7 @@ ev_window_run_presentation (EvWindow *window)
 	guint    current_page;
 	guint    rotation;
 	gboolean inverted_colors;
+	guint    page_cache_mb;
 
 	if (EV_WINDOW_IS_PRESENTATION (window))
 		return;
@@ -4289,6 +4457,10 @@ ev_window_run_presentation (EvWindow *window)
 								    current_page,
 								    rotation,
 								    inverted_colors);
+	page_cache_mb = g_settings_get_uint (ev_window_ensure_settings (window),
+					     GS_PAGE_CACHE_SIZE);
+	ev_view_presentation_set_page_cache_size (EV_VIEW_PRESENTATION (window->priv->presentation_view),
+						  page_cache_mb * 1024 * 1024);
 	g_signal_connect_swapped (window->priv->presentation_view, "finished",
 				  G_CALLBACK (ev_window_view_presentation_finished),
 				  window);
@@ -5697,6 +5869,7 @@ ev_window_dispose (GObject *object)
 
 	ev_window_clear_progress_idle (window);
 	if (priv->progress_cancellable) {
+		g_cancellable_cancel (priv->progress_cancellable);
 		g_object_unref (priv->progress_cancellable);
 		priv->progress_cancellable = NULL;
 	}
@@ -7327,6 +7500,8 @@ ev_window_init (EvWindow *ev_window)
 	ev_view_set_page_cache_size (EV_VIEW (ev_window->priv->view),
 				     page_cache_mb * 1024 * 1024);
 	ev_view_set_model (EV_VIEW (ev_window->priv->view), ev_window->priv->model);
+	ev_sidebar_thumbnails_set_view (EV_SIDEBAR_THUMBNAILS (ev_window->priv->sidebar_thumbs),
+					EV_VIEW (ev_window->priv->view));
 
 	ev_window->priv->password_view = ev_password_view_new (GTK_WINDOW (ev_window));
 	g_signal_connect_swapped (ev_window->priv->password_view,
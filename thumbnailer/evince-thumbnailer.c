@@ -111,6 +111,27 @@ evince_thumbnailer_get_document (GFile *file)
 	if (!g_file_is_native (file)) {
 		gchar *base_name, *template;
 
+		/* Read the remote document in place if possible, so that
+		 * only the parts needed for the thumbnail are transferred */
+		document = ev_document_factory_get_document_for_gfile (file,
+								       EV_DOCUMENT_LOAD_FLAG_NONE,
+								       NULL, &error);
+		if (document && !error)
+			return document;
+
+		/* Only copy the document when it can't be read in place */
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+			/* FIXME: Create a thumb for cryp docs */
+			if (!g_error_matches (error, EV_DOCUMENT_ERROR, EV_DOCUMENT_ERROR_ENCRYPTED))
+				g_printerr ("Error loading remote document: %s\n", error->message);
+			g_error_free (error);
+			if (document)
+				g_object_unref (document);
+
+			return NULL;
+		}
+		g_clear_error (&error);
+
 		base_name = g_file_get_basename (file);
 		template = g_strdup_printf ("document.XXXXXX-%s", base_name);
 		g_free (base_name);